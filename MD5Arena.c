@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "MD5Arena.h"
+
+size_t MD5ArenaSizeForAllocation(size_t size)
+{
+	return (size + MD5_ARENA_ALIGNMENT - 1) & ~((size_t)MD5_ARENA_ALIGNMENT - 1);
+}
+
+int MD5ArenaCreate(MD5Arena* arena, size_t size)
+{
+	memset(arena, 0, sizeof(MD5Arena));
+	size = MD5ArenaSizeForAllocation(size);
+
+	/* allocations are aligned relative to the start of the block */
+	arena->data = (unsigned char*)malloc(size ? size : 1);
+
+	if (!arena->data)
+	{
+		return 0;
+	}
+
+	arena->size = size;
+
+	return 1;
+}
+
+void* MD5ArenaAlloc(MD5Arena* arena, size_t size)
+{
+	void* ptr = NULL;
+
+	size = MD5ArenaSizeForAllocation(size);
+
+	if (arena->used + size > arena->size)
+	{
+		return NULL;
+	}
+
+	ptr = arena->data + arena->used;
+	arena->used += size;
+
+	return ptr;
+}
+
+void* MD5ArenaCalloc(MD5Arena* arena, size_t size)
+{
+	void* ptr = MD5ArenaAlloc(arena, size);
+
+	if (ptr)
+	{
+		memset(ptr, 0, size);
+	}
+
+	return ptr;
+}
+
+void MD5ArenaReset(MD5Arena* arena)
+{
+	arena->used = 0;
+}
+
+void MD5ArenaDestroy(MD5Arena* arena)
+{
+	free(arena->data);
+	memset(arena, 0, sizeof(MD5Arena));
+}
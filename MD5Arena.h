@@ -0,0 +1,78 @@
+/*
+ * Linear arena allocator
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5ARENA_H
+#define MD5ARENA_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#define MD5_ARENA_ALIGNMENT 16 	/* alignment of each allocation */
+
+/*
+** A linear allocator that hands out memory from one contiguous block. Memory
+** is released all at once by either resetting or destroying the arena.
+*/
+typedef struct
+{
+	unsigned char* data; 		/* the block */
+	size_t size; 				/* size of the block in bytes */
+	size_t used; 				/* # of bytes handed out */
+}
+MD5Arena;
+
+/*
+** Returns the amount of bytes an arena needs to hold an allocation of size
+** bytes, including the padding for the alignment.
+*/
+size_t MD5ArenaSizeForAllocation(size_t size);
+
+/*
+** Creates an arena of size bytes. Returns 0 if it fails.
+*/
+int MD5ArenaCreate(MD5Arena* arena, size_t size);
+
+/*
+** Allocates size bytes from the arena. Returns NULL if the arena is 
+** exhausted. The memory is not initialized.
+*/
+void* MD5ArenaAlloc(MD5Arena* arena, size_t size);
+
+/*
+** Same as MD5ArenaAlloc, but zeros the memory.
+*/
+void* MD5ArenaCalloc(MD5Arena* arena, size_t size);
+
+/*
+** Releases all allocations of the arena at once.
+*/
+void MD5ArenaReset(MD5Arena* arena);
+
+/*
+** Destroys the arena and releases its block.
+*/
+void MD5ArenaDestroy(MD5Arena* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5ARENA_H */
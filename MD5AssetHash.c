@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include "MD5AssetHash.h"
+
+#define FNV_PRIME 1099511628211ULL
+
+MD5AssetHash MD5AssetHashBytes(MD5AssetHash hash, const void* bytes, size_t size)
+{
+	const unsigned char* b = (const unsigned char*)bytes;
+	size_t i = 0;
+
+	for (i = 0; i < size; i++)
+	{
+		hash = (hash ^ b[i])*FNV_PRIME;
+	}
+
+	return hash;
+}
+
+int MD5AssetHashFile(MD5AssetHash* hash, const char* filename)
+{
+	unsigned char buffer[4096];
+	FILE* file = NULL;
+	size_t size = 0;
+
+	file = fopen(filename, "rb");
+
+	if (!file)
+	{
+		return 0;
+	}
+
+	*hash = MD5_ASSET_HASH_BASIS;
+
+	while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		*hash = MD5AssetHashBytes(*hash, buffer, size);
+	}
+
+	size = ferror(file);
+	fclose(file);
+
+	return !size;
+}
+
+int MD5AssetFilesEqual(const char* filename, const char* otherFilename)
+{
+	unsigned char buffer[4096];
+	unsigned char otherBuffer[4096];
+	FILE* file = NULL;
+	FILE* otherFile = NULL;
+	size_t size = 0;
+	int equal = 0;
+
+	if (!filename || !otherFilename)
+	{
+		return 0;
+	}
+
+	file = fopen(filename, "rb");
+	otherFile = fopen(otherFilename, "rb");
+
+	if (file && otherFile)
+	{
+		do
+		{
+			size = fread(buffer, 1, sizeof(buffer), file);
+			equal = fread(otherBuffer, 1, sizeof(otherBuffer), otherFile) == size &&
+				!memcmp(buffer, otherBuffer, size);
+		}
+		while (equal && size > 0);
+
+		equal = equal && !ferror(file) && !ferror(otherFile);
+	}
+
+	if (file)
+	{
+		fclose(file);
+	}
+
+	if (otherFile)
+	{
+		fclose(otherFile);
+	}
+
+	return equal;
+}
@@ -0,0 +1,57 @@
+/*
+ * Content hashes of asset files
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5ASSETHASH_H
+#define MD5ASSETHASH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+/*
+** 64 bit FNV-1a hash of the content of an asset. Files with the same hash 
+** are compared byte by byte (see MD5AssetFilesEqual) before they are 
+** treated as the same asset.
+*/
+typedef unsigned long long MD5AssetHash;
+
+#define MD5_ASSET_HASH_BASIS 14695981039346656037ULL 	/* hash of no bytes */
+
+/*
+** Continues hash with size bytes.
+*/
+MD5AssetHash MD5AssetHashBytes(MD5AssetHash hash, const void* bytes, size_t size);
+
+/*
+** Hashes the content of the file. Returns 0 if it cannot be read.
+*/
+int MD5AssetHashFile(MD5AssetHash* hash, const char* filename);
+
+/*
+** Compares the content of two files. Returns 1 if both can be read and are
+** equal, 0 otherwise.
+*/
+int MD5AssetFilesEqual(const char* filename, const char* otherFilename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5ASSETHASH_H */
@@ -0,0 +1,869 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "MD5CompressedAnimation.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define SQRT2 1.41421356237f
+
+/*
+** Quantizes the unit quaternion q to 48 bits. The largest component is
+** dropped (and made positive), its index is stored in the top 2 bits and 
+** the remaining components are stored with 15 bits each.
+*/
+static void QuaternionPack(unsigned short* key, const float* q)
+{
+	unsigned long long bits = 0;
+	float sign = 1.0f;
+	int largest = 0;
+	int i = 0;
+	int shift = 30;
+	unsigned int c = 0;
+
+	for (i = 1; i < 4; i++)
+	{
+		if (fabsf(q[i]) > fabsf(q[largest]))
+		{
+			largest = i;
+		}
+	}
+
+	sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+	bits = (unsigned long long)largest << 45;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		/* the remaining components are in -1/sqrt(2) .. 1/sqrt(2) */
+		c = (unsigned int)((sign*q[i]*SQRT2*0.5f + 0.5f)*32767.0f + 0.5f);
+		c = c > 32767 ? 32767 : c;
+		bits |= (unsigned long long)c << shift;
+		shift -= 15;
+	}
+
+	key[0] = (unsigned short)(bits >> 32);
+	key[1] = (unsigned short)(bits >> 16);
+	key[2] = (unsigned short)bits;
+}
+
+static void QuaternionUnpack(float* q, const unsigned short* key)
+{
+	unsigned long long bits = ((unsigned long long)key[0] << 32) | 
+		((unsigned long long)key[1] << 16) | key[2];
+	int largest = (int)(bits >> 45) & 3;
+	int shift = 30;
+	float sum = 0.0f;
+	int i = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		q[i] = (((bits >> shift) & 0x7FFF)/32767.0f - 0.5f)*2.0f/SQRT2;
+		sum += q[i]*q[i];
+		shift -= 15;
+	}
+
+	q[largest] = sqrtf(fmaxf(0.0f, 1.0f - sum));
+}
+
+/*
+** Normalized linear interpolation between the quaternions a and b.
+*/
+static void QuaternionNlerp(float* q, const float* a, const float* b, float t)
+{
+	float dot = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+	float s = dot < 0.0f ? -t : t;
+	float len = 0.0f;
+	int i = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		q[i] = (1.0f - t)*a[i] + s*b[i];
+		len += q[i]*q[i];
+	}
+
+	len = 1.0f/sqrtf(len);
+
+	for (i = 0; i < 4; i++)
+	{
+		q[i] *= len;
+	}
+}
+
+/*
+** Angle between the rotations of the unit quaternions a and b. The angle
+** is taken from the distance of a to b and to -b, acos of their dot product
+** is too imprecise for angles in the range of the tolerances.
+*/
+static float QuaternionAngle(const float* a, const float* b)
+{
+	float sign = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3] < 0.0f ? 
+		-1.0f : 1.0f;
+	float difference = 0.0f;
+	float sum = 0.0f;
+	int i = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		difference += (a[i] - sign*b[i])*(a[i] - sign*b[i]);
+		sum += (a[i] + sign*b[i])*(a[i] + sign*b[i]);
+	}
+
+	return 4.0f*atan2f(sqrtf(difference), sqrtf(sum));
+}
+
+/*
+** Quantizes a component t of a translation to 16 bits relative to the range
+** min .. min + extent of its track.
+*/
+static unsigned short TranslationPack(float t, float min, float extent)
+{
+	return (unsigned short)(extent > 0.0f ? (t - min)/extent*65535.0f + 0.5f : 0.0f);
+}
+
+static float TranslationUnpack(unsigned short key, float min, float extent)
+{
+	return min + key/65535.0f*extent;
+}
+
+/*
+** Decodes the value of a channel at frame from keys a and b. Returns the 
+** error to the sample. A rotation channel has quaternion keys, a 
+** translation channel is one component of a translation.
+*/
+static float ChannelError(
+	int isRotation,
+	const float* sample,
+	const unsigned short* keyA,
+	const unsigned short* keyB,
+	float t,
+	float min,
+	float extent
+)
+{
+	float a[4], b[4], v[4];
+
+	if (isRotation)
+	{
+		QuaternionUnpack(a, keyA);
+		QuaternionUnpack(b, keyB);
+		QuaternionNlerp(v, a, b, t);
+		return QuaternionAngle(v, sample);
+	}
+
+	return fabsf(
+			(1.0f - t)*TranslationUnpack(*keyA, min, extent) + 
+			t*TranslationUnpack(*keyB, min, extent) - *sample
+		);
+}
+
+/*
+** Reduces the quantized keys (one per frame, 3 shorts for a rotation and 1
+** for a translation) of a channel. Writes the frames of the keys that are 
+** kept to frames and returns their #. samples holds stride floats per 
+** frame.
+*/
+static int ChannelReduce(
+	unsigned short* frames,
+	int isRotation,
+	const float* samples,
+	int stride,
+	const unsigned short* keys,
+	int numFrames,
+	float tolerance,
+	float min,
+	float extent
+)
+{
+	int keySize = isRotation ? 3 : 1;
+	int numKeys = 0;
+	int a = 0, b = 0, f = 0;
+	int fits = 1;
+
+	/* constant track */
+	for (f = 0; f < numFrames && fits; f++)
+	{
+		fits = ChannelError(isRotation, &samples[stride*f], &keys[0], 
+			&keys[0], 0.0f, min, extent) <= tolerance;
+	}
+
+	frames[numKeys++] = 0;
+
+	if (fits)
+	{
+		return numKeys;
+	}
+
+	/* greedily extend each segment as long as all frames it spans can be
+	** interpolated within the tolerance 
+	*/
+	while (a < numFrames - 1)
+	{
+		b = a + 1;
+
+		while (b + 1 < numFrames)
+		{
+			fits = 1;
+
+			for (f = a + 1; f < b + 1 && fits; f++)
+			{
+				fits = ChannelError(isRotation, &samples[stride*f], 
+					&keys[keySize*a], &keys[keySize*(b + 1)], 
+					(float)(f - a)/(b + 1 - a), min, extent) <= tolerance;
+			}
+
+			if (!fits)
+			{
+				break;
+			}
+
+			b++;
+		}
+
+		frames[numKeys++] = (unsigned short)b;
+		a = b;
+	}
+
+	return numKeys;
+}
+
+/*
+** Finds the keys of track around frame, which may be fractional. Returns 
+** the index of the key before frame and the interpolation parameter in t.
+*/
+static unsigned int TrackFind(
+	const MD5CompressedTrack* track,
+	const unsigned short* frames,
+	float frame,
+	float* t
+)
+{
+	unsigned int lo = track->firstKey;
+	unsigned int hi = track->firstKey + track->numKeys - 1;
+	unsigned int mid = 0;
+
+	*t = 0.0f;
+
+	if (track->numKeys == 1 || frame >= frames[hi])
+	{
+		return frame >= frames[hi] ? hi : lo;
+	}
+
+	/* find the last key with frames[key] <= frame */
+	while (lo + 1 < hi)
+	{
+		mid = (lo + hi)/2;
+
+		if (frames[mid] <= frame)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	*t = (frame - frames[lo])/(frames[lo + 1] - frames[lo]);
+
+	return lo;
+}
+
+/*
+** Temporary memory used while compressing an animation.
+*/
+typedef struct
+{
+	float* rotations; 					/* 4 floats per frame and joint */
+	float* translations; 				/* 3 floats per frame and joint */
+	unsigned short* rotationKeys; 		/* quantized keys of one channel */
+	unsigned short* translationKeys;
+	unsigned short* rotationFrames; 	/* frames of the kept keys */
+	unsigned short* translationFrames;
+	unsigned short* keptRotationKeys; 	/* kept keys of all joints */
+	unsigned short* keptTranslationKeys;
+}
+Samples;
+
+static void SamplesDestroy(Samples* samples)
+{
+	free(samples->rotations);
+	free(samples->translations);
+	free(samples->rotationKeys);
+	free(samples->translationKeys);
+	free(samples->rotationFrames);
+	free(samples->translationFrames);
+	free(samples->keptRotationKeys);
+	free(samples->keptTranslationKeys);
+}
+
+static int SamplesCreate(Samples* samples, int numFrames, int numJoints)
+{
+	size_t n = (size_t)numFrames*numJoints;
+
+	memset(samples, 0, sizeof(Samples));
+	samples->rotations = (float*)malloc(4*n*sizeof(float));
+	samples->translations = (float*)malloc(3*n*sizeof(float));
+	samples->rotationKeys = (unsigned short*)malloc(3*numFrames*sizeof(unsigned short));
+	samples->translationKeys = (unsigned short*)malloc(numFrames*sizeof(unsigned short));
+	samples->rotationFrames = (unsigned short*)malloc(n*sizeof(unsigned short));
+	samples->translationFrames = (unsigned short*)malloc(3*n*sizeof(unsigned short));
+	samples->keptRotationKeys = (unsigned short*)malloc(3*n*sizeof(unsigned short));
+	samples->keptTranslationKeys = (unsigned short*)malloc(3*n*sizeof(unsigned short));
+
+	if (!samples->rotations || !samples->translations || 
+		!samples->rotationKeys || !samples->translationKeys || 
+		!samples->rotationFrames || !samples->translationFrames ||
+		!samples->keptRotationKeys || !samples->keptTranslationKeys)
+	{
+		SamplesDestroy(samples);
+		return 0;
+	}
+
+	return 1;
+}
+
+int MD5CompressedAnimationCreateWithAnimation(
+	MD5CompressedAnimation** compressed,
+	FxsMD5Mesh* md5mesh,
+	const FxsMD5Animation* animation,
+	float translationTolerance,
+	float rotationTolerance
+)
+{
+	MD5CompressedAnimation* c = NULL;
+	MD5CompressedTrack* rotationTracks = NULL;
+	MD5CompressedTrack* translationTracks = NULL;
+	float* translationMin = NULL;
+	float* translationExtent = NULL;
+	Samples samples;
+	MD5JointMatrix jm;
+	MD5Arena arena;
+	int numJoints = md5mesh->currentPose.numJoints;
+	int numFrames = animation->numFrames;
+	unsigned int numRotationKeys = 0;
+	unsigned int numTranslationKeys = 0;
+	unsigned int k = 0;
+	float max = 0.0f;
+	float t = 0.0f;
+	size_t size = 0;
+	int i = 0, j = 0, axis = 0;
+
+	*compressed = NULL;
+
+	if (numFrames <= 0 || numFrames > 65535 || numJoints <= 0)
+	{
+		ERR_MSG("Warning: Invalid # of frames or joints. Could not compress animation");
+		return 0;
+	}
+
+	rotationTracks = (MD5CompressedTrack*)malloc(4*numJoints*sizeof(MD5CompressedTrack));
+	translationMin = (float*)malloc(6*numJoints*sizeof(float));
+
+	if (!rotationTracks || !translationMin || 
+		!SamplesCreate(&samples, numFrames, numJoints))
+	{
+		ERR_MSG("Warning: malloc failed. Could not compress animation");
+		free(rotationTracks);
+		free(translationMin);
+		return 0;
+	}
+
+	translationTracks = rotationTracks + numJoints;
+	translationExtent = translationMin + 3*numJoints;
+
+	/* sample the object space joint transforms of each frame */
+	for (i = 0; i < numFrames; i++)
+	{
+		if (!FxsMD5MeshUpdatePoseWithAnimationFrame(md5mesh, animation, i))
+		{
+			ERR_MSG("Warning: Could not pose the mesh. Could not compress animation");
+			SamplesDestroy(&samples);
+			free(rotationTracks);
+			free(translationMin);
+			return 0;
+		}
+
+		for (j = 0; j < numJoints; j++)
+		{
+			MD5JointMatrixMakeWithMatrix4(&jm, &md5mesh->currentPose.joints[j].transform);
+			MD5QuaternionMakeWithJointMatrix(&samples.rotations[4*(numJoints*i + j)], &jm);
+			samples.translations[3*(numJoints*i + j) + 0] = jm.m[3];
+			samples.translations[3*(numJoints*i + j) + 1] = jm.m[7];
+			samples.translations[3*(numJoints*i + j) + 2] = jm.m[11];
+		}
+	}
+
+	/* quantize and reduce the tracks of each joint */
+	for (j = 0; j < numJoints; j++)
+	{
+		for (i = 0; i < numFrames; i++)
+		{
+			QuaternionPack(
+				&samples.rotationKeys[3*i], 
+				&samples.rotations[4*(numJoints*i + j)]
+			);
+		}
+
+		rotationTracks[j].firstKey = numRotationKeys;
+		rotationTracks[j].numKeys = ChannelReduce(
+				&samples.rotationFrames[numRotationKeys], 1, 
+				&samples.rotations[4*j], 4*numJoints, samples.rotationKeys, 
+				numFrames, rotationTolerance, 0.0f, 0.0f
+			);
+
+		/* keep the keys of the reduced track */
+		for (k = 0; k < rotationTracks[j].numKeys; k++, numRotationKeys++)
+		{
+			memcpy(
+				&samples.keptRotationKeys[3*numRotationKeys], 
+				&samples.rotationKeys[3*samples.rotationFrames[numRotationKeys]], 
+				3*sizeof(unsigned short)
+			);
+		}
+
+		/* each component of the translation is a track of its own, so 
+		** components that do not move need a single key 
+		*/
+		for (axis = 0; axis < 3; axis++)
+		{
+			translationMin[3*j + axis] = max = samples.translations[3*j + axis];
+
+			for (i = 1; i < numFrames; i++)
+			{
+				t = samples.translations[3*(numJoints*i + j) + axis];
+				translationMin[3*j + axis] = fminf(translationMin[3*j + axis], t);
+				max = fmaxf(max, t);
+			}
+
+			translationExtent[3*j + axis] = max - translationMin[3*j + axis];
+
+			for (i = 0; i < numFrames; i++)
+			{
+				samples.translationKeys[i] = TranslationPack(
+						samples.translations[3*(numJoints*i + j) + axis],
+						translationMin[3*j + axis],
+						translationExtent[3*j + axis]
+					);
+			}
+
+			translationTracks[3*j + axis].firstKey = numTranslationKeys;
+			translationTracks[3*j + axis].numKeys = ChannelReduce(
+					&samples.translationFrames[numTranslationKeys], 0, 
+					&samples.translations[3*j + axis], 3*numJoints, 
+					samples.translationKeys, numFrames, translationTolerance, 
+					translationMin[3*j + axis], translationExtent[3*j + axis]
+				);
+
+			for (k = 0; k < translationTracks[3*j + axis].numKeys; k++, numTranslationKeys++)
+			{
+				samples.keptTranslationKeys[numTranslationKeys] = 
+					samples.translationKeys[samples.translationFrames[numTranslationKeys]];
+			}
+		}
+	}
+
+	/* move everything into a single arena */
+	size = MD5ArenaSizeForAllocation(sizeof(MD5CompressedAnimation));
+	size += MD5ArenaSizeForAllocation(numJoints*sizeof(MD5CompressedTrack));
+	size += MD5ArenaSizeForAllocation(3*numJoints*sizeof(MD5CompressedTrack));
+	size += 2*MD5ArenaSizeForAllocation(3*numJoints*sizeof(float));
+	size += MD5ArenaSizeForAllocation(numRotationKeys*sizeof(unsigned short));
+	size += MD5ArenaSizeForAllocation(3*numRotationKeys*sizeof(unsigned short));
+	size += 2*MD5ArenaSizeForAllocation(numTranslationKeys*sizeof(unsigned short));
+	size += MD5_COMPRESSED_ANIMATION_CACHE_SIZE*MD5ArenaSizeForAllocation(
+			numJoints*sizeof(MD5JointMatrix)
+		);
+
+	if (!MD5ArenaCreate(&arena, size))
+	{
+		ERR_MSG("Warning: malloc failed. Could not compress animation");
+		SamplesDestroy(&samples);
+		free(rotationTracks);
+		free(translationMin);
+		return 0;
+	}
+
+	c = (MD5CompressedAnimation*)MD5ArenaCalloc(&arena, sizeof(MD5CompressedAnimation));
+	c->numJoints = numJoints;
+	c->numFrames = numFrames;
+
+	c->rotationTracks = (MD5CompressedTrack*)MD5ArenaAlloc(&arena, numJoints*sizeof(MD5CompressedTrack));
+	c->translationTracks = (MD5CompressedTrack*)MD5ArenaAlloc(&arena, 3*numJoints*sizeof(MD5CompressedTrack));
+	c->translationMin = (float*)MD5ArenaAlloc(&arena, 3*numJoints*sizeof(float));
+	c->translationExtent = (float*)MD5ArenaAlloc(&arena, 3*numJoints*sizeof(float));
+	c->rotationFrames = (unsigned short*)MD5ArenaAlloc(&arena, numRotationKeys*sizeof(unsigned short));
+	c->rotationKeys = (unsigned short*)MD5ArenaAlloc(&arena, 3*numRotationKeys*sizeof(unsigned short));
+	c->translationFrames = (unsigned short*)MD5ArenaAlloc(&arena, numTranslationKeys*sizeof(unsigned short));
+	c->translationKeys = (unsigned short*)MD5ArenaAlloc(&arena, numTranslationKeys*sizeof(unsigned short));
+
+	memcpy(c->rotationTracks, rotationTracks, numJoints*sizeof(MD5CompressedTrack));
+	memcpy(c->translationTracks, translationTracks, 3*numJoints*sizeof(MD5CompressedTrack));
+	memcpy(c->translationMin, translationMin, 3*numJoints*sizeof(float));
+	memcpy(c->translationExtent, translationExtent, 3*numJoints*sizeof(float));
+	memcpy(c->rotationFrames, samples.rotationFrames, numRotationKeys*sizeof(unsigned short));
+	memcpy(c->rotationKeys, samples.keptRotationKeys, 3*numRotationKeys*sizeof(unsigned short));
+	memcpy(c->translationFrames, samples.translationFrames, numTranslationKeys*sizeof(unsigned short));
+	memcpy(c->translationKeys, samples.keptTranslationKeys, numTranslationKeys*sizeof(unsigned short));
+
+	c->stats.compressedBytes = arena.used;
+
+	for (i = 0; i < MD5_COMPRESSED_ANIMATION_CACHE_SIZE; i++)
+	{
+		c->cache[i].frame = -1;
+		c->cache[i].palette = (MD5JointMatrix*)MD5ArenaAlloc(
+				&arena, 
+				numJoints*sizeof(MD5JointMatrix)
+			);
+	}
+
+	c->stats.uncompressedBytes = (size_t)numFrames*numJoints*7*sizeof(float);
+	pthread_mutex_init(&c->mutex, NULL);
+	c->arena = arena;
+	*compressed = c;
+
+	SamplesDestroy(&samples);
+	free(rotationTracks);
+	free(translationMin);
+
+	return 1;
+}
+
+/*
+** Decodes the rotation q (x, y, z, w) and the translation t of joint at 
+** frame.
+*/
+static void JointDecode(
+	const MD5CompressedAnimation* compressed,
+	int joint,
+	int frame,
+	float* q,
+	float* t
+)
+{
+	const MD5CompressedTrack* track = NULL;
+	unsigned int key = 0;
+	float a[4], b[4];
+	float s = 0.0f;
+	int i = 0;
+
+	/* rotation */
+	track = &compressed->rotationTracks[joint];
+	key = TrackFind(track, compressed->rotationFrames, (float)frame, &s);
+
+	if (s > 0.0f)
+	{
+		QuaternionUnpack(a, &compressed->rotationKeys[3*key]);
+		QuaternionUnpack(b, &compressed->rotationKeys[3*(key + 1)]);
+		QuaternionNlerp(q, a, b, s);
+	}
+	else
+	{
+		QuaternionUnpack(q, &compressed->rotationKeys[3*key]);
+	}
+
+	/* translation, one track per component */
+	for (i = 0; i < 3; i++)
+	{
+		track = &compressed->translationTracks[3*joint + i];
+		key = TrackFind(track, compressed->translationFrames, (float)frame, &s);
+		t[i] = TranslationUnpack(
+				compressed->translationKeys[key], 
+				compressed->translationMin[3*joint + i], 
+				compressed->translationExtent[3*joint + i]
+			);
+
+		if (s > 0.0f)
+		{
+			t[i] = (1.0f - s)*t[i] + s*TranslationUnpack(
+					compressed->translationKeys[key + 1], 
+					compressed->translationMin[3*joint + i], 
+					compressed->translationExtent[3*joint + i]
+				);
+		}
+	}
+}
+
+/*
+** Gets the time of a monotonic clock in seconds. The cpu time of the 
+** process would include the other threads decoding at the same time.
+*/
+static double GetSeconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + 1e-9*now.tv_nsec;
+}
+
+/*
+** Decodes the first numJoints joints of frame to palette.
+*/
+static void FrameDecode(
+	const MD5CompressedAnimation* compressed,
+	int frame,
+	int numJoints,
+	MD5JointMatrix* palette
+)
+{
+	float q[4], t[3];
+	int j = 0;
+
+	for (j = 0; j < numJoints; j++)
+	{
+		JointDecode(compressed, j, frame, q, t);
+		MD5JointMatrixMakeWithRotationTranslation(&palette[j], q, t);
+	}
+}
+
+/*
+** Finds frame in the decode cache and marks it as used. Returns NULL if it 
+** is not cached.
+*/
+static MD5CompressedAnimationCacheEntry* CacheFind(
+	MD5CompressedAnimation* compressed,
+	int frame
+)
+{
+	int i = 0;
+
+	for (i = 0; i < MD5_COMPRESSED_ANIMATION_CACHE_SIZE; i++)
+	{
+		if (compressed->cache[i].frame == frame)
+		{
+			compressed->cache[i].lastUse = compressed->useCount;
+			return &compressed->cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+** Gets the least recently used entry of the decode cache.
+*/
+static MD5CompressedAnimationCacheEntry* CacheVictim(
+	MD5CompressedAnimation* compressed
+)
+{
+	MD5CompressedAnimationCacheEntry* entry = &compressed->cache[0];
+	int i = 0;
+
+	for (i = 1; i < MD5_COMPRESSED_ANIMATION_CACHE_SIZE; i++)
+	{
+		if (compressed->cache[i].lastUse < entry->lastUse)
+		{
+			entry = &compressed->cache[i];
+		}
+	}
+
+	return entry;
+}
+
+const MD5JointMatrix* MD5CompressedAnimationDecodeFrame(
+	MD5CompressedAnimation* compressed,
+	int frame
+)
+{
+	MD5CompressedAnimationCacheEntry* entry = NULL;
+	double start = 0.0;
+
+	if (frame < 0 || frame >= compressed->numFrames)
+	{
+		return NULL;
+	}
+
+	compressed->stats.numDecodes++;
+	compressed->useCount++;
+
+	/* look up the frame in the cache, else replace the LRU entry */
+	entry = CacheFind(compressed, frame);
+
+	if (entry)
+	{
+		compressed->stats.numCacheHits++;
+		return entry->palette;
+	}
+
+	entry = CacheVictim(compressed);
+	start = GetSeconds();
+	FrameDecode(compressed, frame, compressed->numJoints, entry->palette);
+	entry->frame = frame;
+	entry->lastUse = compressed->useCount;
+	compressed->stats.decodeSeconds += GetSeconds() - start;
+
+	return entry->palette;
+}
+
+int MD5CompressedAnimationCopyFrame(
+	MD5CompressedAnimation* compressed,
+	int frame,
+	int numJoints,
+	MD5JointMatrix* palette
+)
+{
+	MD5CompressedAnimationCacheEntry* entry = NULL;
+	double start = 0.0;
+	double seconds = 0.0;
+
+	if (frame < 0 || frame >= compressed->numFrames || 
+		numJoints > compressed->numJoints)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&compressed->mutex);
+	compressed->stats.numDecodes++;
+	compressed->useCount++;
+	entry = CacheFind(compressed, frame);
+
+	if (entry)
+	{
+		compressed->stats.numCacheHits++;
+		memcpy(palette, entry->palette, numJoints*sizeof(MD5JointMatrix));
+		pthread_mutex_unlock(&compressed->mutex);
+		return 1;
+	}
+
+	pthread_mutex_unlock(&compressed->mutex);
+
+	/* decode without the lock, so other threads can use the cache */
+	start = GetSeconds();
+	FrameDecode(compressed, frame, numJoints, palette);
+	seconds = GetSeconds() - start;
+
+	pthread_mutex_lock(&compressed->mutex);
+	compressed->stats.decodeSeconds += seconds;
+
+	/* only complete frames are cached, another thread may have cached the
+	** frame in the meantime 
+	*/
+	if (numJoints == compressed->numJoints && !CacheFind(compressed, frame))
+	{
+		entry = CacheVictim(compressed);
+		memcpy(entry->palette, palette, numJoints*sizeof(MD5JointMatrix));
+		entry->frame = frame;
+		entry->lastUse = compressed->useCount;
+	}
+
+	pthread_mutex_unlock(&compressed->mutex);
+
+	return 1;
+}
+
+int MD5CompressedAnimationDecodeJoints(
+	const MD5CompressedAnimation* compressed,
+	int frame,
+	int numJoints,
+	float* rotations,
+	float* translations
+)
+{
+	int j = 0;
+
+	if (frame < 0 || frame >= compressed->numFrames || 
+		numJoints > compressed->numJoints)
+	{
+		return 0;
+	}
+
+	for (j = 0; j < numJoints; j++)
+	{
+		JointDecode(compressed, j, frame, &rotations[4*j], &translations[3*j]);
+	}
+
+	return 1;
+}
+
+void MD5CompressedAnimationUnpackKeys(
+	const MD5CompressedAnimation* compressed,
+	float frame,
+	const int* joints,
+	int numJoints,
+	const MD5CompressedKeys* keys
+)
+{
+	const MD5CompressedTrack* track = NULL;
+	unsigned int key = 0;
+	float a[4], b[4];
+	float t = 0.0f;
+	int i = 0, j = 0, joint = 0;
+
+	frame = frame < 0.0f ? 0.0f : frame;
+	frame = frame > compressed->numFrames - 1 ? compressed->numFrames - 1 : frame;
+
+	for (j = 0; j < numJoints; j++)
+	{
+		joint = joints ? joints[j] : j;
+
+		/* rotation, constant tracks and the last key interpolate to 
+		** themselves 
+		*/
+		track = &compressed->rotationTracks[joint];
+		key = TrackFind(track, compressed->rotationFrames, frame, &t);
+		QuaternionUnpack(a, &compressed->rotationKeys[3*key]);
+
+		if (t > 0.0f)
+		{
+			QuaternionUnpack(b, &compressed->rotationKeys[3*(key + 1)]);
+		}
+
+		for (i = 0; i < 4; i++)
+		{
+			keys->rotationA[i][j] = a[i];
+			keys->rotationB[i][j] = t > 0.0f ? b[i] : a[i];
+		}
+
+		keys->rotationT[j] = t;
+
+		/* translation, one track per component */
+		for (i = 0; i < 3; i++)
+		{
+			track = &compressed->translationTracks[3*joint + i];
+			key = TrackFind(track, compressed->translationFrames, frame, &t);
+			a[0] = TranslationUnpack(
+					compressed->translationKeys[key], 
+					compressed->translationMin[3*joint + i], 
+					compressed->translationExtent[3*joint + i]
+				);
+
+			keys->translationA[i][j] = a[0];
+			keys->translationB[i][j] = t > 0.0f ? TranslationUnpack(
+					compressed->translationKeys[key + 1], 
+					compressed->translationMin[3*joint + i], 
+					compressed->translationExtent[3*joint + i]
+				) : a[0];
+			keys->translationT[i][j] = t;
+		}
+	}
+}
+
+void MD5CompressedAnimationDestroy(MD5CompressedAnimation** compressed)
+{
+	MD5Arena arena;
+
+	if (!(*compressed))
+	{
+		return;
+	}
+
+	pthread_mutex_destroy(&(*compressed)->mutex);
+
+	/* the arena lives inside its own block, so we need to copy it first */
+	arena = (*compressed)->arena;
+	MD5ArenaDestroy(&arena);
+
+	*compressed = NULL;
+}
@@ -0,0 +1,210 @@
+/*
+ * Compressed storage for MD5 animations
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5COMPRESSEDANIMATION_H
+#define MD5COMPRESSEDANIMATION_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <pthread.h>
+#include <Fxs/Math/Vector3.h>
+#include <Fxs/MD5/MD5Mesh.h>
+#include <Fxs/MD5/MD5Animation.h>
+#include "MD5Arena.h"
+#include "MD5Skinning.h"
+
+#define MD5_COMPRESSED_ANIMATION_CACHE_SIZE 4 	/* # of decoded frames kept 
+												** per animation */
+
+/*
+** A track stores the keys of one channel (the rotation or one component of
+** the translation) of a joint. Keys are sorted by frame. A constant track has a single key.
+*/
+typedef struct
+{
+	unsigned int firstKey; 			/* index of the first key of the track */
+	unsigned int numKeys; 			/* # of keys */
+}
+MD5CompressedTrack;
+
+/*
+** A decoded frame in the decode cache.
+*/
+typedef struct
+{
+	int frame; 						/* -1 if the entry is unused */
+	unsigned int lastUse; 			/* for LRU replacement */
+	MD5JointMatrix* palette; 		/* the object space joint transforms */
+}
+MD5CompressedAnimationCacheEntry;
+
+/*
+** Statistics of a compressed animation.
+*/
+typedef struct
+{
+	size_t compressedBytes; 		/* memory used by the compressed data */
+	size_t uncompressedBytes; 		/* memory of the same frames as float
+									** quaternions and positions */
+	unsigned int numDecodes; 		/* # of frames requested */
+	unsigned int numCacheHits; 		/* # of frames served by the cache */
+	double decodeSeconds; 			/* (wall) time spent decoding, summed
+									** over all threads */
+}
+MD5CompressedAnimationStats;
+
+/*
+** Object space joint transforms of an animation, compressed with:
+**
+**      - quaternions quantized to 48 bits (smallest three)
+**      - translations quantized to 16 bits per component relative to the 
+**        range of the track, each component in a track of its own
+**      - per track key frame reduction, that drops all keys that can be
+**        interpolated from their neighbours within a tolerance
+**      - constant track elimination
+**
+** Any frame can be decoded in O(numJoints*log(numKeys)).
+*/
+typedef struct
+{
+	int numJoints;
+	int numFrames;
+
+	MD5CompressedTrack* rotationTracks; 	/* one per joint */
+	MD5CompressedTrack* translationTracks; 	/* 3 per joint (x, y, z) */
+	float* translationMin; 					/* range of each translation */ 
+	float* translationExtent; 				/* track */
+
+	unsigned short* rotationFrames; 		/* frame of each rotation key */
+	unsigned short* rotationKeys; 			/* 3 shorts per key */
+	unsigned short* translationFrames; 		/* frame of each translation key */
+	unsigned short* translationKeys; 		/* 1 short per key */
+
+	MD5CompressedAnimationCacheEntry cache[MD5_COMPRESSED_ANIMATION_CACHE_SIZE];
+	unsigned int useCount;
+
+	MD5CompressedAnimationStats stats;
+	pthread_mutex_t mutex; 					/* guards the cache and the stats
+											** (see 
+											** MD5CompressedAnimationCopyFrame) */
+	MD5Arena arena; 						/* holds all of the above */
+}
+MD5CompressedAnimation;
+
+/*
+** Compresses animation. The object space joint transforms are sampled by
+** posing md5mesh with each frame of the animation, so the skeleton of 
+** md5mesh has to match the animation. The pose of md5mesh is changed.
+**
+** translationTolerance is the max. difference of each component of the 
+** translation and rotationTolerance the max. angle (radians) a decoded joint
+** may deviate from the original.
+**
+** Returns 0 if it fails.
+*/
+int MD5CompressedAnimationCreateWithAnimation(
+	MD5CompressedAnimation** compressed,
+	FxsMD5Mesh* md5mesh,
+	const FxsMD5Animation* animation,
+	float translationTolerance,
+	float rotationTolerance
+);
+
+/*
+** Decodes frame. Returns the numJoints object space joint transforms of the
+** frame. The returned palette stays valid until the next call to this fct.
+** Returns NULL if frame is out of range. Not thread safe, see 
+** MD5CompressedAnimationCopyFrame.
+*/
+const MD5JointMatrix* MD5CompressedAnimationDecodeFrame(
+	MD5CompressedAnimation* compressed,
+	int frame
+);
+
+/*
+** Copies the object space transforms of the first numJoints joints of frame
+** to palette, from the decode cache or decoded. Can be called by several 
+** threads at once: the cache is only locked to look up and insert the 
+** frame, frames are decoded in parallel. Returns 0 if frame or numJoints is
+** out of range.
+*/
+int MD5CompressedAnimationCopyFrame(
+	MD5CompressedAnimation* compressed,
+	int frame,
+	int numJoints,
+	MD5JointMatrix* palette
+);
+
+/*
+** Decodes the rotations (4 floats (x, y, z, w) per joint) and translations 
+** (3 floats per joint) of the first numJoints joints at frame, e.g. to 
+** build a dual quaternion palette without going through joint matrices. 
+** Does not use the decode cache, so it can be called by several threads at 
+** once. Returns 0 if frame or numJoints is out of range.
+*/
+int MD5CompressedAnimationDecodeJoints(
+	const MD5CompressedAnimation* compressed,
+	int frame,
+	int numJoints,
+	float* rotations,
+	float* translations
+);
+
+/*
+** The keys around a frame of a list of joints, unpacked into structure of 
+** arrays with one entry per joint. The quaternions are (x, y, z, w). A joint
+** at frame is the nlerp of its rotation keys and the lerp of the keys of 
+** each translation component by their interpolation parameters.
+*/
+typedef struct
+{
+	float* rotationA[4]; 			/* key before the frame */
+	float* rotationB[4]; 			/* key after the frame */
+	float* rotationT; 				/* interpolation parameter */
+	float* translationA[3];
+	float* translationB[3];
+	float* translationT[3];
+}
+MD5CompressedKeys;
+
+/*
+** Unpacks the keys around frame, which may be fractional and is clamped to
+** 0 .. numFrames - 1, of the numJoints joints (0 .. numJoints - 1 if joints
+** is NULL) into keys. Does not use the decode cache, so it can be called by
+** several threads at once.
+*/
+void MD5CompressedAnimationUnpackKeys(
+	const MD5CompressedAnimation* compressed,
+	float frame,
+	const int* joints,
+	int numJoints,
+	const MD5CompressedKeys* keys
+);
+
+/*
+** Destroys a compressed animation.
+*/
+void MD5CompressedAnimationDestroy(MD5CompressedAnimation** compressed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5COMPRESSEDANIMATION_H */
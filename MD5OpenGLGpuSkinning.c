@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "MD5OpenGLGpuSkinning.h"
+#include "MD5VertexFormat.h"
+#include "MD5OpenGLProgramCache.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Definition of the skinning shader. The palette holds 3 texels (the rows
+** of the skinning matrix) per joint for linear blend skinning and 2 texels
+** (real and dual part) per joint for dual quaternion skinning. The outputs
+** are captured interleaved in the layout of MD5Vertex.
+*/
+#define TO_STRING(X) #X
+
+static char* vertexShader =
+	"#version 150\n"
+TO_STRING(
+	uniform samplerBuffer palette;
+	uniform int dualQuaternion;
+
+	in vec3 position;
+	in vec3 normal;
+	in vec4 tangent;
+	in uvec4 joints;
+	in vec4 weights;
+
+	out vec3 skinnedPosition;
+	flat out uint skinnedNormal;
+	flat out uint skinnedTangent;
+
+	/* same as MD5PackSnorm1010102 */
+	uint packSnorm1010102(vec4 v)
+	{
+		ivec4 i = ivec4(round(clamp(v, -1.0, 1.0)*vec4(511.0, 511.0, 511.0, 1.0)));
+
+		return uint(i.x & 0x3FF) | (uint(i.y & 0x3FF) << 10) |
+			(uint(i.z & 0x3FF) << 20) | (uint(i.w & 0x3) << 30);
+	}
+
+	vec3 rotate(vec4 q, vec3 v)
+	{
+		return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+	}
+
+	void main()
+	{
+		vec3 p;
+		vec3 n;
+		vec3 t;
+
+		if (dualQuaternion != 0)
+		{
+			/* blend on the hemisphere of the first (largest) weight */
+			vec4 first = texelFetch(palette, 2*int(joints[0]));
+			vec4 real = vec4(0.0);
+			vec4 dual = vec4(0.0);
+
+			for (int i = 0; i < 4; i++)
+			{
+				vec4 r = texelFetch(palette, 2*int(joints[i]));
+				vec4 d = texelFetch(palette, 2*int(joints[i]) + 1);
+				float w = dot(r, first) < 0.0 ? -weights[i] : weights[i];
+				real += w*r;
+				dual += w*d;
+			}
+
+			float len = length(real);
+			real /= len;
+			dual /= len;
+
+			p = rotate(real, position) + 2.0*(real.w*dual.xyz -
+				dual.w*real.xyz + cross(real.xyz, dual.xyz));
+			n = rotate(real, normal);
+			t = rotate(real, tangent.xyz);
+		}
+		else
+		{
+			vec4 r0 = vec4(0.0);
+			vec4 r1 = vec4(0.0);
+			vec4 r2 = vec4(0.0);
+
+			for (int i = 0; i < 4; i++)
+			{
+				r0 += weights[i]*texelFetch(palette, 3*int(joints[i]));
+				r1 += weights[i]*texelFetch(palette, 3*int(joints[i]) + 1);
+				r2 += weights[i]*texelFetch(palette, 3*int(joints[i]) + 2);
+			}
+
+			p = vec3(dot(r0, vec4(position, 1.0)), dot(r1, vec4(position, 1.0)),
+				dot(r2, vec4(position, 1.0)));
+			n = normalize(vec3(dot(r0.xyz, normal), dot(r1.xyz, normal),
+				dot(r2.xyz, normal)));
+			t = normalize(vec3(dot(r0.xyz, tangent.xyz), dot(r1.xyz, tangent.xyz),
+				dot(r2.xyz, tangent.xyz)));
+		}
+
+		skinnedPosition = p;
+		skinnedNormal = packSnorm1010102(vec4(n, 0.0));
+		skinnedTangent = packSnorm1010102(vec4(t, tangent.w));
+	}
+);
+
+static GLuint program;
+static GLint dualQuaternionLocation;
+
+int MD5OpenGLGpuSkinningCreate()
+{
+	const char* attributes[] = {
+			"position",
+			"normal",
+			"tangent",
+			"joints",
+			"weights"
+		};
+	const char* varyings[] = {
+			"skinnedPosition",
+			"skinnedNormal",
+			"skinnedTangent"
+		};
+	MD5OpenGLProgramSource source;
+
+	memset(&source, 0, sizeof(source));
+	source.name = "gpuSkinning";
+	source.vertexShader = vertexShader;
+	source.attributes = attributes;
+	source.numAttributes = 5;
+	source.varyings = varyings;
+	source.numVaryings = 3;
+	program = MD5OpenGLProgramCacheCreateProgram(&source);
+
+	if (!program)
+	{
+		ERR_MSG("Warning: could not link the gpu skinning program");
+		return 0;
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "palette"), 0);
+	dualQuaternionLocation = glGetUniformLocation(program, "dualQuaternion");
+	glUseProgram(0);
+
+	if (GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: opengl failed. Could not create the gpu skinning program");
+		glDeleteProgram(program);
+		program = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+void MD5OpenGLGpuSkinningDestroy()
+{
+	glDeleteProgram(program);
+	program = 0;
+}
+
+/*
+** Gets the # of texels of the palette per joint.
+*/
+static int MD5OpenGLGpuSkinGetTexelsPerJoint(const MD5OpenGLGpuSkin* skin)
+{
+	return skin->skinningMethod == MD5_SKINNING_DUAL_QUATERNION ? 2 : 3;
+}
+
+int MD5OpenGLGpuSkinCreate(
+	MD5OpenGLGpuSkin* skin,
+	const MD5SkinningInput* inputs,
+	int numVertices,
+	int numJoints,
+	MD5SkinningMethod skinningMethod
+)
+{
+	memset(skin, 0, sizeof(MD5OpenGLGpuSkin));
+	skin->numVertices = numVertices;
+	skin->numJoints = numJoints;
+	skin->skinningMethod = skinningMethod;
+
+	/* inputs */
+	glGenBuffers(1, &skin->inputs);
+	glBindBuffer(GL_ARRAY_BUFFER, skin->inputs);
+
+	glBufferData(
+		GL_ARRAY_BUFFER,
+		sizeof(MD5SkinningInput)*(numVertices + 1),
+		NULL,
+		GL_STATIC_DRAW
+	);
+
+	glBufferSubData(
+		GL_ARRAY_BUFFER,
+		0,
+		sizeof(MD5SkinningInput)*numVertices,
+		inputs
+	);
+
+	glGenVertexArrays(1, &skin->inputArray);
+	glBindVertexArray(skin->inputArray);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+
+	glVertexAttribPointer(
+		0, 3, GL_FLOAT, GL_FALSE,
+		sizeof(MD5SkinningInput),
+		(const void*)offsetof(MD5SkinningInput, position)
+	);
+
+	glVertexAttribPointer(
+		1, 3, GL_FLOAT, GL_FALSE,
+		sizeof(MD5SkinningInput),
+		(const void*)offsetof(MD5SkinningInput, normal)
+	);
+
+	glVertexAttribPointer(
+		2, 4, GL_FLOAT, GL_FALSE,
+		sizeof(MD5SkinningInput),
+		(const void*)offsetof(MD5SkinningInput, tangent)
+	);
+
+	glVertexAttribIPointer(
+		3, MD5_SKINNING_MAX_WEIGHTS, GL_UNSIGNED_SHORT,
+		sizeof(MD5SkinningInput),
+		(const void*)offsetof(MD5SkinningInput, joints)
+	);
+
+	glVertexAttribPointer(
+		4, MD5_SKINNING_MAX_WEIGHTS, GL_FLOAT, GL_FALSE,
+		sizeof(MD5SkinningInput),
+		(const void*)offsetof(MD5SkinningInput, weights)
+	);
+
+	glBindVertexArray(0);
+
+	/* palette */
+	glGenBuffers(1, &skin->palette);
+	glBindBuffer(GL_TEXTURE_BUFFER, skin->palette);
+
+	glBufferData(
+		GL_TEXTURE_BUFFER,
+		4*sizeof(float)*MD5OpenGLGpuSkinGetTexelsPerJoint(skin)*(numJoints + 1),
+		NULL,
+		GL_STREAM_DRAW
+	);
+
+	glGenTextures(1, &skin->paletteTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, skin->paletteTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, skin->palette);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	if (GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: opengl failed. Could not create the gpu skin");
+		MD5OpenGLGpuSkinDestroy(skin);
+		return 0;
+	}
+
+	return 1;
+}
+
+int MD5OpenGLGpuSkinRun(
+	const MD5OpenGLGpuSkin* skin,
+	const void* palette,
+	GLuint buffer,
+	GLintptr offset
+)
+{
+	if (!program)
+	{
+		ERR_MSG("Warning: the gpu skinning program was not created");
+		return 0;
+	}
+
+	glUseProgram(program);
+	glUniform1i(
+		dualQuaternionLocation,
+		skin->skinningMethod == MD5_SKINNING_DUAL_QUATERNION
+	);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, skin->palette);
+
+	glBufferSubData(
+		GL_TEXTURE_BUFFER,
+		0,
+		4*sizeof(float)*MD5OpenGLGpuSkinGetTexelsPerJoint(skin)*skin->numJoints,
+		palette
+	);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, skin->paletteTexture);
+
+	/* one point per vertex, nothing is rasterized */
+	glBindVertexArray(skin->inputArray);
+	glEnable(GL_RASTERIZER_DISCARD);
+
+	glBindBufferRange(
+		GL_TRANSFORM_FEEDBACK_BUFFER,
+		0,
+		buffer,
+		offset,
+		sizeof(MD5Vertex)*skin->numVertices
+	);
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, skin->numVertices);
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(0);
+
+	if (GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: opengl failed. Could not skin on the gpu");
+		return 0;
+	}
+
+	return 1;
+}
+
+void MD5OpenGLGpuSkinDestroy(MD5OpenGLGpuSkin* skin)
+{
+	glDeleteVertexArrays(1, &skin->inputArray);
+	glDeleteBuffers(1, &skin->inputs);
+	glDeleteTextures(1, &skin->paletteTexture);
+	glDeleteBuffers(1, &skin->palette);
+	memset(skin, 0, sizeof(MD5OpenGLGpuSkin));
+}
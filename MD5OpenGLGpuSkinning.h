@@ -0,0 +1,98 @@
+/*
+ * Skinning of MD5 meshes on the gpu with transform feedback
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5OPENGLGPUSKINNING_H
+#define MD5OPENGLGPUSKINNING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Skinning.h"
+#define GL_GLEXT_PROTOTYPES 1
+#include <Fxs/Opengl/glcorearb.h>
+
+/*
+** Gl data for skinning a mesh on the gpu.
+**
+** The bind pose of the vertices is stored in a static input buffer. Each
+** pose update uploads the joint palette to a texture buffer and runs a
+** vertex shader over the inputs, that writes the skinned vertices (in the
+** layout of MD5Vertex) into a range of an output buffer with transform
+** feedback. Any number of draws can then read the output buffer.
+*/
+typedef struct
+{
+	GLuint inputs; 					/* MD5SkinningInput per vertex */
+	GLuint inputArray; 				/* VAO for the inputs */
+	GLuint palette; 				/* texture buffer holding the palette */
+	GLuint paletteTexture;
+	int numVertices;
+	int numJoints;
+	MD5SkinningMethod skinningMethod;
+}
+MD5OpenGLGpuSkin;
+
+/*
+** Creates the transform feedback program shared by all gpu skins. Returns 0
+** if it fails.
+*/
+int MD5OpenGLGpuSkinningCreate();
+
+/*
+** Destroys the transform feedback program.
+*/
+void MD5OpenGLGpuSkinningDestroy();
+
+/*
+** Creates the gl data for skinning numVertices vertices with inputs. The
+** palette holds numJoints joints. Returns 0 if it fails.
+*/
+int MD5OpenGLGpuSkinCreate(
+	MD5OpenGLGpuSkin* skin,
+	const MD5SkinningInput* inputs,
+	int numVertices,
+	int numJoints,
+	MD5SkinningMethod skinningMethod
+);
+
+/*
+** Skins the vertices of skin into buffer starting at byte offset. palette
+** holds the skinning matrices (see MD5SkinningComputeSkinningMatrices) for
+** linear blend skinning or the dual quaternion palette (see
+** MD5SkinningComputeDualQuaternionPalette) for dual quaternion skinning.
+**
+** Changes the bound program, VAO and texture buffer of texture unit 0.
+*/
+int MD5OpenGLGpuSkinRun(
+	const MD5OpenGLGpuSkin* skin,
+	const void* palette,
+	GLuint buffer,
+	GLintptr offset
+);
+
+/*
+** Destroys the gl data of skin.
+*/
+void MD5OpenGLGpuSkinDestroy(MD5OpenGLGpuSkin* skin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5OPENGLGPUSKINNING_H */
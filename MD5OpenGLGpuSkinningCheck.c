@@ -0,0 +1,176 @@
+/*
+ * Check of the gpu skinning against the host skinning
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+** Standalone check of the meshes skinned on the gpu. Loads the meshes and
+** animations of a mesh manager config in a headless gl context, poses the
+** mesh with every frame of the animation and compares the vertices the
+** transform feedback wrote to the vertex arena with skinning them on the
+** host (see MD5OpenGLMeshManagerVerifyGpuSkinning). The mesh has to have
+** "gpuSkinning" set in the config.
+**
+** The context is created with EGL without a window, so the check also runs
+** with a software rasterizer like llvmpipe. Build and run, e.g.:
+**
+**   cc -O2 -DMD5_OPENGL_GPU_SKINNING_CHECK_MAIN MD5OpenGLGpuSkinningCheck.c \
+**      MD5OpenGLMeshManager.c MD5OpenGLGpuSkinning.c MD5Skinning.c \
+**      MD5VertexFormat.c MD5VertexCache.c MD5CompressedAnimation.c \
+**      MD5WorkerPool.c MD5AssetHash.c MD5OpenGLProgramCache.c MD5Arena.c \
+**      ../External/parson.c -lFxs -lEGL -lGL -lpthread -lm \
+**      -o md5gpuskinningcheck
+**   EGL_PLATFORM=surfaceless LIBGL_ALWAYS_SOFTWARE=1 \
+**      ./md5gpuskinningcheck config.json meshId animationId [tolerance]
+**
+** Exits with 0 if all frames are within tolerance.
+*/
+#ifdef MD5_OPENGL_GPU_SKINNING_CHECK_MAIN
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <EGL/egl.h>
+#include "MD5OpenGLMeshManager.h"
+
+#define DEFAULT_TOLERANCE 0.01f 	/* max. difference of the positions and
+									** the components of the normals and
+									** tangents */
+
+/*
+** Makes a gl 3.3 core context current without a window. Returns 0 if it
+** fails.
+*/
+static int CreateContext(
+	EGLDisplay* display, 
+	EGLSurface* surface, 
+	EGLContext* context
+)
+{
+	const EGLint configAttributes[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	const EGLint surfaceAttributes[] = {
+		EGL_WIDTH, 1,
+		EGL_HEIGHT, 1,
+		EGL_NONE
+	};
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+
+	*display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (*display == EGL_NO_DISPLAY || !eglInitialize(*display, NULL, NULL))
+	{
+		return 0;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API) ||
+		!eglChooseConfig(*display, configAttributes, &config, 1, &numConfigs) ||
+		numConfigs < 1)
+	{
+		return 0;
+	}
+
+	/* nothing is rasterized, but draws need a complete framebuffer even
+	** with the rasterizer discarding
+	*/
+	*surface = eglCreatePbufferSurface(*display, config, surfaceAttributes);
+	*context = eglCreateContext(
+			*display,
+			config,
+			EGL_NO_CONTEXT,
+			contextAttributes
+		);
+
+	return *surface != EGL_NO_SURFACE && *context != EGL_NO_CONTEXT &&
+		eglMakeCurrent(*display, *surface, *surface, *context);
+}
+
+int main(int argc, char** argv)
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = EGL_NO_CONTEXT;
+	MD5AssetHash hash = 0;
+	int meshId = argc > 3 ? atoi(argv[2]) : -1;
+	int animationId = argc > 3 ? atoi(argv[3]) : -1;
+	float tolerance = argc > 4 ? (float)atof(argv[4]) : DEFAULT_TOLERANCE;
+	int numFrames = 0;
+	int numFailed = 0;
+	int i = 0;
+
+	if (argc < 4)
+	{
+		printf("usage: %s config meshId animationId [tolerance]\n", argv[0]);
+		return 1;
+	}
+
+	if (!CreateContext(&display, &surface, &context))
+	{
+		printf("Could not create a gl 3.3 context\n");
+		return 1;
+	}
+
+	printf("%s\n", (const char*)glGetString(GL_RENDERER));
+
+	if (!MD5OpenGLMeshManagerCreate(argv[1]))
+	{
+		printf("Could not create the mesh manager for %s\n", argv[1]);
+		return 1;
+	}
+
+	if (!MD5OpenGLMeshManagerGetMeshWithId(meshId) ||
+		!MD5OpenGLMeshManagerGetAnimationInfo(animationId, &numFrames, &hash))
+	{
+		MD5OpenGLMeshManagerDestroy();
+		return 1;
+	}
+
+	for (i = 0; i < numFrames; i++)
+	{
+		if (!MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+				meshId,
+				animationId,
+				i
+			) ||
+			!MD5OpenGLMeshManagerVerifyGpuSkinning(meshId, tolerance))
+		{
+			printf("frame %d failed\n", i);
+			numFailed++;
+		}
+	}
+
+	printf("mesh %d, animation %d: %d of %d frames within %g\n", meshId,
+		animationId, numFrames - numFailed, numFrames, tolerance);
+
+	MD5OpenGLMeshManagerDestroy();
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglDestroySurface(display, surface);
+	eglTerminate(display);
+
+	return numFailed > 0 || numFrames == 0;
+}
+
+#endif /* MD5_OPENGL_GPU_SKINNING_CHECK_MAIN */
@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "MD5OpenGLImpostor.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+static char errMsg[1024];
+
+#define MD5_IMPOSTOR_PI 3.14159265358979f
+#define MD5_IMPOSTOR_TIMEOUT 1000000000 	/* nanoseconds to wait for a row
+											** per call */
+
+/* the bounding sphere is stored in the image id field of the TGA */
+#define MD5_IMPOSTOR_TGA_MAGIC "MD5I"
+#define MD5_IMPOSTOR_TGA_HEADER_SIZE 18
+#define MD5_IMPOSTOR_TGA_ID_SIZE (4 + 4*sizeof(float))
+
+int MD5OpenGLImpostorCreate(
+	MD5OpenGLImpostor* impostor,
+	int numFrames,
+	int numAngles,
+	int cellSize
+)
+{
+	GLint maxSize = 0;
+
+	memset(impostor, 0, sizeof(MD5OpenGLImpostor));
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+	if (numFrames <= 0 || numAngles <= 0 || cellSize <= 0 ||
+		cellSize > maxSize || numAngles*cellSize > maxSize)
+	{
+		sprintf(errMsg, "Warning: Invalid impostor layout: %d angles of %d texels. The max. texture size is %d", numAngles, cellSize, maxSize);
+		ERR_MSG(errMsg);
+		return 0;
+	}
+
+	/* skip frames until the rows fit into a texture */
+	impostor->frameStep = 1;
+
+	while ((numFrames + impostor->frameStep - 1)/impostor->frameStep*cellSize > maxSize)
+	{
+		impostor->frameStep++;
+	}
+
+	impostor->numFrames = numFrames;
+	impostor->numRows = (numFrames + impostor->frameStep - 1)/impostor->frameStep;
+	impostor->numAngles = numAngles;
+	impostor->cellSize = cellSize;
+	impostor->width = numAngles*cellSize;
+	impostor->height = impostor->numRows*cellSize;
+
+	return 1;
+}
+
+/*
+** Creates the atlas texture, with pixels (BGRA) if they are not NULL.
+*/
+static void MD5OpenGLImpostorCreateAtlas(
+	MD5OpenGLImpostor* impostor,
+	const unsigned char* pixels
+)
+{
+	glDeleteTextures(1, &impostor->atlas);
+	glGenTextures(1, &impostor->atlas);
+	glBindTexture(GL_TEXTURE_2D, impostor->atlas);
+
+	glTexImage2D(
+		GL_TEXTURE_2D,
+		0,
+		GL_RGBA8,
+		impostor->width,
+		impostor->height,
+		0,
+		GL_BGRA,
+		GL_UNSIGNED_BYTE,
+		pixels
+	);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	if (pixels)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+** Computes the matrices of the view from angle: an orthographic projection
+** of the bounding sphere, seen from a point on its equator.
+*/
+static void MD5OpenGLImpostorComputeView(
+	const MD5OpenGLImpostor* impostor,
+	int angle,
+	float* view,
+	float* projection
+)
+{
+	float theta = 2.0f*MD5_IMPOSTOR_PI*angle/impostor->numAngles;
+	float c = cosf(theta), s = sinf(theta);
+	float r = impostor->radius;
+	float eye[3];
+
+	eye[0] = impostor->center.x + 2.0f*r*c;
+	eye[1] = impostor->center.y + 2.0f*r*s;
+	eye[2] = impostor->center.z;
+
+	/* looking along -(c, s, 0) with z up: right is (-s, c, 0) */
+	memset(view, 0, 16*sizeof(float));
+	view[0] = -s;
+	view[4] = c;
+	view[9] = 1.0f;
+	view[2] = c;
+	view[6] = s;
+	view[12] = s*eye[0] - c*eye[1];
+	view[13] = -eye[2];
+	view[14] = -c*eye[0] - s*eye[1];
+	view[15] = 1.0f;
+
+	/* the sphere lies between the distances r and 3r from the eye */
+	memset(projection, 0, 16*sizeof(float));
+	projection[0] = 1.0f/r;
+	projection[5] = 1.0f/r;
+	projection[10] = -1.0f/r;
+	projection[14] = -2.0f;
+	projection[15] = 1.0f;
+}
+
+/*
+** Waits for the read back of row into pixelBuffer and copies it to image.
+** Returns 0 if it fails.
+*/
+static int MD5OpenGLImpostorReadRow(
+	const MD5OpenGLImpostor* impostor,
+	GLuint pixelBuffer,
+	GLsync fence,
+	int row,
+	unsigned char* image
+)
+{
+	size_t rowBytes = 4*(size_t)impostor->width*impostor->cellSize;
+	const void* pixels = NULL;
+	GLenum status = GL_TIMEOUT_EXPIRED;
+
+	while (status == GL_TIMEOUT_EXPIRED)
+	{
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, MD5_IMPOSTOR_TIMEOUT);
+	}
+
+	glDeleteSync(fence);
+
+	if (status == GL_WAIT_FAILED)
+	{
+		return 0;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+	pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowBytes, GL_MAP_READ_BIT);
+
+	if (!pixels)
+	{
+		return 0;
+	}
+
+	memcpy(image + row*rowBytes, pixels, rowBytes);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+	return 1;
+}
+
+int MD5OpenGLImpostorBake(
+	MD5OpenGLImpostor* impostor,
+	MD5OpenGLImpostorDrawCell drawCell,
+	void* data,
+	unsigned char* image
+)
+{
+	GLuint pixelBuffers[MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS];
+	GLsync fences[MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS];
+	GLuint framebuffer = 0;
+	GLuint depth = 0;
+	GLint previousFramebuffer = 0;
+	GLint viewport[4];
+	GLfloat clearColor[4];
+	GLboolean depthTest = GL_FALSE;
+	float view[16];
+	float projection[16];
+	int cell = impostor->cellSize;
+	int slot = 0;
+	int result = 1;
+	int row = 0, angle = 0;
+
+	if (impostor->radius <= 0.0f)
+	{
+		ERR_MSG("Warning: The bounding sphere of the impostor is empty");
+		return 0;
+	}
+
+	MD5OpenGLImpostorCreateAtlas(impostor, NULL);
+
+	/* render target: the atlas and a depth buffer of the same size */
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, impostor->width, impostor->height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostor->atlas, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		ERR_MSG("Warning: The impostor framebuffer is incomplete");
+		glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &depth);
+		MD5OpenGLImpostorDestroy(impostor);
+		return 0;
+	}
+
+	if (image)
+	{
+		glGenBuffers(MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS, pixelBuffers);
+
+		for (slot = 0; slot < MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS; slot++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, 4*impostor->width*cell, NULL, GL_STREAM_READ);
+			fences[slot] = NULL;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glViewport(0, 0, impostor->width, impostor->height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	for (row = 0; row < impostor->numRows; row++)
+	{
+		for (angle = 0; angle < impostor->numAngles; angle++)
+		{
+			glViewport(angle*cell, row*cell, cell, cell);
+			MD5OpenGLImpostorComputeView(impostor, angle, view, projection);
+			drawCell(data, row*impostor->frameStep, view, projection);
+		}
+
+		if (!image)
+		{
+			continue;
+		}
+
+		/* start reading the row back, the copy to the host waits until the
+		** slot is reused, so it overlaps with rendering the next rows
+		*/
+		slot = row % MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS;
+
+		if (fences[slot])
+		{
+			result = MD5OpenGLImpostorReadRow(
+				impostor,
+				pixelBuffers[slot],
+				fences[slot],
+				row - MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS,
+				image
+			) && result;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, row*cell, impostor->width, cell, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	if (image)
+	{
+		/* the last rows are still in flight */
+		row = impostor->numRows - MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS;
+
+		for (row = row > 0 ? row : 0; row < impostor->numRows; row++)
+		{
+			slot = row % MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS;
+
+			result = MD5OpenGLImpostorReadRow(
+				impostor,
+				pixelBuffers[slot],
+				fences[slot],
+				row,
+				image
+			) && result;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glDeleteBuffers(MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS, pixelBuffers);
+	}
+
+	/* restore the state */
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	if (!depthTest)
+	{
+		glDisable(GL_DEPTH_TEST);
+	}
+
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &depth);
+
+	glBindTexture(GL_TEXTURE_2D, impostor->atlas);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!result || GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: opengl failed. Could not bake the impostor");
+		MD5OpenGLImpostorDestroy(impostor);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+** Writes a little endian 16 bit value to bytes.
+*/
+static void MD5OpenGLImpostorPutShort(unsigned char* bytes, int value)
+{
+	bytes[0] = value & 0xFF;
+	bytes[1] = (value >> 8) & 0xFF;
+}
+
+static int MD5OpenGLImpostorGetShort(const unsigned char* bytes)
+{
+	return bytes[0] | (bytes[1] << 8);
+}
+
+int MD5OpenGLImpostorLoad(MD5OpenGLImpostor* impostor, const char* path)
+{
+	unsigned char header[MD5_IMPOSTOR_TGA_HEADER_SIZE];
+	unsigned char id[MD5_IMPOSTOR_TGA_ID_SIZE];
+	size_t size = 4*(size_t)impostor->width*impostor->height;
+	unsigned char* pixels = NULL;
+	float sphere[4];
+	FILE* file = NULL;
+
+	file = fopen(path, "rb");
+
+	if (!file)
+	{
+		return 0;
+	}
+
+	/* uncompressed 32 bit true color of the size of the layout with the
+	** bounding sphere in the id field
+	*/
+	if (fread(header, sizeof(header), 1, file) != 1 ||
+		header[0] != MD5_IMPOSTOR_TGA_ID_SIZE || header[1] != 0 ||
+		header[2] != 2 || header[16] != 32 ||
+		MD5OpenGLImpostorGetShort(&header[12]) != impostor->width ||
+		MD5OpenGLImpostorGetShort(&header[14]) != impostor->height ||
+		fread(id, sizeof(id), 1, file) != 1 ||
+		memcmp(id, MD5_IMPOSTOR_TGA_MAGIC, 4))
+	{
+		sprintf(errMsg, "Warning: Impostor does not match its layout: %s", path);
+		ERR_MSG(errMsg);
+		fclose(file);
+		return 0;
+	}
+
+	pixels = (unsigned char*)malloc(size);
+
+	if (!pixels || fread(pixels, 1, size, file) != size)
+	{
+		free(pixels);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+
+	memcpy(sphere, id + 4, sizeof(sphere));
+	impostor->center.x = sphere[0];
+	impostor->center.y = sphere[1];
+	impostor->center.z = sphere[2];
+	impostor->radius = sphere[3];
+
+	MD5OpenGLImpostorCreateAtlas(impostor, pixels);
+	free(pixels);
+
+	if (GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: opengl failed. Could not load the impostor");
+		MD5OpenGLImpostorDestroy(impostor);
+		return 0;
+	}
+
+	return 1;
+}
+
+int MD5OpenGLImpostorStore(
+	const MD5OpenGLImpostor* impostor,
+	const char* path,
+	const unsigned char* image
+)
+{
+	unsigned char header[MD5_IMPOSTOR_TGA_HEADER_SIZE];
+	unsigned char id[MD5_IMPOSTOR_TGA_ID_SIZE];
+	size_t size = 4*(size_t)impostor->width*impostor->height;
+	float sphere[4];
+	FILE* file = NULL;
+	int written = 0;
+
+	memset(header, 0, sizeof(header));
+	header[0] = MD5_IMPOSTOR_TGA_ID_SIZE;
+	header[2] = 2; 					/* uncompressed true color */
+	MD5OpenGLImpostorPutShort(&header[12], impostor->width);
+	MD5OpenGLImpostorPutShort(&header[14], impostor->height);
+	header[16] = 32;
+	header[17] = 8; 				/* 8 alpha bits, origin bottom left */
+
+	sphere[0] = impostor->center.x;
+	sphere[1] = impostor->center.y;
+	sphere[2] = impostor->center.z;
+	sphere[3] = impostor->radius;
+	memcpy(id, MD5_IMPOSTOR_TGA_MAGIC, 4);
+	memcpy(id + 4, sphere, sizeof(sphere));
+
+	file = fopen(path, "wb");
+
+	if (file)
+	{
+		written = fwrite(header, sizeof(header), 1, file) == 1 &&
+			fwrite(id, sizeof(id), 1, file) == 1 &&
+			fwrite(image, 1, size, file) == size;
+		written = !fclose(file) && written;
+	}
+
+	if (!written)
+	{
+		sprintf(errMsg, "Warning: Could not write impostor: %s", path);
+		ERR_MSG(errMsg);
+	}
+
+	return written;
+}
+
+void MD5OpenGLImpostorGetCell(
+	const MD5OpenGLImpostor* impostor,
+	int frame,
+	const float* direction,
+	float* cell
+)
+{
+	float angle = atan2f(direction[1], direction[0]);
+	int column = (int)floorf(0.5f*angle/MD5_IMPOSTOR_PI*impostor->numAngles + 0.5f);
+	int row = 0;
+
+	/* the view closest to the direction, see MD5OpenGLImpostorComputeView */
+	column = (column % impostor->numAngles + impostor->numAngles) % impostor->numAngles;
+
+	frame = frame > 0 ? frame % impostor->numFrames : 0;
+	row = frame/impostor->frameStep;
+
+	cell[0] = (float)column/impostor->numAngles;
+	cell[1] = (float)row/impostor->numRows;
+	cell[2] = 1.0f/impostor->numAngles;
+	cell[3] = 1.0f/impostor->numRows;
+}
+
+void MD5OpenGLImpostorDestroy(MD5OpenGLImpostor* impostor)
+{
+	glDeleteTextures(1, &impostor->atlas);
+	impostor->atlas = 0;
+}
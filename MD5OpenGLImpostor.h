@@ -0,0 +1,135 @@
+/*
+ * Impostor atlases of animated meshes
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5OPENGLIMPOSTOR_H
+#define MD5OPENGLIMPOSTOR_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <Fxs/Math/Vector3.h>
+#define GL_GLEXT_PROTOTYPES 1
+#include <Fxs/Opengl/glcorearb.h>
+
+#define MD5_OPENGL_IMPOSTOR_NUM_PIXEL_BUFFERS 3 	/* rows read back in
+													** flight while baking */
+
+/*
+** Draws a pose for a cell of the atlas: frame of the animation, seen with
+** the view and projection matrix (column major) of the cell. The viewport
+** is set to the cell.
+*/
+typedef void (*MD5OpenGLImpostorDrawCell)(
+	void* data,
+	int frame,
+	const float* view,
+	const float* projection
+);
+
+/*
+** Atlas of the views of an animated mesh.
+**
+** Each row of the atlas holds a sampled frame of the animation, each column
+** a view from one of numAngles directions evenly spaced around the z axis
+** (the up axis of md5 models). The views are orthographic, looking at the
+** bounding sphere of the poses from its equator. Texels not covered by the
+** mesh have alpha 0. Row 0 is at the bottom of the texture.
+*/
+typedef struct
+{
+	GLuint atlas; 				/* RGBA8 texture, mipmapped */
+	int numFrames; 				/* # of frames of the animation */
+	int frameStep; 				/* every frameStep-th frame is sampled */
+	int numRows; 				/* # of sampled frames */
+	int numAngles;
+	int cellSize; 				/* width and height of a view in texels */
+	int width;
+	int height;
+
+	/* bounding sphere of the sampled poses */
+	FxsVector3 center;
+	float radius;
+}
+MD5OpenGLImpostor;
+
+/*
+** Sets up the layout of the atlas for an animation with numFrames frames.
+** Frames are skipped if the rows would not fit into a texture. No gl
+** objects are created. Returns 0 if the layout is invalid.
+*/
+int MD5OpenGLImpostorCreate(
+	MD5OpenGLImpostor* impostor,
+	int numFrames,
+	int numAngles,
+	int cellSize
+);
+
+/*
+** Renders the atlas into an offscreen framebuffer, calling drawCell for each
+** cell. The bounding sphere has to be set. If image is not NULL the atlas is
+** read back to it (width*height BGRA texels, bottom row first) through pixel
+** buffers, each row asynchronously while the next rows are rendered. The
+** viewport, clear color, depth test and framebuffer are restored. Returns 0
+** if it fails.
+*/
+int MD5OpenGLImpostorBake(
+	MD5OpenGLImpostor* impostor,
+	MD5OpenGLImpostorDrawCell drawCell,
+	void* data,
+	unsigned char* image
+);
+
+/*
+** Loads the atlas and the bounding sphere from the TGA at path, which has to
+** match the layout. Returns 0 if it fails.
+*/
+int MD5OpenGLImpostorLoad(MD5OpenGLImpostor* impostor, const char* path);
+
+/*
+** Writes image (see MD5OpenGLImpostorBake) and the bounding sphere to path
+** as TGA. Returns 0 if it fails.
+*/
+int MD5OpenGLImpostorStore(
+	const MD5OpenGLImpostor* impostor,
+	const char* path,
+	const unsigned char* image
+);
+
+/*
+** Gets the cell of the atlas for frame (any frame of the animation) seen
+** from direction (from the center to the viewer in the space of the mesh):
+** the min. and the size of its texture coordinates.
+*/
+void MD5OpenGLImpostorGetCell(
+	const MD5OpenGLImpostor* impostor,
+	int frame,
+	const float* direction,
+	float* cell
+);
+
+/*
+** Destroys the atlas.
+*/
+void MD5OpenGLImpostorDestroy(MD5OpenGLImpostor* impostor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5OPENGLIMPOSTOR_H */
@@ -1,572 +1,2771 @@
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <stddef.h>
+#include <time.h>
 #include <Fxs/Math/Vector4.h>
 #include "MD5OpenGLMeshManager.h"
+#include "MD5Skinning.h"
+#include "MD5VertexFormat.h"
+#include "MD5CompressedAnimation.h"
+#include "MD5WorkerPool.h"
+#include "MD5AssetHash.h"
+#include "MD5OpenGLProgramCache.h"
 #include <Fxs/MD5/MD5Animation.h>
 #include "../External/parson.h"
 
 #define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
 static char errMsg[1024];
 
+/* shared vertex and element arena for the vertices and indices of all 
+** meshes. The renderer draws them through its own VAOs (see 
+** MD5OpenGLMeshManagerCreateInstancedVertexArray).
+*/
+static GLuint vertexArena;
+static GLuint elementArena;
+
+/* format of the positions in the vertex arena */
+static MD5PositionFormat positionFormat = MD5_POSITION_FORMAT_FLOAT;
+
+/* linear allocator for transient data of a pose update (e.g. the joint 
+** palette). It is reset at the beginning of each update and sized to hold
+** the transient data of the largest mesh.
+*/
+static MD5Arena scratchArena;
+
+/* worker threads that skin the meshes requested in a frame while the gl 
+** thread draws it (see MD5OpenGLMeshManagerSubmitRequestedPoses). Each 
+** worker has its own scratch arena. Decoding compressed animations and 
+** posing md5meshes is serialized: the decode caches are not thread safe and
+** meshes sharing their data share the md5mesh, whose current pose is 
+** written by posing it.
+*/
+static MD5WorkerPool workerPool;
+static int numWorkers = 0;
+static MD5Arena* workerScratchArenas = NULL;
+
 /* forward decl. of a destructor fct. for a MD5OpenGLMesh */
 static void MD5OpenGLMeshDestroy(MD5OpenGLMesh** glmesh);
 
+/* forward decl. of the fence between the workers and the gl thread */
+static void MD5OpenGLMeshManagerFinishWorkers();
+
 /*
-** Creates a MD5OpenGLMesh from an md5file
-*/ 
-static int MD5OpenGLMeshCreateWithFile(
-	MD5OpenGLMesh** glmesh, 
-	const char* filename
+** Computes the vertices and the bounding boxes of mesh for the joint
+** transforms in palette, or with dual quaternion skinning for the dual 
+** quaternion palette dqPalette (see MD5OpenGLMeshComputeSkinningPalette). 
+** If back is not 0, the results are written to the back buffers of mesh 
+** (see MD5OpenGLMeshManagerSubmitRequestedPoses).
+*/
+static void MD5OpenGLMeshSkin(
+	MD5OpenGLMesh* mesh, 
+	const MD5JointMatrix* palette,
+	const MD5DualQuaternion* dqPalette,
+	int back
 )
 {
-	FxsMD5Mesh* md5mesh = NULL;
-	FxsMD5SubMesh* md5subMesh = NULL;
-	FxsMD5Weight* md5weight = NULL;
-	FxsMD5Vertex* md5vertex = NULL;
-	FxsMD5Face* md5face = NULL;
-	FxsMD5Joint* md5joint = NULL;
-	FxsVector4 weightPosition; 				/* transformed weight position */
-	FxsVector3* vertPosition;
-	unsigned int count = 0; 				/* counts the vertices loaded */
-	unsigned int* vertexIds = NULL; 		/* vertex indices of md5face */
-	int i = 0, j = 0, k = 0, l = 0; 	 	/* loop variables */
+	FxsMD5Mesh* md5mesh = mesh->md5mesh;
+	FxsMD5SubMesh* md5submesh = NULL;
+	FxsVector3* vertPosition = NULL;
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	MD5Vertex* vertices = NULL;
+	FxsVector3* min = back ? &mesh->backMin : &mesh->min;
+	FxsVector3* max = back ? &mesh->backMax : &mesh->max;
+	FxsVector3* subMin = NULL;
+	FxsVector3* subMax = NULL;
+	int i = 0, j = 0;
+
+	min->x = FLT_MAX;
+	min->y = FLT_MAX;
+	min->z = FLT_MAX;
+	max->x = -FLT_MAX;
+	max->y = -FLT_MAX;
+	max->z = -FLT_MAX;
 
-	if (!FxsMD5MeshCreateWithFile(&md5mesh, filename))
+	for (i = 0; i < md5mesh->numSubMeshes; i++) 
 	{
-		sprintf(errMsg, "Warning: could not load md5mesh: %s", filename);
-		ERR_MSG(errMsg);
-		return 0;
+		glsubmesh = &mesh->subMeshes[i];
+		md5submesh = &md5mesh->meshes[i];
+		vertices = back ? glsubmesh->verticesBack : glsubmesh->verticesHost;
+		subMin = back ? &glsubmesh->backMin : &glsubmesh->min;
+		subMax = back ? &glsubmesh->backMax : &glsubmesh->max;
+
+		subMin->x = FLT_MAX;
+		subMin->y = FLT_MAX;
+		subMin->z = FLT_MAX;
+		subMax->x = -FLT_MAX;
+		subMax->y = -FLT_MAX;
+		subMax->z = -FLT_MAX;
+
+		/* update each vertex */
+		for (j = 0; j < glsubmesh->numVertices; j++)
+		{
+			if (mesh->skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
+			{
+				MD5SkinningSkinVertexDualQuaternion(
+					&vertices[j],
+					md5submesh,
+					glsubmesh->vertexMap[j],
+					glsubmesh->bindPositions,
+					glsubmesh->bindNormals,
+					glsubmesh->bindTangents,
+					glsubmesh->handedness,
+					dqPalette
+				);
+			}
+			else
+			{
+				MD5SkinningSkinVertex(
+					&vertices[j],
+					md5submesh,
+					glsubmesh->vertexMap[j],
+					glsubmesh->weightNormals,
+					glsubmesh->weightTangents,
+					glsubmesh->handedness,
+					palette
+				);
+			}
+
+			vertPosition = &vertices[j].position;
+
+			/* update the bounding box */
+			subMin->x = fminf(subMin->x, vertPosition->x);
+			subMin->y = fminf(subMin->y, vertPosition->y);
+			subMin->z = fminf(subMin->z, vertPosition->z);
+			subMax->x = fmaxf(subMax->x, vertPosition->x);
+			subMax->y = fmaxf(subMax->y, vertPosition->y);
+			subMax->z = fmaxf(subMax->z, vertPosition->z);
+		}
+		
+		min->x = fminf(subMin->x, min->x);
+		min->y = fminf(subMin->y, min->y);
+		min->z = fminf(subMin->z, min->z);
+
+		max->x = fmaxf(subMax->x, max->x);
+		max->y = fmaxf(subMax->y, max->y);
+		max->z = fmaxf(subMax->z, max->z);
 	}
+}
 
-	*glmesh = (MD5OpenGLMesh*)malloc(sizeof(MD5OpenGLMesh));
+/*
+** Swaps the front and back buffers of mesh.
+*/
+static void MD5OpenGLMeshSwapBuffers(MD5OpenGLMesh* mesh)
+{
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	MD5Vertex* vertices = NULL;
+	FxsVector3 v;
+	int i = 0;
 
-	if (!glmesh) 
+	for (i = 0; i < mesh->numSubMeshes; i++)
 	{
-		sprintf(
-			errMsg,
-			"Warning: malloc for MD5OpenGL mesh failed. Could not load md5mesh: %s", 
-			filename
-		);
-	    ERR_MSG(errMsg)
-		FxsMD5MeshDestroy(&md5mesh);
-		return 0;
+		glsubmesh = &mesh->subMeshes[i];
+		vertices = glsubmesh->verticesHost;
+		glsubmesh->verticesHost = glsubmesh->verticesBack;
+		glsubmesh->verticesBack = vertices;
+		v = glsubmesh->min;
+		glsubmesh->min = glsubmesh->backMin;
+		glsubmesh->backMin = v;
+		v = glsubmesh->max;
+		glsubmesh->max = glsubmesh->backMax;
+		glsubmesh->backMax = v;
 	}
 
-	/* prepare gl mesh */
-	memset(*glmesh, 0, sizeof(MD5OpenGLMesh));
-	(*glmesh)->md5mesh = md5mesh;  
-	(*glmesh)->numSubMeshes = md5mesh->numSubMeshes;
-	(*glmesh)->subMeshes = (MD5OpenGLSubMesh*)malloc(
-			md5mesh->numSubMeshes*sizeof(MD5OpenGLSubMesh)
-		);
+	v = mesh->min;
+	mesh->min = mesh->backMin;
+	mesh->backMin = v;
+	v = mesh->max;
+	mesh->max = mesh->backMax;
+	mesh->backMax = v;
+}
+
+/*
+** Bakes the data of the bind pose given by palette that is needed for 
+** skinning mesh. numMD5Vertices holds the # of md5 vertices of each 
+** submesh. Returns 0 if it fails.
+*/
+static int MD5OpenGLMeshBakeBindPose(
+	MD5OpenGLMesh* mesh,
+	const MD5JointMatrix* palette,
+	const int* numMD5Vertices
+)
+{
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	FxsVector3* bindFrames = NULL;
+	int keepBindFrames = mesh->skinningMethod == MD5_SKINNING_DUAL_QUATERNION ||
+		mesh->gpuSkinning;
+	int maxMD5Vertices = 0;
+	int i = 0;
 
-	if (!(*glmesh)->subMeshes)
+	if (mesh->skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
 	{
-		sprintf(
-			errMsg, 
-			"Warning: malloc failed. Could not load md5mesh: %s", 
-			filename
+		MD5SkinningComputeInverseBindPose(
+			mesh->inverseBindPose, 
+			palette, 
+			mesh->numJoints
+		);
+	}
+	else if (mesh->gpuSkinning)
+	{
+		MD5SkinningComputeInverseBindMatrices(
+			mesh->inverseBindMatrices, 
+			palette, 
+			mesh->numJoints
 		);
+	}
 
-		ERR_MSG(errMsg);	
-		FxsMD5MeshDestroy(&md5mesh);
-		MD5OpenGLMeshDestroy(glmesh);
-		return 0;
-	}		
+	if (!keepBindFrames)
+	{
+		/* linear blend skinning on the host only keeps the frames in joint
+		** space 
+		*/
+		for (i = 0; i < mesh->numSubMeshes; i++)
+		{
+			maxMD5Vertices = numMD5Vertices[i] > maxMD5Vertices ? 
+				numMD5Vertices[i] : maxMD5Vertices;
+		}
 
-	memset(
-		(*glmesh)->subMeshes, 
-		0, 
-		(*glmesh)->numSubMeshes*sizeof(MD5OpenGLSubMesh)
-	);
+		bindFrames = (FxsVector3*)malloc(3*maxMD5Vertices*sizeof(FxsVector3) + 1);
 
-	(*glmesh)->min.x = FLT_MAX;
-	(*glmesh)->min.y = FLT_MAX;
-	(*glmesh)->min.z = FLT_MAX;
-	(*glmesh)->max.x = FLT_MIN;
-	(*glmesh)->max.y = FLT_MIN;
-	(*glmesh)->max.z = FLT_MIN;
-	
-	/* load the submeshes */
-	for (i = 0; i < md5mesh->numSubMeshes; i++)       /* for each md5submesh */
+		if (!bindFrames)
+		{
+			return 0;
+		}
+	}
+
+	for (i = 0; i < mesh->numSubMeshes; i++)
 	{
-	  	md5subMesh = &md5mesh->meshes[i];
+		glsubmesh = &mesh->subMeshes[i];
 
-		/* alloc host memory for positions of this gl submesh */
-		(*glmesh)->subMeshes[i].numPositions = 3*md5subMesh->numFaces;
-		(*glmesh)->subMeshes[i].positionsHost = (FxsVector3*)malloc(
-				3*md5subMesh->numFaces*sizeof(FxsVector3)
-			);
-		
-		if (!(*glmesh)->subMeshes[i].positionsHost) 
+		if (!keepBindFrames)
 		{
-		    sprintf(
-				errMsg, 
-				"Warning: malloc failed. Could not load md5mesh: %s", 
-				filename
-			);
-			
-			ERR_MSG(errMsg);	
-			FxsMD5MeshDestroy(&md5mesh);
-			MD5OpenGLMeshDestroy(glmesh);
+			glsubmesh->bindPositions = bindFrames;
+			glsubmesh->bindNormals = bindFrames + maxMD5Vertices;
+			glsubmesh->bindTangents = bindFrames + 2*maxMD5Vertices;
 		}
 
-		memset(
-			(*glmesh)->subMeshes[i].positionsHost,
-			0,
-			3*md5subMesh->numFaces*sizeof(FxsVector3)
-		);
-
-		/* init the bounding box for the sub mesh */
-		(*glmesh)->subMeshes[i].min.x = FLT_MAX;
-		(*glmesh)->subMeshes[i].min.y = FLT_MAX;
-		(*glmesh)->subMeshes[i].min.z = FLT_MAX;
-		(*glmesh)->subMeshes[i].max.x = FLT_MIN;
-		(*glmesh)->subMeshes[i].max.y = FLT_MIN;
-		(*glmesh)->subMeshes[i].max.z = FLT_MIN;
-		
-		count = 0;
+		if (!MD5SkinningComputeBindFrames(
+				glsubmesh->bindPositions,
+				glsubmesh->bindNormals,
+				glsubmesh->bindTangents,
+				glsubmesh->handedness,
+				&mesh->md5mesh->meshes[i],
+				numMD5Vertices[i],
+				palette
+			))
+		{
+			free(bindFrames);
+			return 0;
+		}
 
-		for (j = 0; j < md5subMesh->numFaces; j++)    /* for each face of the 
-													  ** submesh */ 
+		if (mesh->skinningMethod != MD5_SKINNING_DUAL_QUATERNION)
 		{
-			md5face = &md5subMesh->faces[j];
-			vertexIds = &md5face->v1;
-	
-			for (k = 0; k < 3; k++)           /* for each vertex of the face */
-			{
-				md5vertex = &md5subMesh->vertices[vertexIds[k]];
-				
-				/* make the current vertex position zero */
-				vertPosition = &(*glmesh)->subMeshes[i].positionsHost[count];
-				FxsVector3MakeZero(vertPosition);
-			
-				for (l = 0; l < md5vertex->numWeights; l++) /* for each weight 
-															** of the vertex */
-				{
-					md5weight = &md5subMesh->weights[md5vertex->weightId + l];
-					md5joint = &md5mesh->currentPose.joints[md5weight->jointId];
-					
-					FxsMatrix4MultiplyVector3(
-						&weightPosition, 
-						&md5joint->transform,
-						&md5weight->position
-					);
-
-					/* add up all weight positions to compute the final
-					** vertex position.
-					*/
-					vertPosition->x += md5weight->value*weightPosition.x;
-					vertPosition->y += md5weight->value*weightPosition.y;
-					vertPosition->z += md5weight->value*weightPosition.z;
-				}
+			MD5SkinningComputeWeightFrames(
+				glsubmesh->weightNormals,
+				glsubmesh->weightTangents,
+				&mesh->md5mesh->meshes[i],
+				numMD5Vertices[i],
+				glsubmesh->bindNormals,
+				glsubmesh->bindTangents,
+				palette
+			);
+		}
 
-				/* update the bounding box */
-				(*glmesh)->subMeshes[i].min.x = fminf(
-						(*glmesh)->subMeshes[i].min.x, vertPosition->x
-					);
+		if (!keepBindFrames)
+		{
+			glsubmesh->bindPositions = NULL;
+			glsubmesh->bindNormals = NULL;
+			glsubmesh->bindTangents = NULL;
+		}
+	}
 
-				(*glmesh)->subMeshes[i].min.y = fminf(
-						(*glmesh)->subMeshes[i].min.y, vertPosition->y
-					);
+	free(bindFrames);
 
-				(*glmesh)->subMeshes[i].min.z = fminf(
-						(*glmesh)->subMeshes[i].min.z, vertPosition->z
-					);
-		
-				(*glmesh)->subMeshes[i].max.x = fmaxf(
-						(*glmesh)->subMeshes[i].max.x, vertPosition->x
-					);
+	return 1;
+}
 
-				(*glmesh)->subMeshes[i].max.y = fmaxf(
-						(*glmesh)->subMeshes[i].max.y, vertPosition->y
-					);
+/*
+** Reorders the faces of md5submesh for the vertex cache into the indices of
+** glsubmesh and renumbers its vertices in the order of their first use. 
+** Returns 0 if it fails.
+*/
+static int MD5OpenGLSubMeshOptimize(
+	MD5OpenGLSubMesh* glsubmesh,
+	const FxsMD5SubMesh* md5submesh,
+	int numMD5Vertices
+)
+{
+	int i = 0;
 
-				(*glmesh)->subMeshes[i].max.z = fmaxf(
-						(*glmesh)->subMeshes[i].max.z, vertPosition->z
-					);
+	for (i = 0; i < md5submesh->numFaces; i++)
+	{
+		memcpy(
+			&glsubmesh->indices[3*i], 
+			&md5submesh->faces[i].v1, 
+			3*sizeof(unsigned int)
+		);
+	}
 
-				count++;
-			}	
-		}
-        
-		(*glmesh)->min.x = fminf((*glmesh)->subMeshes[i].min.x, (*glmesh)->min.x);
-		(*glmesh)->min.y = fminf((*glmesh)->subMeshes[i].min.y, (*glmesh)->min.y);
-		(*glmesh)->min.z = fminf((*glmesh)->subMeshes[i].min.z, (*glmesh)->min.z);
+	glsubmesh->acmrBefore = MD5VertexCacheComputeAcmr(
+			glsubmesh->indices,
+			md5submesh->numFaces,
+			numMD5Vertices,
+			MD5_VERTEX_CACHE_SIZE
+		);
 
-		(*glmesh)->max.x = fmaxf((*glmesh)->subMeshes[i].max.x, (*glmesh)->max.x);
-		(*glmesh)->max.y = fmaxf((*glmesh)->subMeshes[i].max.y, (*glmesh)->max.y);
-		(*glmesh)->max.z = fmaxf((*glmesh)->subMeshes[i].max.z, (*glmesh)->max.z);
+	if (!MD5VertexCacheOptimize(
+			glsubmesh->indices,
+			md5submesh->numFaces,
+			numMD5Vertices,
+			MD5_VERTEX_CACHE_SIZE
+		))
+	{
+		return 0;
+	}
 
-		/* initialize the opengl data for the sub mesh */
-		glGenBuffers(1, &(*glmesh)->subMeshes[i].positions);
-		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);  
-		
-		glBufferData(
-			GL_ARRAY_BUFFER,
-		 	sizeof(FxsVector3)*(*glmesh)->subMeshes[i].numPositions,
-			(*glmesh)->subMeshes[i].positionsHost,
-			GL_DYNAMIC_DRAW
+	glsubmesh->numVertices = MD5VertexCacheRemap(
+			glsubmesh->indices,
+			md5submesh->numFaces,
+			numMD5Vertices,
+			glsubmesh->vertexMap
 		);
-		
-		glGenVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-		glBindVertexArray((*glmesh)->subMeshes[i].vao);
-		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	
-		if (GL_NO_ERROR != glGetError()) 
-		{
-			sprintf(errMsg, "Warning: opengl failed. Could not load md5mesh: %s", filename);
-			ERR_MSG(errMsg);	
-			FxsMD5MeshDestroy(&md5mesh);
-			MD5OpenGLMeshDestroy(glmesh);
-			return 0;		    
-		}
+
+	if (glsubmesh->numVertices < 0)
+	{
+		return 0;
 	}
-	
+
+	glsubmesh->acmrAfter = MD5VertexCacheComputeAcmr(
+			glsubmesh->indices,
+			md5submesh->numFaces,
+			glsubmesh->numVertices,
+			MD5_VERTEX_CACHE_SIZE
+		);
+
 	return 1;
 }
 
 /*
-** updates the md5mesh of mesh according to the passed animation and the frame.
-** updates geometry on host and opengl side according to the updated pose.
+** Creates a MD5OpenGLMesh from an md5file.
+**
+** The mesh, its submeshes and their host positions are allocated from a
+** single arena owned by the mesh.
 */ 
-static int MD5OpenGLMeshUpdatePoseWithAnimationFrame(
-	MD5OpenGLMesh* mesh,
-	const FxsMD5Animation* animation, 
-	unsigned int frame
+static int MD5OpenGLMeshCreateWithFile(
+	MD5OpenGLMesh** glmesh, 
+	const char* filename,
+	MD5SkinningMethod skinningMethod,
+	int gpuSkinning
 )
 {
-	int i = 0, j = 0, k = 0, l = 0;
-	FxsMD5Mesh* md5mesh = mesh->md5mesh;
-	FxsMD5SubMesh* md5submesh = NULL;
-	FxsMD5Face* face = NULL;
-	FxsMD5Vertex* vertex = NULL;
-	FxsMD5Weight* weight = NULL;	
-	FxsMD5Joint* joint = NULL;
-	FxsVector3* vertPosition = NULL;
-	FxsVector4 weightPosition;
-	unsigned int* vertexIds = NULL;
+	FxsMD5Mesh* md5mesh = NULL;
+	FxsMD5SubMesh* md5subMesh = NULL;
+	FxsMD5Vertex* md5vertex = NULL;
+	FxsMD5Weight* md5weight = NULL;
+	MD5Arena arena;
+	MD5JointMatrix* palette = NULL;
 	MD5OpenGLSubMesh* glsubmesh = NULL;
-	int count = 0;	
+	size_t size = 0; 						/* size of the mesh's arena */
+	int numJoints = 0;
+	int* numMD5Vertices = NULL; 			/* # of md5 vertices and weights */
+	int* numMD5Weights = NULL; 				/* of each submesh */
+	int i = 0, j = 0, k = 0, l = 0; 		/* loop variables */
 
-	if (!FxsMD5MeshUpdatePoseWithAnimationFrame(mesh->md5mesh, animation, frame))
+	*glmesh = NULL;
+
+	if (!FxsMD5MeshCreateWithFile(&md5mesh, filename))
 	{
+		sprintf(errMsg, "Warning: could not load md5mesh: %s", filename);
+		ERR_MSG(errMsg);
 		return 0;
 	}
 
-	mesh->min.x = FLT_MAX;
-	mesh->min.y = FLT_MAX;
-	mesh->min.z = FLT_MAX;
-	mesh->max.x = FLT_MIN;
-	mesh->max.y = FLT_MIN;
-	mesh->max.z = FLT_MIN;
+	numMD5Vertices = (int*)calloc(2*md5mesh->numSubMeshes + 1, sizeof(int));
 
-	/* for all submeshes of the md5mesh, let's update the host and opengl data
-	** of the opengl submeshes geometry (positions ...)
-	*/ 
-	for (i = 0; i < md5mesh->numSubMeshes; i++) 
+	if (!numMD5Vertices)
 	{
-		glsubmesh = &mesh->subMeshes[i]; 		
-		md5submesh = &md5mesh->meshes[i];		
-		count = 0;
+		sprintf(errMsg, "Warning: malloc failed. Could not load md5mesh: %s", filename);
+		ERR_MSG(errMsg);
+		FxsMD5MeshDestroy(&md5mesh);
+		return 0;
+	}
+
+	numMD5Weights = numMD5Vertices + md5mesh->numSubMeshes;
+
+	/* compute the size of the arena, the # of vertices referenced by the
+	** faces of each submesh and the # of weights and joints referenced by
+	** these vertices. Skinning walks all vertices below the # of vertices,
+	** including those no face references.
+	*/
+	size = MD5ArenaSizeForAllocation(sizeof(MD5OpenGLMesh));
+	size += MD5ArenaSizeForAllocation(
+			md5mesh->numSubMeshes*sizeof(MD5OpenGLSubMesh)
+		);
+	size += MD5ArenaSizeForAllocation(
+			md5mesh->numSubMeshes*sizeof(MD5OpenGLSubMeshBounds)
+		);
 
-		mesh->subMeshes[i].min.x = FLT_MAX;
-		mesh->subMeshes[i].min.y = FLT_MAX;
-		mesh->subMeshes[i].min.z = FLT_MAX;
-		mesh->subMeshes[i].max.x = FLT_MIN;
-		mesh->subMeshes[i].max.y = FLT_MIN;
-		mesh->subMeshes[i].max.z = FLT_MIN;
+	for (i = 0; i < md5mesh->numSubMeshes; i++)
+	{
+	  	md5subMesh = &md5mesh->meshes[i];
 
-		/* for each face in the md5submesh ... */
-		for (j = 0; j < md5submesh->numFaces; j++) 
+		for (j = 0; j < md5subMesh->numFaces; j++)
 		{
-			face = &md5submesh->faces[j];		
-			vertexIds = &face->v1;
-		
-			/* ... update each vertex */
 			for (k = 0; k < 3; k++)
 			{
-				vertex = &md5submesh->vertices[vertexIds[k]];
-
-				/* make the current vertex position zero */
-				vertPosition = &mesh->subMeshes[i].positionsHost[count];
-				FxsVector3MakeZero(vertPosition);
+				l = (&md5subMesh->faces[j].v1)[k];
 
-				/* update the position of each vertex by interation over
-				** each of its weights
-				*/
-				for (l = 0; l < vertex->numWeights; l++)
+				if (l >= numMD5Vertices[i])
 				{
-					weight = &md5submesh->weights[vertex->weightId + l];	
-					joint = &md5mesh->currentPose.joints[weight->jointId];		
-					
-					FxsMatrix4MultiplyVector3(
-						&weightPosition, 
-						&joint->transform,
-						&weight->position
-					);
-
-					/* add up all weight positions to compute the final
-					** vertex position.
-					*/
-					vertPosition->x += weight->value*weightPosition.x;
-					vertPosition->y += weight->value*weightPosition.y;
-					vertPosition->z += weight->value*weightPosition.z;					
-				}	
-
-				/* update the bounding box */
-				mesh->subMeshes[i].min.x = fminf(
-						mesh->subMeshes[i].min.x, vertPosition->x
-					);
-
-				mesh->subMeshes[i].min.y = fminf(
-						mesh->subMeshes[i].min.y, vertPosition->y
-					);
-
-				mesh->subMeshes[i].min.z = fminf(
-						mesh->subMeshes[i].min.z, vertPosition->z
-					);
-		
-				mesh->subMeshes[i].max.x = fmaxf(
-						mesh->subMeshes[i].max.x, vertPosition->x
-					);
+					numMD5Vertices[i] = l + 1;
+				}
+			}
+		}
 
-				mesh->subMeshes[i].max.y = fmaxf(
-						mesh->subMeshes[i].max.y, vertPosition->y
-					);
+		for (j = 0; j < numMD5Vertices[i]; j++)
+		{
+			md5vertex = &md5subMesh->vertices[j];
 
-				mesh->subMeshes[i].max.z = fmaxf(
-						mesh->subMeshes[i].max.z, vertPosition->z
-					);
+			if (md5vertex->weightId + md5vertex->numWeights > numMD5Weights[i])
+			{
+				numMD5Weights[i] = md5vertex->weightId + md5vertex->numWeights;
+			}
+			
+			for (l = 0; l < md5vertex->numWeights; l++)
+			{
+				md5weight = &md5subMesh->weights[md5vertex->weightId + l];
 
-				count++;
+				if (md5weight->jointId >= numJoints)
+				{
+					numJoints = md5weight->jointId + 1;
+				}
 			}
 		}
-		
-		mesh->min.x = fminf(mesh->subMeshes[i].min.x, mesh->min.x);
-		mesh->min.y = fminf(mesh->subMeshes[i].min.y, mesh->min.y);
-		mesh->min.z = fminf(mesh->subMeshes[i].min.z, mesh->min.z);
 
-		mesh->max.x = fmaxf(mesh->subMeshes[i].max.x, mesh->max.x);
-		mesh->max.y = fmaxf(mesh->subMeshes[i].max.y, mesh->max.y);
-		mesh->max.z = fmaxf(mesh->subMeshes[i].max.z, mesh->max.z);
+		/* the # of vertices is known after the optimization of the faces,
+		** all md5 vertices are reserved 
+		*/
+		size += (numWorkers > 0 ? 2 : 1)*MD5ArenaSizeForAllocation(
+				numMD5Vertices[i]*sizeof(MD5Vertex)
+			);
+		size += MD5ArenaSizeForAllocation(numMD5Vertices[i]*sizeof(int));
+		size += MD5ArenaSizeForAllocation(
+				3*md5subMesh->numFaces*sizeof(unsigned int)
+			);
+		size += MD5ArenaSizeForAllocation(numMD5Vertices[i]*sizeof(float));
 
-		/* update the opengl data for the sub mesh */
-		glBindBuffer(GL_ARRAY_BUFFER, mesh->subMeshes[i].positions);  
-	
-		glBufferSubData(
-			GL_ARRAY_BUFFER,
-			0,
-		 	sizeof(FxsVector3)*mesh->subMeshes[i].numPositions,
-			mesh->subMeshes[i].positionsHost
-		);
+		/* frames in joint space for linear blend skinning, the bind pose for 
+		** dual quaternion skinning and skinning on the gpu
+		*/
+		if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION || gpuSkinning)
+		{
+			size += 3*MD5ArenaSizeForAllocation(numMD5Vertices[i]*sizeof(FxsVector3));
+		}
 		
-//		glGenVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-//		glBindVertexArray((*glmesh)->subMeshes[i].vao);
-//		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);
-//		glEnableVertexAttribArray(0);
-//		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	
-		if (GL_NO_ERROR != glGetError()) 
+		if (skinningMethod != MD5_SKINNING_DUAL_QUATERNION)
 		{
-			sprintf(errMsg, "Warning: opengl failed. Could not update md5mesh");
-			ERR_MSG(errMsg);	
-			return 0;		    
-		}	
+			size += 2*MD5ArenaSizeForAllocation(numMD5Weights[i]*sizeof(FxsVector3));
+		}
 	}
-	
-	return 1;
-}
 
-/*
-** Destroys a MD5OpenGLMesh
-*/ 
-static void MD5OpenGLMeshDestroy(MD5OpenGLMesh** glmesh)
-{
-	int i = 0;
+	size += MD5ArenaSizeForAllocation(numJoints*sizeof(MD5JointMatrix));
 
-	if (!(*glmesh)) 
+	if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
 	{
-	    return;
+		size += MD5ArenaSizeForAllocation(numJoints*sizeof(MD5DualQuaternion));
+	}
+	else if (gpuSkinning)
+	{
+		size += MD5ArenaSizeForAllocation(numJoints*sizeof(MD5JointMatrix));
 	}
 
-	/* delete the md5 mesh */
-	if ((*glmesh)->md5mesh)
+	if (!MD5ArenaCreate(&arena, size))
 	{
-		FxsMD5MeshDestroy(&(*glmesh)->md5mesh);
+		sprintf(
+			errMsg,
+			"Warning: malloc for MD5OpenGL mesh failed. Could not load md5mesh: %s", 
+			filename
+		);
+	    ERR_MSG(errMsg)
+		free(numMD5Vertices);
+		FxsMD5MeshDestroy(&md5mesh);
+		return 0;
 	}
 
-	/* delete the submeshes and their data */
-	if ((*glmesh)->subMeshes)
+	/* prepare gl mesh. The sizes were computed above, so the allocations
+	** cannot fail.
+	*/
+	*glmesh = (MD5OpenGLMesh*)MD5ArenaCalloc(&arena, sizeof(MD5OpenGLMesh));
+	(*glmesh)->md5mesh = md5mesh;  
+	(*glmesh)->numSubMeshes = md5mesh->numSubMeshes;
+	(*glmesh)->numJoints = numJoints;
+	(*glmesh)->skinningMethod = skinningMethod;
+	(*glmesh)->gpuSkinning = gpuSkinning;
+	(*glmesh)->poseAnimationId = -1;
+	(*glmesh)->poseFrame = -1;
+	(*glmesh)->requestedAnimationId = -1;
+	(*glmesh)->requestedFrame = -1;
+	(*glmesh)->backAnimationId = -1;
+	(*glmesh)->backFrame = -1;
+	(*glmesh)->refCount = 1;
+	pthread_mutex_init(&(*glmesh)->poseMutex, NULL);
+	(*glmesh)->subMeshes = (MD5OpenGLSubMesh*)MD5ArenaCalloc(
+			&arena,
+			md5mesh->numSubMeshes*sizeof(MD5OpenGLSubMesh)
+		);
+	(*glmesh)->bounds = (MD5OpenGLSubMeshBounds*)MD5ArenaCalloc(
+			&arena,
+			md5mesh->numSubMeshes*sizeof(MD5OpenGLSubMeshBounds)
+		);
+	(*glmesh)->bindPose = (MD5JointMatrix*)MD5ArenaAlloc(
+			&arena,
+			numJoints*sizeof(MD5JointMatrix)
+		);
+
+	if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
 	{
-		for (i = 0; i < (*glmesh)->numSubMeshes; i++) 
-		{
-			if((*glmesh)->subMeshes[i].positions)
-			{
-				free((*glmesh)->subMeshes[i].positionsHost);
-				glDeleteBuffers(1, &(*glmesh)->subMeshes[i].positions);
-				glDeleteVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-			}
-		}
+		(*glmesh)->inverseBindPose = (MD5DualQuaternion*)MD5ArenaAlloc(
+				&arena,
+				numJoints*sizeof(MD5DualQuaternion)
+			);
+	}
+	else if (gpuSkinning)
+	{
+		(*glmesh)->inverseBindMatrices = (MD5JointMatrix*)MD5ArenaAlloc(
+				&arena,
+				numJoints*sizeof(MD5JointMatrix)
+			);
 	}
 
-	/* delete the gl mesh */
-	free(*glmesh);
-	
-	*glmesh = NULL;
-}
+	for (i = 0; i < md5mesh->numSubMeshes; i++)
+	{
+		glsubmesh = &(*glmesh)->subMeshes[i];
+		glsubmesh->verticesHost = (MD5Vertex*)MD5ArenaAlloc(
+				&arena,
+				numMD5Vertices[i]*sizeof(MD5Vertex)
+			);
+		if (numWorkers > 0)
+		{
+			glsubmesh->verticesBack = (MD5Vertex*)MD5ArenaAlloc(
+					&arena,
+					numMD5Vertices[i]*sizeof(MD5Vertex)
+				);
+		}
 
-#define MAX_MESHES 32  /* max amount of meshes stored by the manager 
-					   ** ids in the config file are allowed to be within
-					   ** 0 .. MAX_MESHES - 1.	
-					   */
-#define MAX_ANIMATIONS 32 /* max amount of animations stored by the manager
-					      ** ids in the config file are allowed to be within
-					      ** 0 .. MAX_ANIMATIONS - 1.
-					      */
+		glsubmesh->vertexMap = (int*)MD5ArenaAlloc(
+				&arena,
+				numMD5Vertices[i]*sizeof(int)
+			);
+		glsubmesh->numIndices = 3*md5mesh->meshes[i].numFaces;
+		glsubmesh->indices = (unsigned int*)MD5ArenaAlloc(
+				&arena,
+				glsubmesh->numIndices*sizeof(unsigned int)
+			);
+		glsubmesh->handedness = (float*)MD5ArenaAlloc(
+				&arena, 
+				numMD5Vertices[i]*sizeof(float)
+			);
 
-MD5OpenGLMesh* meshes[MAX_MESHES];
-FxsMD5Animation* animations[MAX_ANIMATIONS];
+		if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION || gpuSkinning)
+		{
+			glsubmesh->bindPositions = (FxsVector3*)MD5ArenaAlloc(
+					&arena, 
+					numMD5Vertices[i]*sizeof(FxsVector3)
+				);
+			glsubmesh->bindNormals = (FxsVector3*)MD5ArenaAlloc(
+					&arena, 
+					numMD5Vertices[i]*sizeof(FxsVector3)
+				);
+			glsubmesh->bindTangents = (FxsVector3*)MD5ArenaAlloc(
+					&arena, 
+					numMD5Vertices[i]*sizeof(FxsVector3)
+				);
+		}
+		
+		if (skinningMethod != MD5_SKINNING_DUAL_QUATERNION)
+		{
+			glsubmesh->weightNormals = (FxsVector3*)MD5ArenaAlloc(
+					&arena, 
+					numMD5Weights[i]*sizeof(FxsVector3)
+				);
+			glsubmesh->weightTangents = (FxsVector3*)MD5ArenaAlloc(
+					&arena, 
+					numMD5Weights[i]*sizeof(FxsVector3)
+				);
+		}
+	}
 
-static int wasInitialized = 0;
+	(*glmesh)->arena = arena;
 
-int MD5OpenGLMeshManagerCreate(const char* filename)
-{
-	JSON_Value* root = NULL;
-	JSON_Array* array = NULL;
+	for (i = 0; i < md5mesh->numSubMeshes; i++)
+	{
+		if (!MD5OpenGLSubMeshOptimize(
+				&(*glmesh)->subMeshes[i], 
+				&md5mesh->meshes[i],
+				numMD5Vertices[i]
+			))
+		{
+			sprintf(
+				errMsg, 
+				"Warning: malloc failed. Could not load md5mesh: %s", 
+				filename
+			);
+
+			ERR_MSG(errMsg);	
+			free(numMD5Vertices);
+			MD5OpenGLMeshDestroy(glmesh);
+			return 0;
+		}
+	}
+
+	(*glmesh)->scratchSize = MD5ArenaSizeForAllocation(
+			numJoints*sizeof(MD5JointMatrix)
+		);
+
+	/* the dual quaternion palette, or the skinning matrices for linear 
+	** blend skinning on the gpu 
+	*/
+	if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
+	{
+		(*glmesh)->scratchSize += MD5ArenaSizeForAllocation(
+				numJoints*sizeof(MD5DualQuaternion)
+			);
+	}
+	else if (gpuSkinning)
+	{
+		(*glmesh)->scratchSize += MD5ArenaSizeForAllocation(
+				numJoints*sizeof(MD5JointMatrix)
+			);
+	}
+
+	for (i = 0, j = 0; i < md5mesh->numSubMeshes; i++)
+	{
+		j = (*glmesh)->subMeshes[i].numVertices > j ? 
+			(*glmesh)->subMeshes[i].numVertices : j;
+	}
+
+	if (positionFormat != MD5_POSITION_FORMAT_FLOAT)
+	{
+		(*glmesh)->scratchSize += MD5ArenaSizeForAllocation(
+				j*MD5PositionFormatGetVertexSize(positionFormat)
+			);
+	}
+
+	/* bake the normals and tangents of the initial (bind) pose and skin the
+	** mesh in this pose 
+	*/
+	palette = (MD5JointMatrix*)malloc(
+			numJoints*(sizeof(MD5JointMatrix) + sizeof(MD5DualQuaternion)) + 1
+		);
+
+	if (!palette)
+	{
+		sprintf(
+			errMsg, 
+			"Warning: malloc failed. Could not load md5mesh: %s", 
+			filename
+		);
+
+		ERR_MSG(errMsg);	
+		free(numMD5Vertices);
+		MD5OpenGLMeshDestroy(glmesh);
+		return 0;
+	}
+
+	MD5SkinningComputePalette(palette, md5mesh, numJoints);
+	memcpy((*glmesh)->bindPose, palette, numJoints*sizeof(MD5JointMatrix));
+
+	if (!MD5OpenGLMeshBakeBindPose(*glmesh, palette, numMD5Vertices))
+	{
+		sprintf(
+			errMsg, 
+			"Warning: malloc failed. Could not load md5mesh: %s", 
+			filename
+		);
+
+		ERR_MSG(errMsg);	
+		free(palette);
+		free(numMD5Vertices);
+		MD5OpenGLMeshDestroy(glmesh);
+		return 0;
+	}
+
+	if (skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
+	{
+		MD5SkinningComputeDualQuaternionPalette(
+			(MD5DualQuaternion*)(palette + numJoints), 
+			palette, 
+			(*glmesh)->inverseBindPose,
+			numJoints
+		);
+	}
+
+	MD5OpenGLMeshSkin(
+		*glmesh, 
+		palette, 
+		(MD5DualQuaternion*)(palette + numJoints),
+		0
+	);
+	free(palette);
+	free(numMD5Vertices);
+	
+	return 1;
+}
+
+/*
+** Creates a MD5OpenGLMesh that shares the immutable data of source. Only 
+** the mesh, its submeshes and their skinned vertices are allocated, the 
+** mesh starts in the pose of source. The md5mesh is shared too, its current
+** pose is only valid while the poseMutex of source is held (see 
+** MD5OpenGLMeshComputePalette).
+*/
+static int MD5OpenGLMeshCreateInstance(
+	MD5OpenGLMesh** glmesh, 
+	MD5OpenGLMesh* source
+)
+{
+	MD5Arena arena;
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	size_t size = 0;
+	int i = 0;
+
+	*glmesh = NULL;
+
+	size = MD5ArenaSizeForAllocation(sizeof(MD5OpenGLMesh));
+	size += MD5ArenaSizeForAllocation(
+			source->numSubMeshes*sizeof(MD5OpenGLSubMesh)
+		);
+	size += MD5ArenaSizeForAllocation(
+			source->numSubMeshes*sizeof(MD5OpenGLSubMeshBounds)
+		);
+
+	for (i = 0; i < source->numSubMeshes; i++)
+	{
+		size += (numWorkers > 0 ? 2 : 1)*MD5ArenaSizeForAllocation(
+				source->subMeshes[i].numVertices*sizeof(MD5Vertex)
+			);
+	}
+
+	if (!MD5ArenaCreate(&arena, size))
+	{
+	    ERR_MSG("Warning: malloc for MD5OpenGL mesh failed. Could not share md5mesh");
+		return 0;
+	}
+
+	/* the sizes were computed above, so the allocations cannot fail */
+	*glmesh = (MD5OpenGLMesh*)MD5ArenaAlloc(&arena, sizeof(MD5OpenGLMesh));
+	memcpy(*glmesh, source, sizeof(MD5OpenGLMesh));
+	(*glmesh)->shared = source;
+	(*glmesh)->refCount = 0;
+	(*glmesh)->arena = arena;
+	(*glmesh)->frameRequestSerial = 0;
+	(*glmesh)->subMeshes = (MD5OpenGLSubMesh*)MD5ArenaAlloc(
+			&(*glmesh)->arena,
+			source->numSubMeshes*sizeof(MD5OpenGLSubMesh)
+		);
+	(*glmesh)->bounds = (MD5OpenGLSubMeshBounds*)MD5ArenaAlloc(
+			&(*glmesh)->arena,
+			source->numSubMeshes*sizeof(MD5OpenGLSubMeshBounds)
+		);
+	memcpy(
+		(*glmesh)->bounds, 
+		source->bounds, 
+		source->numSubMeshes*sizeof(MD5OpenGLSubMeshBounds)
+	);
+
+	for (i = 0; i < source->numSubMeshes; i++)
+	{
+		glsubmesh = &(*glmesh)->subMeshes[i];
+		memcpy(glsubmesh, &source->subMeshes[i], sizeof(MD5OpenGLSubMesh));
+		glsubmesh->verticesHost = (MD5Vertex*)MD5ArenaAlloc(
+				&(*glmesh)->arena,
+				glsubmesh->numVertices*sizeof(MD5Vertex)
+			);
+
+		memcpy(
+			glsubmesh->verticesHost, 
+			source->subMeshes[i].verticesHost, 
+			glsubmesh->numVertices*sizeof(MD5Vertex)
+		);
+
+		if (numWorkers > 0)
+		{
+			glsubmesh->verticesBack = (MD5Vertex*)MD5ArenaAlloc(
+					&(*glmesh)->arena,
+					glsubmesh->numVertices*sizeof(MD5Vertex)
+				);
+		}
+	}
+
+	source->refCount++;
+
+	return 1;
+}
+
+/*
+** Uploads the vertices of mesh's submeshes to the vertex arena and keeps 
+** the bounds their positions are relative to in mesh (see 
+** MD5OpenGLMeshManagerGetDrawCommands). Uses the scratch arena to stage the
+** packed data.
+*/
+static int MD5OpenGLMeshUpload(MD5OpenGLMesh* mesh)
+{
+	MD5OpenGLSubMeshBounds* bounds = NULL;
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	void* packed = NULL;
+	void* staging = NULL;
+	size_t size = MD5PositionFormatGetVertexSize(positionFormat);
+	int maxVertices = 0;
+	int i = 0;
+
+	/* the staging memory for the packed vertices is reused for each 
+	** submesh. Vertices with float positions are uploaded directly.
+	*/
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		if (mesh->subMeshes[i].numVertices > maxVertices)
+		{
+			maxVertices = mesh->subMeshes[i].numVertices;
+		}
+	}
+
+	bounds = mesh->bounds;
+	staging = MD5ArenaAlloc(
+			&scratchArena, 
+			positionFormat == MD5_POSITION_FORMAT_FLOAT ? 0 : maxVertices*size
+		);
+
+	if (!staging)
+	{
+		ERR_MSG("Warning: scratch arena exhausted. Could not upload md5mesh");
+		return 0;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexArena);  
+
+	for (i = 0; i < mesh->numSubMeshes; i++) 
+	{
+		glsubmesh = &mesh->subMeshes[i];
+		
+		switch (positionFormat)
+		{
+			case MD5_POSITION_FORMAT_UNORM16:
+				bounds[i].min = glsubmesh->min;
+				bounds[i].extent.x = glsubmesh->max.x - glsubmesh->min.x;
+				bounds[i].extent.y = glsubmesh->max.y - glsubmesh->min.y;
+				bounds[i].extent.z = glsubmesh->max.z - glsubmesh->min.z;
+				break;
+
+			case MD5_POSITION_FORMAT_HALF:
+				bounds[i].min = glsubmesh->min;
+				bounds[i].extent.x = 1.0f;
+				bounds[i].extent.y = 1.0f;
+				bounds[i].extent.z = 1.0f;
+				break;
+
+			default:
+				FxsVector3MakeZero(&bounds[i].min);
+				bounds[i].extent.x = 1.0f;
+				bounds[i].extent.y = 1.0f;
+				bounds[i].extent.z = 1.0f;
+				break;
+		}
+
+		if (positionFormat == MD5_POSITION_FORMAT_FLOAT)
+		{
+			/* no packing required */
+			packed = glsubmesh->verticesHost;
+		}
+		else
+		{
+			packed = staging;
+
+			MD5PositionFormatPack(
+				packed,
+				positionFormat,
+				glsubmesh->verticesHost,
+				glsubmesh->numVertices,
+				&glsubmesh->min,
+				&glsubmesh->max
+			);
+		}
+
+		glBufferSubData(
+			GL_ARRAY_BUFFER,
+			size*glsubmesh->first,
+		 	size*glsubmesh->numVertices,
+			packed
+		);
+	}
+
+	return 1;
+}
+
+/*
+** Computes the joint transforms of mesh for the frame of an animation in 
+** scratch. If compressed is not NULL, the joint transforms are decoded from
+** it and animation is ignored. If both are NULL, they are the ones of the
+** bind pose. Returns NULL if it fails.
+*/
+static const MD5JointMatrix* MD5OpenGLMeshComputePalette(
+	MD5OpenGLMesh* mesh,
+	const FxsMD5Animation* animation, 
+	MD5CompressedAnimation* compressed,
+	unsigned int frame,
+	MD5Arena* scratch
+)
+{
+	MD5OpenGLMesh* owner = mesh->shared ? mesh->shared : mesh;
+	MD5JointMatrix* palette = NULL;
+
+	if (compressed && compressed->numJoints < mesh->numJoints)
+	{
+		ERR_MSG("Warning: animation has too few joints. Could not update md5mesh");
+		return NULL;
+	}
+
+	palette = (MD5JointMatrix*)MD5ArenaAlloc(
+			scratch, 
+			mesh->numJoints*sizeof(MD5JointMatrix)
+		);
+
+	if (!palette)
+	{
+		return NULL;
+	}
+
+	if (!animation && !compressed)
+	{
+		memcpy(palette, mesh->bindPose, mesh->numJoints*sizeof(MD5JointMatrix));
+		return palette;
+	}
+
+	if (compressed)
+	{
+		/* the decode cache is shared by all meshes posed with the animation
+		** and locked by it 
+		*/
+		return MD5CompressedAnimationCopyFrame(
+				compressed, 
+				frame, 
+				mesh->numJoints, 
+				palette
+			) ? palette : NULL;
+	}
+
+	/* the md5mesh may be shared with other meshes (see 
+	** MD5OpenGLMeshCreateInstance), its pose is copied to the palette of 
+	** this mesh before another thread can pose it. Meshes with their own 
+	** md5mesh are posed in parallel.
+	*/
+	pthread_mutex_lock(&owner->poseMutex);
+
+	if (!FxsMD5MeshUpdatePoseWithAnimationFrame(mesh->md5mesh, animation, frame))
+	{
+		pthread_mutex_unlock(&owner->poseMutex);
+		return NULL;
+	}
+
+	MD5SkinningComputePalette(palette, mesh->md5mesh, mesh->numJoints);
+	pthread_mutex_unlock(&owner->poseMutex);
+
+	return palette;
+}
+
+/*
+** Computes what mesh is skinned with for the frame of an animation in 
+** scratch (see MD5OpenGLMeshComputePalette): the joint transforms in 
+** palette, or with dual quaternion skinning the dual quaternion palette in
+** dqPalette. Compressed animations give the rotations and translations of
+** the joints, so their dual quaternions are built directly. The joints of
+** the other poses are only available as matrices, which are converted. 
+** Returns 0 if it fails.
+*/
+static int MD5OpenGLMeshComputeSkinningPalette(
+	MD5OpenGLMesh* mesh,
+	const FxsMD5Animation* animation, 
+	MD5CompressedAnimation* compressed,
+	unsigned int frame,
+	MD5Arena* scratch,
+	const MD5JointMatrix** palette,
+	const MD5DualQuaternion** dqPalette
+)
+{
+	MD5DualQuaternion* dq = NULL;
+	float* joints = NULL;
+
+	*palette = NULL;
+	*dqPalette = NULL;
+
+	if (mesh->skinningMethod != MD5_SKINNING_DUAL_QUATERNION || !compressed)
+	{
+		*palette = MD5OpenGLMeshComputePalette(
+				mesh, 
+				animation, 
+				compressed, 
+				frame, 
+				scratch
+			);
+
+		if (!*palette)
+		{
+			return 0;
+		}
+
+		if (mesh->skinningMethod != MD5_SKINNING_DUAL_QUATERNION)
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		/* the rotations and translations take the place of the palette */
+		joints = (float*)MD5ArenaAlloc(scratch, mesh->numJoints*7*sizeof(float));
+
+		if (!joints)
+		{
+			return 0;
+		}
+
+		if (!MD5CompressedAnimationDecodeJoints(
+				compressed, 
+				frame, 
+				mesh->numJoints, 
+				joints, 
+				joints + 4*mesh->numJoints
+			))
+		{
+			ERR_MSG("Warning: animation has too few joints or frames. Could not update md5mesh");
+			return 0;
+		}
+	}
+
+	dq = (MD5DualQuaternion*)MD5ArenaAlloc(
+			scratch,
+			mesh->numJoints*sizeof(MD5DualQuaternion)
+		);
+
+	if (!dq)
+	{
+		return 0;
+	}
+
+	if (joints)
+	{
+		MD5SkinningComputeDualQuaternionPaletteWithJoints(
+			dq, 
+			joints, 
+			joints + 4*mesh->numJoints, 
+			mesh->inverseBindPose,
+			mesh->numJoints
+		);
+	}
+	else
+	{
+		MD5SkinningComputeDualQuaternionPalette(
+			dq, 
+			*palette, 
+			mesh->inverseBindPose,
+			mesh->numJoints
+		);
+	}
+
+	*dqPalette = dq;
+
+	return 1;
+}
+
+/*
+** Skins mesh for the joint transforms in palette, or the dual quaternion
+** palette dqPalette (see MD5OpenGLMeshSkin), on the gpu, directly into the
+** vertex arena.
+*/
+static int MD5OpenGLMeshSkinOnGpu(
+	MD5OpenGLMesh* mesh, 
+	const MD5JointMatrix* palette,
+	const MD5DualQuaternion* dqPalette
+)
+{
+	MD5JointMatrix* skinningMatrices = NULL;
+	const void* gpuPalette = NULL;
+
+	if (!mesh->numSubMeshes)
+	{
+		return 1;
+	}
+
+	if (mesh->skinningMethod == MD5_SKINNING_DUAL_QUATERNION)
+	{
+		gpuPalette = dqPalette;
+	}
+	else
+	{
+		skinningMatrices = (MD5JointMatrix*)MD5ArenaAlloc(
+				&scratchArena,
+				mesh->numJoints*sizeof(MD5JointMatrix)
+			);
+
+		if (skinningMatrices)
+		{
+			MD5SkinningComputeSkinningMatrices(
+				skinningMatrices,
+				palette,
+				mesh->inverseBindMatrices,
+				mesh->numJoints
+			);
+		}
+
+		gpuPalette = skinningMatrices;
+	}
+
+	if (!gpuPalette)
+	{
+		ERR_MSG("Warning: scratch arena exhausted. Could not update md5mesh");
+		return 0;
+	}
+
+	/* the submeshes of a mesh are contiguous in the arena */
+	return MD5OpenGLGpuSkinRun(
+			&mesh->gpuSkin,
+			gpuPalette,
+			vertexArena,
+			sizeof(MD5Vertex)*mesh->subMeshes[0].first
+		);
+}
+
+/*
+** updates the md5mesh of mesh according to the passed animation and the frame.
+** updates geometry on host and opengl side according to the updated pose.
+**
+** If compressed is not NULL, the joint transforms are decoded from it and
+** animation is ignored.
+*/ 
+static int MD5OpenGLMeshUpdatePoseWithAnimationFrame(
+	MD5OpenGLMesh* mesh,
+	const FxsMD5Animation* animation, 
+	MD5CompressedAnimation* compressed,
+	unsigned int frame
+)
+{
+	const MD5JointMatrix* palette = NULL;
+	const MD5DualQuaternion* dqPalette = NULL;
+
+	MD5ArenaReset(&scratchArena);
+
+	if (!MD5OpenGLMeshComputeSkinningPalette(
+			mesh, 
+			animation, 
+			compressed, 
+			frame, 
+			&scratchArena,
+			&palette,
+			&dqPalette
+		))
+	{
+		ERR_MSG("Warning: Could not compute the joint transforms of md5mesh");
+		return 0;
+	}
+
+	if (mesh->gpuSkinning)
+	{
+		return MD5OpenGLMeshSkinOnGpu(mesh, palette, dqPalette);
+	}
+
+	/* update the host data of the opengl submeshes geometry (positions ...)
+	*/ 
+	MD5OpenGLMeshSkin(mesh, palette, dqPalette, 0);
+
+	/* update the opengl data for the sub meshes */
+	if (!MD5OpenGLMeshUpload(mesh))
+	{
+		return 0;
+	}
+	
+	if (GL_NO_ERROR != glGetError()) 
+	{
+		sprintf(errMsg, "Warning: opengl failed. Could not update md5mesh");
+		ERR_MSG(errMsg);	
+		return 0;		    
+	}	
+	
+	return 1;
+}
+
+/*
+** Creates the gl data for skinning mesh on the gpu from the bind pose of its
+** submeshes. Returns 0 if it fails.
+*/
+static int MD5OpenGLMeshCreateGpuSkin(MD5OpenGLMesh* mesh)
+{
+	MD5SkinningInput* inputs = NULL;
+	MD5OpenGLSubMesh* glsubmesh = NULL;
+	int numVertices = 0;
+	int count = 0;
+	int i = 0, j = 0;
+
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		numVertices += mesh->subMeshes[i].numVertices;
+	}
+
+	inputs = (MD5SkinningInput*)malloc((numVertices + 1)*sizeof(MD5SkinningInput));
+
+	if (!inputs)
+	{
+		return 0;
+	}
+
+	/* one input for each vertex in the arena, in the same order */
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		glsubmesh = &mesh->subMeshes[i];
+
+		for (j = 0; j < glsubmesh->numVertices; j++)
+		{
+			MD5SkinningInputMake(
+				&inputs[count++],
+				&mesh->md5mesh->meshes[i],
+				glsubmesh->vertexMap[j],
+				glsubmesh->bindPositions,
+				glsubmesh->bindNormals,
+				glsubmesh->bindTangents,
+				glsubmesh->handedness
+			);
+		}
+	}
+
+	i = MD5OpenGLGpuSkinCreate(
+			&mesh->gpuSkin,
+			inputs,
+			numVertices,
+			mesh->numJoints,
+			mesh->skinningMethod
+		);
+	free(inputs);
+
+	return i;
+}
+
+/*
+** Destroys a MD5OpenGLMesh
+*/ 
+static void MD5OpenGLMeshDestroy(MD5OpenGLMesh** glmesh)
+{
+	MD5Arena arena;
+
+	if (!(*glmesh)) 
+	{
+	    return;
+	}
+
+	if ((*glmesh)->shared)
+	{
+		/* the immutable data is released with the mesh owning it */
+		(*glmesh)->shared->refCount--;
+	}
+	else if ((*glmesh)->refCount > 1)
+	{
+		/* keep the data alive rather than leave the other meshes dangling */
+		ERR_MSG("Warning: Could not destroy a md5mesh that is still shared");
+		*glmesh = NULL;
+		return;
+	}
+	else
+	{
+		/* delete the md5 mesh */
+		if ((*glmesh)->md5mesh)
+		{
+			FxsMD5MeshDestroy(&(*glmesh)->md5mesh);
+		}
+
+		if ((*glmesh)->gpuSkin.inputs)
+		{
+			MD5OpenGLGpuSkinDestroy(&(*glmesh)->gpuSkin);
+		}
+
+		pthread_mutex_destroy(&(*glmesh)->poseMutex);
+	}
+
+	/* delete the gl mesh, its submeshes and their data. The arena lives 
+	** inside its own block, so we need to copy it first.
+	*/
+	arena = (*glmesh)->arena;
+	MD5ArenaDestroy(&arena);
+	
+	*glmesh = NULL;
+}
+
+#define MAX_MESHES 32  /* max amount of meshes stored by the manager 
+					   ** ids in the config file are allowed to be within
+					   ** 0 .. MAX_MESHES - 1.	
+					   */
+#define MAX_ANIMATIONS 32 /* max amount of animations stored by the manager
+					      ** ids in the config file are allowed to be within
+					      ** 0 .. MAX_ANIMATIONS - 1.
+					      */
+
+MD5OpenGLMesh* meshes[MAX_MESHES];
+FxsMD5Animation* animations[MAX_ANIMATIONS];
+MD5CompressedAnimation* compressedAnimations[MAX_ANIMATIONS];
+
+/*
+** Animation shared by all ids whose files have the same content and that 
+** are loaded with the same options. The ids alias its data in animations
+** and compressedAnimations.
+*/
+typedef struct
+{
+	MD5AssetHash hash; 				/* content hash of the md5anim file */
+	int compress;
+	float translationTolerance;
+	float rotationTolerance;
+	FxsMD5Animation* animation;
+	MD5CompressedAnimation* compressedAnimation;
+	int refCount; 					/* # of ids aliasing the animation */
+}
+MD5OpenGLSharedAnimation;
+
+static MD5OpenGLSharedAnimation sharedAnimations[MAX_ANIMATIONS];
+static int numSharedAnimations = 0;
+static int sharedAnimationIds[MAX_ANIMATIONS]; 	/* index of the shared 
+												** animation of each id */
+
+/* ids of the meshes the workers skin (see 
+** MD5OpenGLMeshManagerSubmitRequestedPoses) 
+*/
+static int meshesInFlight[MAX_MESHES];
+static int numMeshesInFlight = 0;
+
+#define DEFAULT_TRANSLATION_TOLERANCE 0.001f 	/* default tolerances for */
+#define DEFAULT_ROTATION_TOLERANCE 0.001f 		/* compressed animations */
+
+/*
+** Compresses the animation with id using the skeleton of the first mesh that 
+** can be posed with it. On success the uncompressed animation is released.
+*/
+static int MD5OpenGLMeshManagerCompressAnimation(
+	int id, 
+	float translationTolerance,
+	float rotationTolerance
+)
+{
+	int i = 0;
+
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (!meshes[i])
+		{
+			continue;
+		}
+
+		if (MD5CompressedAnimationCreateWithAnimation(
+				&compressedAnimations[id],
+				meshes[i]->md5mesh,
+				animations[id],
+				translationTolerance,
+				rotationTolerance
+			))
+		{
+			FxsMD5AnimationDestroy(&animations[id]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* files of the meshes owning their data and of the shared animations, 
+** only valid while the config is parsed. A matching hash is confirmed by
+** comparing the files.
+*/
+static const char* meshFilenames[MAX_MESHES];
+static const char* animationFilenames[MAX_ANIMATIONS];
+
+/*
+** Finds a mesh owning its data loaded from a file with the same content 
+** (filename with hash) and with the same options. Returns NULL if there is
+** none.
+*/
+static MD5OpenGLMesh* MD5OpenGLMeshManagerFindSharedMesh(
+	MD5AssetHash hash,
+	const char* filename,
+	MD5SkinningMethod skinningMethod,
+	int gpuSkinning
+)
+{
+	int i = 0;
+
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (meshes[i] && !meshes[i]->shared && meshes[i]->hash == hash &&
+			meshes[i]->skinningMethod == skinningMethod &&
+			meshes[i]->gpuSkinning == gpuSkinning &&
+			MD5AssetFilesEqual(meshFilenames[i], filename))
+		{
+			return meshes[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+** Finds the shared animation loaded from a file with the same content 
+** (filename with hash) and with the same options. Returns its index or -1 if
+** there is none.
+*/
+static int MD5OpenGLMeshManagerFindSharedAnimation(
+	MD5AssetHash hash,
+	const char* filename,
+	int compress,
+	float translationTolerance,
+	float rotationTolerance
+)
+{
+	const MD5OpenGLSharedAnimation* shared = NULL;
+	int i = 0;
+
+	for (i = 0; i < numSharedAnimations; i++)
+	{
+		shared = &sharedAnimations[i];
+
+		if (shared->hash != hash || shared->compress != compress)
+		{
+			continue;
+		}
+
+		if ((!compress || 
+			(shared->translationTolerance == translationTolerance &&
+			shared->rotationTolerance == rotationTolerance)) &&
+			MD5AssetFilesEqual(animationFilenames[i], filename))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+** Drops a reference to a shared animation and destroys it with the last 
+** one.
+*/
+static void MD5OpenGLMeshManagerReleaseAnimation(MD5OpenGLSharedAnimation* shared)
+{
+	if (--shared->refCount > 0)
+	{
+		return;
+	}
+
+	if (shared->animation)
+	{
+		FxsMD5AnimationDestroy(&shared->animation);
+	}
+
+	if (shared->compressedAnimation)
+	{
+		MD5CompressedAnimationDestroy(&shared->compressedAnimation);
+	}
+
+	memset(shared, 0, sizeof(MD5OpenGLSharedAnimation));
+}
+
+/*
+** Gets the # of frames of the animation with id. The animation has to exist.
+*/
+static int MD5OpenGLMeshManagerGetNumFrames(int id)
+{
+	if (compressedAnimations[id])
+	{
+		return compressedAnimations[id]->numFrames;
+	}
+
+	return animations[id]->numFrames;
+}
+
+static int wasInitialized = 0;
+
+/* # of scheduled updates, requests with the same serial belong to the same
+** frame 
+*/
+static int requestSerial = 1;
+
+/*
+** Sets the attributes of the vertices in the vertex arena and the element 
+** arena on the bound VAO (see 
+** MD5OpenGLMeshManagerCreateInstancedVertexArray).
+*/
+static void MD5OpenGLMeshManagerSetVertexAttributes()
+{
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementArena);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexArena);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+
+	switch (positionFormat)
+	{
+		case MD5_POSITION_FORMAT_UNORM16:
+		case MD5_POSITION_FORMAT_HALF:
+			glVertexAttribPointer(
+				0, 3, 
+				positionFormat == MD5_POSITION_FORMAT_HALF ? 
+					GL_HALF_FLOAT : GL_UNSIGNED_SHORT, 
+				positionFormat == MD5_POSITION_FORMAT_HALF ? GL_FALSE : GL_TRUE, 
+				sizeof(MD5PackedVertex),
+				(const void*)offsetof(MD5PackedVertex, position)
+			);
+			
+			glVertexAttribPointer(
+				3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 
+				sizeof(MD5PackedVertex),
+				(const void*)offsetof(MD5PackedVertex, normal)
+			);
+			
+			/* octahedral, the handedness is in the normal */
+			glVertexAttribPointer(
+				4, 2, GL_BYTE, GL_TRUE, 
+				sizeof(MD5PackedVertex),
+				(const void*)offsetof(MD5PackedVertex, tangent)
+			);
+			break;
+
+		default:
+			glVertexAttribPointer(
+				0, 3, GL_FLOAT, GL_FALSE, 
+				sizeof(MD5Vertex),
+				(const void*)offsetof(MD5Vertex, position)
+			);
+			
+			glVertexAttribPointer(
+				3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 
+				sizeof(MD5Vertex),
+				(const void*)offsetof(MD5Vertex, normal)
+			);
+			
+			glVertexAttribPointer(
+				4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 
+				sizeof(MD5Vertex),
+				(const void*)offsetof(MD5Vertex, tangent)
+			);
+			break;
+	}
+}
+
+/*
+** Packs the vertices and indices of all loaded meshes into the shared vertex
+** and element arena.
+*/
+static int MD5OpenGLMeshManagerCreateArena()
+{
+	GLint numVertices = 0;
+	GLuint numIndices = 0;
+	size_t scratchSize = 0;
+	int i = 0, j = 0, k = 0;
+
+	/* assign each submesh its range in the arena */
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (!meshes[i])
+		{
+			continue;
+		}
+
+		for (j = 0; j < meshes[i]->numSubMeshes; j++)
+		{
+			meshes[i]->subMeshes[j].first = numVertices;
+			numVertices += meshes[i]->subMeshes[j].numVertices;
+
+			/* meshes sharing their data share the indices */
+			if (!meshes[i]->shared)
+			{
+				meshes[i]->subMeshes[j].firstIndex = numIndices;
+				numIndices += meshes[i]->subMeshes[j].numIndices;
+			}
+		}
+
+		if (meshes[i]->scratchSize > scratchSize)
+		{
+			scratchSize = meshes[i]->scratchSize;
+		}
+	}
+
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		for (j = 0; meshes[i] && meshes[i]->shared && 
+			j < meshes[i]->numSubMeshes; j++)
+		{
+			meshes[i]->subMeshes[j].firstIndex = 
+				meshes[i]->shared->subMeshes[j].firstIndex;
+		}
+	}
+
+	if (!MD5ArenaCreate(&scratchArena, scratchSize))
+	{
+		ERR_MSG("Warning: malloc failed. Could not create the scratch arena");
+		return 0;
+	}
+
+	if (numWorkers > 0)
+	{
+		workerScratchArenas = (MD5Arena*)calloc(numWorkers, sizeof(MD5Arena));
+
+		if (!workerScratchArenas)
+		{
+			ERR_MSG("Warning: malloc failed. Could not create the scratch arena");
+			return 0;
+		}
+
+		for (i = 0; i < numWorkers; i++)
+		{
+			if (!MD5ArenaCreate(&workerScratchArenas[i], scratchSize))
+			{
+				ERR_MSG("Warning: malloc failed. Could not create the scratch arena");
+				return 0;
+			}
+		}
+	}
+
+	/* initialize the arenas */
+	glGenBuffers(1, &vertexArena);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexArena);
+	
+	glBufferData(
+		GL_ARRAY_BUFFER,
+		MD5PositionFormatGetVertexSize(positionFormat)*(numVertices + 1),
+		NULL,
+		GL_DYNAMIC_DRAW
+	);
+
+	glGenBuffers(1, &elementArena);
+	glBindBuffer(GL_ARRAY_BUFFER, elementArena);
+	
+	glBufferData(
+		GL_ARRAY_BUFFER,
+		sizeof(unsigned int)*(numIndices + 1),
+		NULL,
+		GL_STATIC_DRAW
+	);
+
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (!meshes[i])
+		{
+			continue;
+		}
+
+		MD5ArenaReset(&scratchArena);
+
+		if (!MD5OpenGLMeshUpload(meshes[i]))
+		{
+			return 0;
+		}
+
+		/* the indices are relative to the first vertex of the submesh */
+		glBindBuffer(GL_ARRAY_BUFFER, elementArena);
+
+		for (j = 0; j < meshes[i]->numSubMeshes; j++)
+		{
+			if (!meshes[i]->shared)
+			{
+				glBufferSubData(
+					GL_ARRAY_BUFFER,
+					sizeof(unsigned int)*meshes[i]->subMeshes[j].firstIndex,
+					sizeof(unsigned int)*meshes[i]->subMeshes[j].numIndices,
+					meshes[i]->subMeshes[j].indices
+				);
+			}
+		}
+	}
+
+	if (GL_NO_ERROR != glGetError()) 
+	{
+		ERR_MSG("Warning: opengl failed. Could not create the vertex arena");
+		return 0;		    
+	}
+
+	/* meshes skinned on the gpu fall back to the host if the skinning stage
+	** is not available
+	*/
+	for (i = 0, k = 0; i < MAX_MESHES; i++)
+	{
+		k = k || (meshes[i] && meshes[i]->gpuSkinning);
+	}
+
+	if (k && !MD5OpenGLGpuSkinningCreate())
+	{
+		ERR_MSG("Warning: Could not create the gpu skinning stage. Skinning on the host");
+		k = 0;
+	}
+
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (!meshes[i] || !meshes[i]->gpuSkinning || meshes[i]->shared)
+		{
+			continue;
+		}
+
+		if (!k || !MD5OpenGLMeshCreateGpuSkin(meshes[i]))
+		{
+			sprintf(errMsg, "Warning: Could not skin mesh with id %d on the gpu. Skinning on the host", i);
+			ERR_MSG(errMsg);
+			meshes[i]->gpuSkinning = 0;
+		}
+	}
+
+	/* the inputs do not depend on the pose, the palette is uploaded right
+	** before each run, so meshes sharing their data share the gpu skin
+	*/
+	for (i = 0; i < MAX_MESHES; i++)
+	{
+		if (meshes[i] && meshes[i]->gpuSkinning && meshes[i]->shared)
+		{
+			meshes[i]->gpuSkin = meshes[i]->shared->gpuSkin;
+			meshes[i]->gpuSkinning = meshes[i]->shared->gpuSkinning;
+		}
+	}
+
+	return 1;
+}
+
+int MD5OpenGLMeshManagerCreate(const char* filename)
+{
+	JSON_Value* root = NULL;
+	JSON_Array* array = NULL;
     JSON_Object* rootObj = NULL;
 	JSON_Object* object = NULL;
 	size_t arraySize = 0;
 	int i = 0; 
 	const char* md5filename = NULL;
+	const char* skinning = NULL;
+	MD5SkinningMethod skinningMethod = MD5_SKINNING_LINEAR;
+	int gpuSkinning = 0;
+	int compress = 0;
+	float translationTolerance = 0.0f;
+	float rotationTolerance = 0.0f;
+	MD5AssetHash hash = 0;
 	int id = 0;
+	int j = 0;
+    MD5OpenGLMesh* mesh = NULL;
+	FxsMD5Animation* animation = NULL;
+
+    if (wasInitialized)
+    {
+        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate was already initialized")
+        return 0;
+    }
+    
+    memset(meshFilenames, 0, sizeof(meshFilenames));
+    memset(animationFilenames, 0, sizeof(animationFilenames));
+	root = json_parse_file(filename);
+		
+	if (!root) 
+	{
+	    sprintf(errMsg, "Failed to parse file: %s", filename);
+		ERR_MSG(errMsg)
+		return 0;
+	}
+    
+    rootObj = json_value_get_object(root);
+    
+	if (!rootObj)
+	{
+	    sprintf(errMsg, "Failed to parse file: %s", filename);
+		ERR_MSG(errMsg)
+		return 0;
+	}
+	
+	/* the format of the positions is optional and defaults to float */
+	md5filename = json_object_get_string(rootObj, "positionFormat");
+
+	if (md5filename && !MD5PositionFormatMakeWithName(&positionFormat, md5filename))
+	{
+		sprintf(errMsg, "Warning: Unknown position format: %s. Using float", md5filename);
+		ERR_MSG(errMsg);
+		positionFormat = MD5_POSITION_FORMAT_FLOAT;
+	}
+
+	/* worker threads are optional, without them meshes are skinned by the
+	** calling thread 
+	*/
+	numWorkers = (int)json_object_get_number(rootObj, "workerThreads");
+
+	if (numWorkers > 0 && !MD5WorkerPoolCreate(&workerPool, numWorkers))
+	{
+		ERR_MSG("Warning: Could not create the worker threads. Skinning without workers");
+		numWorkers = 0;
+	}
+
+	numWorkers = numWorkers > 0 ? numWorkers : 0;
+
+	/* the program cache is optional, without it programs are compiled on
+	** each start 
+	*/
+	if (!MD5OpenGLProgramCacheCreate(json_object_get_string(rootObj, "programCache")))
+	{
+		ERR_MSG("Warning: Could not create the program cache. Compiling programs");
+	}
+
+	/* load meshes */
+	array = json_object_get_array(rootObj, "meshes");
+
+	if (!array) 
+	{
+	    sprintf(errMsg, "Failed to parse file: %s", filename);
+		ERR_MSG(errMsg)
+ 		json_value_free(root);
+		return 0;
+	}
+
+    arraySize = json_array_get_count(array);
+
+	for (i = 0; i < arraySize; i++) 
+	{
+	   	object = json_array_get_object(array, i);
+	    id = json_object_get_number(object, "id");	
+		md5filename = json_object_get_string(object, "filename");
+	
+		if (id < 0 || id >= MAX_MESHES)
+        {
+            sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. Skipping mesh for file %s", id, MAX_MESHES - 1, md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+        
+        if (meshes[id] != NULL)
+        {
+            sprintf(errMsg, "Warning: Mesh for id %d was already initialized. Skipping mesh for file %s", id, md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+        
+        /* the skinning method is optional and defaults to linear */
+        skinning = json_object_get_string(object, "skinning");
+        skinningMethod = MD5_SKINNING_LINEAR;
+
+        if (skinning && !strcmp(skinning, "dualQuaternion"))
+        {
+            skinningMethod = MD5_SKINNING_DUAL_QUATERNION;
+        }
+        else if (skinning && strcmp(skinning, "linear"))
+        {
+            sprintf(errMsg, "Warning: Unknown skinning method: %s. Using linear skinning for file %s", skinning, md5filename);
+            ERR_MSG(errMsg);
+        }
+
+        /* skinning on the gpu is optional and needs float positions */
+        gpuSkinning = json_object_get_boolean(object, "gpuSkinning") == 1;
+
+        if (gpuSkinning && positionFormat != MD5_POSITION_FORMAT_FLOAT)
+        {
+            sprintf(errMsg, "Warning: Skinning on the gpu needs float positions. Skinning on the host for file %s", md5filename);
+            ERR_MSG(errMsg);
+            gpuSkinning = 0;
+        }
+
+        if (!MD5AssetHashFile(&hash, md5filename))
+        {
+            sprintf(errMsg, "Warning: Failed to read mesh for: %s", md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+
+        /* ids with the same file content and options share the data */
+        mesh = MD5OpenGLMeshManagerFindSharedMesh(
+                hash, 
+                md5filename, 
+                skinningMethod, 
+                gpuSkinning
+            );
+
+        if (mesh && MD5OpenGLMeshCreateInstance(&meshes[id], mesh))
+        {
+            continue;
+        }
+
+        if (!MD5OpenGLMeshCreateWithFile(&mesh, md5filename, skinningMethod, gpuSkinning))
+        {
+            sprintf(errMsg, "Warning: Failed to load mesh for: %s", md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+        
+        mesh->hash = hash;
+        meshes[id] = mesh;
+        meshFilenames[id] = md5filename;
+	}
+	
+	if (!MD5OpenGLMeshManagerCreateArena())
+	{
+ 		json_value_free(root);
+		return 0;
+	}
+
+	/* load animations */		
+	array = json_object_get_array(rootObj, "animations");
+
+	if (!array) 
+	{
+	    sprintf(errMsg, "Failed to parse file: %s", filename);
+		ERR_MSG(errMsg)
+ 		json_value_free(root);
+		return 0;
+	}
+
+    arraySize = json_array_get_count(array);
+
+	for (i = 0; i < arraySize; i++) 
+	{
+		object = json_array_get_object(array, i);
+	    id = json_object_get_number(object, "id");	
+		md5filename = json_object_get_string(object, "filename");
+
+		if (id < 0 || id >= MAX_ANIMATIONS)
+        {
+            sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. Skipping animation for file %s", id, MAX_ANIMATIONS - 1, md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+        
+        if (animations[id] != NULL || compressedAnimations[id] != NULL)
+        {
+            sprintf(errMsg, "Warning: Animation for id %d was already initialized. Skipping animation for file %s", id, md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+        
+		/* compression is optional */
+		compress = json_object_get_boolean(object, "compress") == 1;
+		translationTolerance = 
+			json_object_get_value(object, "translationTolerance") ?
+				json_object_get_number(object, "translationTolerance") :
+				DEFAULT_TRANSLATION_TOLERANCE;
+		rotationTolerance = 
+			json_object_get_value(object, "rotationTolerance") ?
+				json_object_get_number(object, "rotationTolerance") :
+				DEFAULT_ROTATION_TOLERANCE;
+
+        if (!MD5AssetHashFile(&hash, md5filename))
+        {
+            sprintf(errMsg, "Warning: Failed to read animation for: %s", md5filename);
+            ERR_MSG(errMsg);
+            continue;
+        }
+
+        /* ids with the same file content and options alias one animation */
+        j = MD5OpenGLMeshManagerFindSharedAnimation(
+                hash, 
+                md5filename,
+                compress, 
+                translationTolerance, 
+                rotationTolerance
+            );
+
+        if (j < 0)
+        {
+            if (!FxsMD5AnimationCreateWithFile(&animation, md5filename)) 
+            {
+                sprintf(errMsg, "Warning: Failed to load animation for: %s", md5filename);
+                ERR_MSG(errMsg);
+                continue;
+            }
+
+            animations[id] = animation;
+
+            if (compress && !MD5OpenGLMeshManagerCompressAnimation(
+                    id,
+                    translationTolerance,
+                    rotationTolerance
+                ))
+            {
+                sprintf(errMsg, "Warning: Failed to compress animation for: %s. Keeping it uncompressed", md5filename);
+                ERR_MSG(errMsg);
+            }
+
+            j = numSharedAnimations++;
+            sharedAnimations[j].hash = hash;
+            sharedAnimations[j].compress = compress;
+            sharedAnimations[j].translationTolerance = translationTolerance;
+            sharedAnimations[j].rotationTolerance = rotationTolerance;
+            sharedAnimations[j].animation = animations[id];
+            sharedAnimations[j].compressedAnimation = compressedAnimations[id];
+            sharedAnimations[j].refCount = 0;
+            animationFilenames[j] = md5filename;
+        }
+
+        animations[id] = sharedAnimations[j].animation;
+        compressedAnimations[id] = sharedAnimations[j].compressedAnimation;
+        sharedAnimations[j].refCount++;
+        sharedAnimationIds[id] = j;
+	}
+
+	/* clean up, the filenames are owned by the config */
+ 	json_value_free(root);
+    memset(meshFilenames, 0, sizeof(meshFilenames));
+    memset(animationFilenames, 0, sizeof(animationFilenames));
+    
+    wasInitialized = 1;
+    
+    return 1;
+}
+
+const MD5OpenGLMesh* MD5OpenGLMeshManagerGetMeshWithId(int id)
+{
+    if (!wasInitialized)
+    {
+        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
+        return 0;
+    }
+
+    if (id < 0 || id >= MAX_MESHES)
+    {
+        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d.", id, MAX_MESHES - 1);
+        ERR_MSG(errMsg);
+        return NULL;
+    }
+    
+    if (!meshes[id])
+    {
+        sprintf(errMsg, "Warning: Mesh with id: %d not found.", id);
+        ERR_MSG(errMsg);
+        return NULL;
+    }
+    
+    return (const MD5OpenGLMesh*)meshes[id];
+}
+
+void MD5OpenGLMeshManagerDestroy()
+{
+    int i = 0;
+
+    if (!wasInitialized)
+    {
+        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
+    }
+
+    /* the workers may still skin meshes */
+    if (numWorkers > 0)
+    {
+        MD5WorkerPoolDestroy(&workerPool);
+
+        for (i = 0; workerScratchArenas && i < numWorkers; i++)
+        {
+            MD5ArenaDestroy(&workerScratchArenas[i]);
+        }
+
+        free(workerScratchArenas);
+        workerScratchArenas = NULL;
+        numWorkers = 0;
+    }
+
+    numMeshesInFlight = 0;
+    
+    /* meshes sharing the data of another mesh are destroyed first */
+    for (i = 0; i < MAX_MESHES; i++)
+    {
+        if (meshes[i] && meshes[i]->shared)
+        {
+            MD5OpenGLMeshDestroy(&meshes[i]);
+        }
+    }
+
+    for (i = 0; i < MAX_MESHES; i++)
+    {
+        if (meshes[i])
+        {
+            MD5OpenGLMeshDestroy(&meshes[i]);
+        }
+    }
+
+    /* the ids alias the shared animations, that are destroyed with the 
+    ** last id
+    */
+    for (i = 0; i < MAX_ANIMATIONS; i++)
+    {
+        if (!animations[i] && !compressedAnimations[i])
+        {
+            continue;
+        }
+
+        animations[i] = NULL;
+        compressedAnimations[i] = NULL;
+        MD5OpenGLMeshManagerReleaseAnimation(&sharedAnimations[sharedAnimationIds[i]]);
+    }
+
+    numSharedAnimations = 0;
+
+	MD5ArenaDestroy(&scratchArena);
+	MD5OpenGLGpuSkinningDestroy();
+	MD5OpenGLProgramCacheDestroy();
+	glDeleteBuffers(1, &vertexArena);
+	glDeleteBuffers(1, &elementArena);
+	vertexArena = 0;
+	elementArena = 0;
+}
+
+int MD5OpenGLMeshManagerGetMeshMemoryUsage(
+	int id,
+	MD5OpenGLMeshMemoryUsage* usage
+)
+{
+	const MD5OpenGLMesh* mesh = MD5OpenGLMeshManagerGetMeshWithId(id);
+	int i = 0;
+
+	if (!mesh)
+	{
+		return 0;
+	}
+
+	memset(usage, 0, sizeof(MD5OpenGLMeshMemoryUsage));
+	usage->hostBytes = mesh->arena.size;
+	usage->scratchBytes = mesh->scratchSize;
+
+	if (mesh->shared)
+	{
+		usage->sharedBytes = mesh->shared->arena.size;
+	}
+
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		usage->deviceBytes += mesh->subMeshes[i].numVertices*
+			MD5PositionFormatGetVertexSize(positionFormat);
+
+		if (mesh->shared)
+		{
+			usage->sharedBytes += mesh->subMeshes[i].numIndices*sizeof(unsigned int);
+		}
+		else
+		{
+			usage->deviceBytes += mesh->subMeshes[i].numIndices*sizeof(unsigned int);
+		}
+	}
+
+	return 1;
+}
+
+int MD5OpenGLMeshManagerGetMeshAcmr(
+	int id,
+	float* acmrBefore,
+	float* acmrAfter
+)
+{
+	const MD5OpenGLMesh* mesh = MD5OpenGLMeshManagerGetMeshWithId(id);
+	float numFaces = 0.0f, n = 0.0f;
+	int i = 0;
+
+	if (!mesh)
+	{
+		return 0;
+	}
+
+	*acmrBefore = 0.0f;
+	*acmrAfter = 0.0f;
+
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		n = (float)(mesh->subMeshes[i].numIndices/3);
+		*acmrBefore += n*mesh->subMeshes[i].acmrBefore;
+		*acmrAfter += n*mesh->subMeshes[i].acmrAfter;
+		numFaces += n;
+	}
+
+	if (numFaces == 0.0f)
+	{
+		return 0;
+	}
+
+	*acmrBefore /= numFaces;
+	*acmrAfter /= numFaces;
+
+	return 1;
+}
+
+int MD5OpenGLMeshManagerGetAnimationStats(
+	int id,
+	MD5CompressedAnimationStats* stats
+)
+{
+    if (id < 0 || id >= MAX_ANIMATIONS || !compressedAnimations[id])
+    {
+        return 0;
+    }
+
+	*stats = compressedAnimations[id]->stats;
+
+	return 1;
+}
+
+int MD5OpenGLMeshManagerGetAnimationInfo(
+	int id,
+	int* numFrames,
+	MD5AssetHash* hash
+)
+{
+    if (id < 0 || id >= MAX_ANIMATIONS || 
+        (!animations[id] && !compressedAnimations[id]))
+    {
+        return 0;
+    }
+
+	*numFrames = MD5OpenGLMeshManagerGetNumFrames(id);
+	*hash = sharedAnimations[sharedAnimationIds[id]].hash;
+
+	return 1;
+}
+
+size_t MD5OpenGLMeshManagerGetScratchMemoryUsage()
+{
+	return scratchArena.size;
+}
+
+MD5PositionFormat MD5OpenGLMeshManagerGetPositionFormat()
+{
+	return positionFormat;
+}
+
+GLuint MD5OpenGLMeshManagerCreateInstancedVertexArray(GLuint instanceBuffer)
+{
+	GLuint array = 0;
+
+	if (!wasInitialized)
+	{
+		ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
+		return 0;
+	}
+
+	glGenVertexArrays(1, &array);
+	glBindVertexArray(array);
+	MD5OpenGLMeshManagerSetVertexAttributes();
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(5);
+
+	glVertexAttribPointer(
+		1, 3, GL_FLOAT, GL_FALSE, 
+		sizeof(MD5OpenGLInstance), 
+		(const void*)offsetof(MD5OpenGLInstance, bounds.min)
+	);
+
+	glVertexAttribPointer(
+		2, 3, GL_FLOAT, GL_FALSE, 
+		sizeof(MD5OpenGLInstance), 
+		(const void*)offsetof(MD5OpenGLInstance, bounds.extent)
+	);
+
+	glVertexAttribIPointer(
+		5, 1, GL_UNSIGNED_INT, 
+		sizeof(MD5OpenGLInstance), 
+		(const void*)offsetof(MD5OpenGLInstance, model)
+	);
+
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribDivisor(5, 1);
+	glBindVertexArray(0);
+
+	if (GL_NO_ERROR != glGetError()) 
+	{
+		ERR_MSG("Warning: opengl failed. Could not create the vertex array");
+		glDeleteVertexArrays(1, &array);
+		return 0;		    
+	}
+
+	return array;
+}
+
+int MD5OpenGLMeshManagerGetDrawCommands(
+	int meshId,
+	GLuint model,
+	GLuint baseInstance,
+	MD5OpenGLDrawElementsIndirectCommand* commands,
+	MD5OpenGLInstance* instances
+)
+{
+	MD5OpenGLMesh* mesh = NULL;
+	int i = 0;
+
+	if (!wasInitialized || meshId < 0 || meshId >= MAX_MESHES || !meshes[meshId])
+	{
+		return 0;
+	}
+
+	mesh = meshes[meshId];
+
+	for (i = 0; i < mesh->numSubMeshes; i++)
+	{
+		commands[i].count = mesh->subMeshes[i].numIndices;
+		commands[i].instanceCount = 1;
+		commands[i].firstIndex = mesh->subMeshes[i].firstIndex;
+		commands[i].baseVertex = mesh->subMeshes[i].first;
+		commands[i].baseInstance = baseInstance + i;
+		instances[i].bounds = mesh->bounds[i];
+		instances[i].model = model;
+	}
+
+	return mesh->numSubMeshes;
+}
+
+/*
+** Checks the ids of a pose and keeps its frame between 0 .. # of frames of
+** the animation. Returns -1 if the pose is invalid.
+*/
+static int MD5OpenGLMeshManagerGetPoseFrame(
+    int meshId,
+    int animationId,
+    int frame
+)
+{
+    if (!wasInitialized)
+    {
+        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
+        return -1;
+    }
+    
+    if (meshId < 0 || meshId >= MAX_MESHES)
+    {
+        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d.", meshId, MAX_MESHES - 1);
+        ERR_MSG(errMsg);
+        return -1;
+    }
+    
+    if (meshes[meshId] == NULL)
+    {
+        sprintf(errMsg, "Warning: Mesh with id %d not found", meshId);
+        ERR_MSG(errMsg);
+        return -1;
+    }
+    
+    if (animationId < 0 || animationId >= MAX_ANIMATIONS)
+    {
+        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. ", animationId, MAX_ANIMATIONS - 1);
+        return -1;
+    }
+        
+    if (animations[animationId] == NULL && compressedAnimations[animationId] == NULL)
+    {
+        sprintf(errMsg, "Warning: Animation with id %d not found", animationId);
+        ERR_MSG(errMsg);
+        return -1;
+    }
+    
+    if (frame < 0)
+    {
+        ERR_MSG("Frame index cannot be negative");
+        return -1;
+    }
+    
+    /* keep the frame between 0 .. animations[animationId]->numFrames */
+    return frame % MD5OpenGLMeshManagerGetNumFrames(animationId);
+}
+
+/*
+** Gets the time of a monotonic clock in microseconds. The budget is wall 
+** time, the cpu time of the process includes the workers.
+*/
+static double MD5OpenGLMeshManagerGetMicroseconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return 1e6*now.tv_sec + 1e-3*now.tv_nsec;
+}
+
+/*
+** Poses the mesh with meshId with frame f of an animation and updates the
+** estimated cost of its pose updates. The ids have to be valid.
+*/
+static int MD5OpenGLMeshManagerPoseMesh(int meshId, int animationId, int f)
+{
+    MD5OpenGLMesh* mesh = meshes[meshId];
+    double start = 0.0;
+    float microseconds = 0.0f;
+
+    /* the vertex arena already holds the pose */
+    if (mesh->poseAnimationId == animationId && mesh->poseFrame == f)
+    {
+        return 1;
+    }
+
+    /* invalidate the pose first, a failed update may leave the arena 
+    ** partially written 
+    */
+    mesh->poseAnimationId = -1;
+    mesh->poseFrame = -1;
+    start = MD5OpenGLMeshManagerGetMicroseconds();
+
+    if (!MD5OpenGLMeshUpdatePoseWithAnimationFrame(
+            mesh, 
+            animations[animationId], 
+            compressedAnimations[animationId], 
+            f
+        ))
+    {
+        ERR_MSG("Failed to update the opengl mesh");
+        return 0;
+    }
+
+    mesh->poseAnimationId = animationId;
+    mesh->poseFrame = f;
+
+    /* exponential moving average of the measured cost */
+    microseconds = (float)(MD5OpenGLMeshManagerGetMicroseconds() - start);
+    mesh->updateMicroseconds = mesh->updateMicroseconds > 0.0f ? 
+        0.75f*mesh->updateMicroseconds + 0.25f*microseconds : microseconds;
+
+    return 1;
+}
+
+const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+    int meshId,
+    int animationId,
+    int frame
+)
+{
+    int f = MD5OpenGLMeshManagerGetPoseFrame(meshId, animationId, frame);
+
+    if (f < 0)
+    {
+        return 0;
+    }
+
+    MD5OpenGLMeshManagerFinishWorkers();
+
+    return MD5OpenGLMeshManagerPoseMesh(meshId, animationId, f);
+}
+
+int MD5OpenGLMeshManagerResetMeshPose(int meshId)
+{
+    MD5OpenGLMesh* mesh = NULL;
+
+    if (!MD5OpenGLMeshManagerGetMeshWithId(meshId))
+    {
+        return 0;
+    }
+
+    mesh = meshes[meshId];
+
+    MD5OpenGLMeshManagerFinishWorkers();
+
+    /* a failed update leaves the pose invalid too, so the bind pose is 
+    ** always skinned 
+    */
+    mesh->poseAnimationId = -1;
+    mesh->poseFrame = -1;
+
+    return MD5OpenGLMeshUpdatePoseWithAnimationFrame(mesh, NULL, NULL, 0);
+}
+
+int MD5OpenGLMeshManagerGetPoseBounds(
+    int meshId, 
+    FxsVector3* min, 
+    FxsVector3* max
+)
+{
+    MD5OpenGLMesh* mesh = NULL;
+    MD5OpenGLSubMesh* glsubmesh = NULL;
+    MD5Vertex* skinned = NULL;
+    int i = 0, j = 0;
+
+    if (!MD5OpenGLMeshManagerGetMeshWithId(meshId))
+    {
+        return 0;
+    }
+
+    mesh = meshes[meshId];
+
+    MD5OpenGLMeshManagerFinishWorkers();
+
+    if (!mesh->gpuSkinning)
+    {
+        *min = mesh->min;
+        *max = mesh->max;
+        return 1;
+    }
+
+    /* the vertices skinned on the gpu are read back, they are in float 
+    ** format 
+    */
+    min->x = min->y = min->z = FLT_MAX;
+    max->x = max->y = max->z = -FLT_MAX;
+    glBindBuffer(GL_ARRAY_BUFFER, vertexArena);
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        glsubmesh = &mesh->subMeshes[i];
+        skinned = (MD5Vertex*)malloc((glsubmesh->numVertices + 1)*sizeof(MD5Vertex));
+
+        if (!skinned)
+        {
+            ERR_MSG("Warning: malloc failed. Could not read back md5mesh");
+            return 0;
+        }
+
+        glGetBufferSubData(
+            GL_ARRAY_BUFFER,
+            sizeof(MD5Vertex)*glsubmesh->first,
+            sizeof(MD5Vertex)*glsubmesh->numVertices,
+            skinned
+        );
+
+        for (j = 0; j < glsubmesh->numVertices; j++)
+        {
+            min->x = fminf(min->x, skinned[j].position.x);
+            min->y = fminf(min->y, skinned[j].position.y);
+            min->z = fminf(min->z, skinned[j].position.z);
+            max->x = fmaxf(max->x, skinned[j].position.x);
+            max->y = fmaxf(max->y, skinned[j].position.y);
+            max->z = fmaxf(max->z, skinned[j].position.z);
+        }
+
+        free(skinned);
+    }
+
+    if (GL_NO_ERROR != glGetError()) 
+    {
+        ERR_MSG("Warning: opengl failed. Could not read back md5mesh");
+        return 0;		    
+    }	
+
+    return min->x <= max->x;
+}
+
+int MD5OpenGLMeshManagerRequestMeshPose(
+    int meshId,
+    int animationId,
+    int frame,
+    float screenSize
+)
+{
     MD5OpenGLMesh* mesh = NULL;
-	FxsMD5Animation* animation = NULL;
+    int f = MD5OpenGLMeshManagerGetPoseFrame(meshId, animationId, frame);
 
-    if (wasInitialized)
+    if (f < 0)
     {
-        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate was already initialized")
         return 0;
     }
-    
-	root = json_parse_file(filename);
-		
-	if (!root) 
-	{
-	    sprintf(errMsg, "Failed to parse file: %s", filename);
-		ERR_MSG(errMsg)
-		return 0;
-	}
-    
-    rootObj = json_value_get_object(root);
-    
-	if (!rootObj)
-	{
-	    sprintf(errMsg, "Failed to parse file: %s", filename);
-		ERR_MSG(errMsg)
-		return 0;
-	}
-	
-	/* load meshes */
-	array = json_object_get_array(rootObj, "meshes");
 
-	if (!array) 
-	{
-	    sprintf(errMsg, "Failed to parse file: %s", filename);
-		ERR_MSG(errMsg)
- 		json_value_free(root);
-		return 0;
-	}
+    mesh = meshes[meshId];
 
-    arraySize = json_array_get_count(array);
+    /* the draws of a frame share the vertices of the mesh, so there is one
+    ** pose per mesh and frame
+    */
+    if (mesh->frameRequestSerial == requestSerial &&
+        (mesh->frameAnimationId != animationId || mesh->frameFrame != f))
+    {
+        return -1;
+    }
 
-	for (i = 0; i < arraySize; i++) 
-	{
-	   	object = json_array_get_object(array, i);
-	    id = json_object_get_number(object, "id");	
-		md5filename = json_object_get_string(object, "filename");
-	
-		if (id < 0 || id > MAX_MESHES)
-        {
-            sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. Skipping mesh for file %s", id, MAX_MESHES - 1, md5filename);
-            ERR_MSG(errMsg);
-            continue;
-        }
-        
-        if (meshes[id] != NULL)
+    mesh->frameRequestSerial = requestSerial;
+    mesh->frameAnimationId = animationId;
+    mesh->frameFrame = f;
+
+    /* a request for the current pose or the one in flight cancels a pending
+    ** one 
+    */
+    if ((mesh->poseAnimationId == animationId && mesh->poseFrame == f) ||
+        (mesh->backAnimationId == animationId && mesh->backFrame == f))
+    {
+        mesh->requestedAnimationId = -1;
+        mesh->requestedFrame = -1;
+        mesh->staleUpdates = 0;
+        return 1;
+    }
+
+    mesh->requestedAnimationId = animationId;
+    mesh->requestedFrame = f;
+    mesh->screenSize = screenSize;
+
+    return 1;
+}
+
+#define MIN_PRIORITY_SCREEN_SIZE 0.01f 	/* screen size the priority of a 
+										** request is at least computed with,
+										** so staleness raises the priority
+										** of meshes covering no pixels */
+
+/*
+** Compares the priority of two meshes with pending pose requests (for 
+** qsort, highest priority first).
+*/
+static int MD5OpenGLMeshManagerComparePriority(const void* a, const void* b)
+{
+    const MD5OpenGLMesh* meshA = meshes[*(const int*)a];
+    const MD5OpenGLMesh* meshB = meshes[*(const int*)b];
+    float priorityA = fmaxf(meshA->screenSize, MIN_PRIORITY_SCREEN_SIZE)*
+        (1 + meshA->staleUpdates);
+    float priorityB = fmaxf(meshB->screenSize, MIN_PRIORITY_SCREEN_SIZE)*
+        (1 + meshB->staleUpdates);
+
+    return priorityA < priorityB ? 1 : (priorityA > priorityB ? -1 : 0);
+}
+
+/*
+** Performs the pending pose requests within the budget (see 
+** MD5OpenGLMeshManagerUpdateRequestedPoses). Returns the # of deferred 
+** requests.
+*/
+static int MD5OpenGLMeshManagerPerformRequests(unsigned int budgetMicroseconds)
+{
+    int pending[MAX_MESHES];
+    MD5OpenGLMesh* mesh = NULL;
+    double start = MD5OpenGLMeshManagerGetMicroseconds();
+    float elapsed = 0.0f;
+    int numPending = 0;
+    int numDeferred = 0;
+    int i = 0;
+
+    for (i = 0; i < MAX_MESHES; i++)
+    {
+        if (meshes[i] && meshes[i]->requestedAnimationId >= 0)
         {
-            sprintf(errMsg, "Warning: Mesh for id %d was already initialized. Skipping mesh for file %s", id, md5filename);
-            ERR_MSG(errMsg);
-            continue;
+            pending[numPending++] = i;
         }
-        
-        if (!MD5OpenGLMeshCreateWithFile(&mesh, md5filename))
+    }
+
+    qsort(pending, numPending, sizeof(int), MD5OpenGLMeshManagerComparePriority);
+
+    for (i = 0; i < numPending; i++)
+    {
+        mesh = meshes[pending[i]];
+        elapsed = (float)(MD5OpenGLMeshManagerGetMicroseconds() - start);
+
+        /* defer the request if its estimated cost exceeds the budget */
+        if (i > 0 && elapsed + mesh->updateMicroseconds > budgetMicroseconds)
         {
-            sprintf(errMsg, "Warning: Failed to load mesh for: %s", md5filename);
-            ERR_MSG(errMsg);
+            mesh->staleUpdates++;
+            numDeferred++;
             continue;
         }
-        
-        meshes[id] = mesh;
-	}
-	
-	/* load animations */		
-	array = json_object_get_array(rootObj, "animations");
 
-	if (!array) 
-	{
-	    sprintf(errMsg, "Failed to parse file: %s", filename);
-		ERR_MSG(errMsg)
- 		json_value_free(root);
-		return 0;
-	}
+        MD5OpenGLMeshManagerPoseMesh(
+            pending[i], 
+            mesh->requestedAnimationId, 
+            mesh->requestedFrame
+        );
 
-    arraySize = json_array_get_count(array);
+        mesh->requestedAnimationId = -1;
+        mesh->requestedFrame = -1;
+        mesh->staleUpdates = 0;
+    }
 
-	for (i = 0; i < arraySize; i++) 
-	{
-		object = json_array_get_object(array, i);
-	    id = json_object_get_number(object, "id");	
-		md5filename = json_object_get_string(object, "filename");
+    return numDeferred;
+}
+
+/*
+** Skins the mesh with the index-th id in data, the ids of the meshes in 
+** flight, into its back buffers. Runs on a worker thread.
+*/
+static void MD5OpenGLMeshManagerSkinJob(void* data, int index, int worker)
+{
+    MD5OpenGLMesh* mesh = meshes[((const int*)data)[index]];
+    MD5Arena* scratch = &workerScratchArenas[worker];
+    const MD5JointMatrix* palette = NULL;
+    const MD5DualQuaternion* dqPalette = NULL;
+
+    MD5ArenaReset(scratch);
+    mesh->backValid = 0;
+
+    if (!MD5OpenGLMeshComputeSkinningPalette(
+            mesh,
+            animations[mesh->backAnimationId],
+            compressedAnimations[mesh->backAnimationId],
+            mesh->backFrame,
+            scratch,
+            &palette,
+            &dqPalette
+        ))
+    {
+        return;
+    }
+
+    MD5OpenGLMeshSkin(mesh, palette, dqPalette, 1);
+    mesh->backValid = 1;
+}
+
+/*
+** Waits for the workers and swaps the poses they skinned to the front 
+** buffers. Writes the ids of these meshes to swapped and returns their #.
+*/
+static int MD5OpenGLMeshManagerSwapWorkerResults(int* swapped)
+{
+    MD5OpenGLMesh* mesh = NULL;
+    int numSwapped = 0;
+    int i = 0;
+
+    if (numWorkers <= 0)
+    {
+        return 0;
+    }
+
+    /* the fence between the workers and the gl thread */
+    MD5WorkerPoolWait(&workerPool);
+
+    for (i = 0; i < numMeshesInFlight; i++)
+    {
+        mesh = meshes[meshesInFlight[i]];
 
-		if (id < 0 || id > MAX_ANIMATIONS)
+        if (mesh->backValid && mesh->backAnimationId >= 0)
         {
-            sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. Skipping animation for file %s", id, MAX_ANIMATIONS - 1, md5filename);
-            ERR_MSG(errMsg);
-            continue;
+            MD5OpenGLMeshSwapBuffers(mesh);
+            mesh->poseAnimationId = mesh->backAnimationId;
+            mesh->poseFrame = mesh->backFrame;
+            swapped[numSwapped++] = meshesInFlight[i];
         }
-        
-        if (animations[id] != NULL)
+        else if (mesh->backAnimationId >= 0)
         {
-            sprintf(errMsg, "Warning: Animation for id %d was already initialized. Skipping animation for file %s", id, md5filename);
-            ERR_MSG(errMsg);
-            continue;
+            ERR_MSG("Warning: Could not skin md5mesh on a worker");
         }
-        
-        if (!FxsMD5AnimationCreateWithFile(&animation, md5filename)) 
+
+        mesh->backAnimationId = -1;
+        mesh->backFrame = -1;
+        mesh->backValid = 0;
+    }
+
+    numMeshesInFlight = 0;
+
+    return numSwapped;
+}
+
+/*
+** Uploads the front buffers of the meshes with ids.
+*/
+static void MD5OpenGLMeshManagerUploadMeshes(const int* ids, int numIds)
+{
+    int i = 0;
+
+    for (i = 0; i < numIds; i++)
+    {
+        MD5ArenaReset(&scratchArena);
+
+        if (!MD5OpenGLMeshUpload(meshes[ids[i]]))
         {
-            sprintf(errMsg, "Warning: Failed to load animation for: %s", md5filename);
-            ERR_MSG(errMsg);
-            continue;
+            meshes[ids[i]]->poseAnimationId = -1;
+            meshes[ids[i]]->poseFrame = -1;
         }
+    }
+}
 
-		animations[id] = animation;
-	}
+/*
+** Waits for the workers and uploads the poses they skinned, so the gl thread
+** can update meshes itself.
+*/
+static void MD5OpenGLMeshManagerFinishWorkers()
+{
+    int swapped[MAX_MESHES];
 
-	/* clean up */
- 	json_value_free(root);
-    
-    wasInitialized = 1;
-    
-    return 1;
+    MD5OpenGLMeshManagerUploadMeshes(
+        swapped, 
+        MD5OpenGLMeshManagerSwapWorkerResults(swapped)
+    );
 }
 
-const MD5OpenGLMesh* MD5OpenGLMeshManagerGetMeshWithId(int id)
+int MD5OpenGLMeshManagerUpdateRequestedPoses(unsigned int budgetMicroseconds)
 {
     if (!wasInitialized)
     {
@@ -574,101 +2773,187 @@ const MD5OpenGLMesh* MD5OpenGLMeshManagerGetMeshWithId(int id)
         return 0;
     }
 
-    if (id < 0 || id > MAX_MESHES)
-    {
-        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d.", id, MAX_MESHES - 1);
-        ERR_MSG(errMsg);
-        return NULL;
-    }
-    
-    if (!meshes[id])
-    {
-        sprintf(errMsg, "Warning: Mesh with id: %d not found.", id);
-        ERR_MSG(errMsg);
-        return NULL;
-    }
-    
-    return (const MD5OpenGLMesh*)meshes[id];
+    MD5OpenGLMeshManagerFinishWorkers();
+    requestSerial++;
+
+    return MD5OpenGLMeshManagerPerformRequests(budgetMicroseconds);
 }
 
-void MD5OpenGLMeshManagerDestroy()
+int MD5OpenGLMeshManagerSubmitRequestedPoses(unsigned int budgetMicroseconds)
 {
+    int swapped[MAX_MESHES];
+    int numSwapped = 0;
+    MD5OpenGLMesh* mesh = NULL;
     int i = 0;
 
     if (!wasInitialized)
     {
         ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
+        return 0;
     }
-    
-    for (i = 0; i < MAX_MESHES; i++)
+
+    requestSerial++;
+
+    if (numWorkers <= 0)
     {
-        if (meshes[i])
-        {
-            MD5OpenGLMeshDestroy(&meshes[i]);
-        }
+        return MD5OpenGLMeshManagerPerformRequests(budgetMicroseconds);
     }
 
-    for (i = 0; i < MAX_ANIMATIONS; i++)
+    numSwapped = MD5OpenGLMeshManagerSwapWorkerResults(swapped);
+
+    /* hand the requests of meshes skinned on the host to the workers */
+    for (i = 0; i < MAX_MESHES; i++)
     {
-        if (animations[i])
+        mesh = meshes[i];
+
+        if (!mesh || mesh->requestedAnimationId < 0 || mesh->gpuSkinning)
         {
-            FxsMD5AnimationDestroy(&animations[i]);
+            continue;
         }
+
+        mesh->backAnimationId = mesh->requestedAnimationId;
+        mesh->backFrame = mesh->requestedFrame;
+        mesh->requestedAnimationId = -1;
+        mesh->requestedFrame = -1;
+        mesh->staleUpdates = 0;
+        meshesInFlight[numMeshesInFlight++] = i;
     }
+
+    MD5WorkerPoolRun(
+        &workerPool, 
+        MD5OpenGLMeshManagerSkinJob, 
+        meshesInFlight, 
+        numMeshesInFlight
+    );
+
+    /* the back buffers of the swapped meshes are not used by the workers */
+    MD5OpenGLMeshManagerUploadMeshes(swapped, numSwapped);
+
+    return MD5OpenGLMeshManagerPerformRequests(budgetMicroseconds);
 }
 
-const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
-    int meshId,
-    int animationId,
-    int frame
-)
+int MD5OpenGLMeshManagerGetNumWorkers()
 {
-    int f = 0;
+    return numWorkers;
+}
 
-    if (!wasInitialized)
-    {
-        ERR_MSG("Warning: MD5OpenGLMeshManagerCreate is not initialized")
-        return 0;
-    }
-    
-    if (meshId < 0 || meshId > MAX_MESHES)
+/*
+** Gets a component of a signed normalized 10:10:10:2 integer
+*/
+static float MD5OpenGLUnpackSnorm10(unsigned int packed, int component)
+{
+	int i = (int)((packed >> (10*component)) & 0x3FF);
+
+	/* sign extend */
+	i = i >= 512 ? i - 1024 : i;
+
+	return i < -511 ? -1.0f : i/511.0f;
+}
+
+int MD5OpenGLMeshManagerVerifyGpuSkinning(int meshId, float tolerance)
+{
+    MD5OpenGLMesh* mesh = NULL;
+    MD5OpenGLSubMesh* glsubmesh = NULL;
+    const MD5JointMatrix* palette = NULL;
+    const MD5DualQuaternion* dqPalette = NULL;
+    MD5Vertex* skinned = NULL;
+    MD5Vertex* a = NULL;
+    MD5Vertex* b = NULL;
+    float error = 0.0f;
+    int i = 0, j = 0, k = 0;
+
+    if (!MD5OpenGLMeshManagerGetMeshWithId(meshId))
     {
-        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d.", meshId, MAX_MESHES - 1);
-        ERR_MSG(errMsg);
         return 0;
     }
-    
-    if (meshes[meshId] == NULL)
+
+    mesh = meshes[meshId];
+
+    MD5OpenGLMeshManagerFinishWorkers();
+
+    if (!mesh->gpuSkinning || mesh->poseAnimationId < 0)
     {
-        sprintf(errMsg, "Warning: Mesh with id %d not found", meshId);
-        ERR_MSG(errMsg);
+        ERR_MSG("Warning: Mesh is not skinned on the gpu or not posed by an animation");
         return 0;
     }
-    
-    if (animationId < 0 || animationId > MAX_ANIMATIONS)
+
+    /* skin the current pose on the host */
+    MD5ArenaReset(&scratchArena);
+
+    if (!MD5OpenGLMeshComputeSkinningPalette(
+            mesh,
+            animations[mesh->poseAnimationId],
+            compressedAnimations[mesh->poseAnimationId],
+            mesh->poseFrame,
+            &scratchArena,
+            &palette,
+            &dqPalette
+        ))
     {
-        sprintf(errMsg, "Warning: Invalid id: %d. Id has to be inbetween 0 .. %d. ", animationId, MAX_ANIMATIONS - 1);
+        ERR_MSG("Warning: Could not compute the joint transforms of md5mesh");
         return 0;
     }
-        
-    if (animations[animationId] == NULL)
+
+    MD5OpenGLMeshSkin(mesh, palette, dqPalette, 0);
+
+    /* compare with the vertices in the arena */
+    glBindBuffer(GL_ARRAY_BUFFER, vertexArena);
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
     {
-        sprintf(errMsg, "Warning: Animation with id %d not found", animationId);
-        ERR_MSG(errMsg);
-        return 0;
+        glsubmesh = &mesh->subMeshes[i];
+        skinned = (MD5Vertex*)malloc((glsubmesh->numVertices + 1)*sizeof(MD5Vertex));
+
+        if (!skinned)
+        {
+            ERR_MSG("Warning: malloc failed. Could not verify md5mesh");
+            return 0;
+        }
+
+        glGetBufferSubData(
+            GL_ARRAY_BUFFER,
+            sizeof(MD5Vertex)*glsubmesh->first,
+            sizeof(MD5Vertex)*glsubmesh->numVertices,
+            skinned
+        );
+
+        for (j = 0; j < glsubmesh->numVertices; j++)
+        {
+            a = &skinned[j];
+            b = &glsubmesh->verticesHost[j];
+
+            error = fmaxf(error, fabsf(a->position.x - b->position.x));
+            error = fmaxf(error, fabsf(a->position.y - b->position.y));
+            error = fmaxf(error, fabsf(a->position.z - b->position.z));
+
+            for (k = 0; k < 3; k++)
+            {
+                error = fmaxf(error, fabsf(MD5OpenGLUnpackSnorm10(a->normal, k) - 
+                    MD5OpenGLUnpackSnorm10(b->normal, k)));
+                error = fmaxf(error, fabsf(MD5OpenGLUnpackSnorm10(a->tangent, k) - 
+                    MD5OpenGLUnpackSnorm10(b->tangent, k)));
+            }
+
+            /* the handedness has to match exactly */
+            if ((a->tangent >> 30) != (b->tangent >> 30))
+            {
+                error = FLT_MAX;
+            }
+        }
+
+        free(skinned);
     }
-    
-    if (frame < 0)
+
+    if (GL_NO_ERROR != glGetError()) 
     {
-        ERR_MSG("Frame index cannot be negative");
-    }
-    
-    /* keep the frame between 0 .. animations[animationId]->numFrames */
-    f = frame % animations[animationId]->numFrames;
+        ERR_MSG("Warning: opengl failed. Could not verify md5mesh");
+        return 0;		    
+    }	
 
-    if (!MD5OpenGLMeshUpdatePoseWithAnimationFrame(meshes[meshId], animations[animationId], f))
+    if (error > tolerance)
     {
-        ERR_MSG("Failed to update the opengl mesh");
+        sprintf(errMsg, "Warning: gpu skinning of mesh with id %d is off by %f", meshId, error);
+        ERR_MSG(errMsg);
         return 0;
     }
 
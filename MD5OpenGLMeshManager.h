@@ -23,37 +23,196 @@ extern "C"
 {
 #endif
 
+#include <pthread.h>
 #include <Fxs/Math/Vector3.h>
 #include <Fxs/MD5/MD5Mesh.h>
+#include "MD5Arena.h"
+#include "MD5VertexFormat.h"
+#include "MD5CompressedAnimation.h"
+#include "MD5Skinning.h"
+#include "MD5OpenGLGpuSkinning.h"
+#include "MD5VertexCache.h"
+#include "MD5AssetHash.h"
 #define GL_GLEXT_PROTOTYPES 1
 #include <Fxs/Opengl/glcorearb.h>
 
 /*
 ** Submesh that actually stores all the opengl data
+**
+** The faces are reordered for the post-transform vertex cache at load time
+** and the vertices are renumbered in the order of their first use, so 
+** skinning and drawing walk the vertices sequentially.
 */ 
 typedef struct
 {
-	GLuint vao;
-	GLuint positions; 			/* opengl positions buffer */
-	FxsVector3* positionsHost; 	/* positions in host memory */
-	int numPositions; 			/* # of positions */
+	GLint first; 				/* index of the first vertex in the arena */
+	GLuint firstIndex; 			/* index of the first index in the element
+								** arena */
+	MD5Vertex* verticesHost; 	/* skinned vertices in host memory */
+	int numVertices; 			/* # of vertices */
+	int* vertexMap; 			/* md5 vertex id of each vertex */
+	unsigned int* indices; 		/* 3 vertex ids per face */
+	int numIndices; 			/* # of indices */
+
+	/* average cache miss ratio (transformed vertices per face) of the faces 
+	** in file order and after the optimization, for a fifo cache of 
+	** MD5_VERTEX_CACHE_SIZE entries
+	*/
+	float acmrBefore;
+	float acmrAfter;
+
+	/* normals and tangents of the bind pose in the space of the joint of
+	** each weight, and the handedness of the bitangent of each md5 vertex
+	** (see MD5SkinningComputeWeightFrames) 
+	*/
+	FxsVector3* weightNormals;
+	FxsVector3* weightTangents;
+	float* handedness;
+
+	/* positions, normals and tangents of the bind pose of each md5 vertex,
+	** only kept for dual quaternion skinning and skinning on the gpu. Linear 
+	** blend skinning on the host uses the weight normals and tangents.
+	*/
+	FxsVector3* bindPositions;
+	FxsVector3* bindNormals;
+	FxsVector3* bindTangents;
 	
 	/* bounding box for the submesh */
     FxsVector3 min;
 	FxsVector3 max;
+
+	/* skinned vertices and bounding box written by the worker threads, only
+	** allocated if the manager has workers 
+	*/
+	MD5Vertex* verticesBack;
+	FxsVector3 backMin;
+	FxsVector3 backMax;
 }
 MD5OpenGLSubMesh; 
 
+/*
+** Bounds the packed positions of a submesh are relative to. A vertex shader
+** recovers a position p fetched from the vertex arena with min + p*extent.
+*/
+typedef struct
+{
+	FxsVector3 min;
+	FxsVector3 extent;
+}
+MD5OpenGLSubMeshBounds;
+
+/*
+** Layout of a command in the indirect draw buffer (see 
+** glMultiDrawElementsIndirect)
+*/
+typedef struct
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+}
+MD5OpenGLDrawElementsIndirectCommand;
+
+/*
+** Instanced data of a submesh in a draw through a VAO of
+** MD5OpenGLMeshManagerCreateInstancedVertexArray.
+*/
+typedef struct
+{
+	MD5OpenGLSubMeshBounds bounds;
+	GLuint model; 				/* index of the model matrix of the draw */
+}
+MD5OpenGLInstance;
+
 /*
 ** Struct for storing OpenGL data for a MD5 mesh.
 **
-** A mesh consits of submeshes that store all the opengl data
+** A mesh consits of submeshes that store all the opengl data. The vertices
+** and indices of all submeshes of all meshes live in one shared vertex and
+** element arena, that are drawn through a single VAO (see 
+** MD5OpenGLMeshManagerCreateInstancedVertexArray and 
+** MD5OpenGLMeshManagerGetDrawCommands).
+**
+** Meshes loaded from files with the same content and options share the 
+** immutable data of the first of them: the md5mesh, the baked bind pose, the
+** indices in the element arena and the inputs for skinning on the gpu. The
+** pose (animation, frame and joint palette) and the skinned vertices are 
+** per mesh. The skeleton of the shared md5mesh is only a temporary: posing
+** it and copying the joints to the palette of a mesh happen under one 
+** lock, so meshes sharing it can be skinned in different poses on 
+** different threads.
 */
-typedef struct
+typedef struct MD5OpenGLMesh
 {
 	FxsMD5Mesh* md5mesh; 			/* reference to the associated md5mesh */
 	int numSubMeshes; 				/* # of submeshes */
 	MD5OpenGLSubMesh* subMeshes;
+	MD5OpenGLSubMeshBounds* bounds; /* bounds the positions of the 
+									** submeshes in the vertex arena are
+									** relative to */
+	int numJoints; 					/* # of joints referenced by the weights */
+
+	MD5SkinningMethod skinningMethod;
+	MD5DualQuaternion* inverseBindPose; 	/* only for dual quaternion 
+											** skinning */
+
+	/* meshes skinned on the gpu write their vertices into the vertex arena 
+	** with transform feedback. The bounding boxes are not updated and stay 
+	** the ones of the bind pose (see MD5OpenGLMeshManagerGetPoseBounds).
+	*/
+	int gpuSkinning;
+	MD5OpenGLGpuSkin gpuSkin;
+	MD5JointMatrix* inverseBindMatrices; 	/* only for linear blend skinning
+											** on the gpu */
+	MD5JointMatrix* bindPose; 		/* joint transforms of the bind pose */
+
+	/* animation and frame of the pose in the vertex arena, -1 for the bind 
+	** pose. Updates to the same pose are skipped, so the mesh is skinned
+	** once no matter how often it is drawn in that pose.
+	*/
+	int poseAnimationId;
+	int poseFrame;
+
+	/* pose requested for the next scheduled update (see 
+	** MD5OpenGLMeshManagerRequestMeshPose), -1 if no request is pending
+	*/
+	int requestedAnimationId;
+	int requestedFrame;
+	float screenSize; 				/* screen size of the request */
+	int staleUpdates; 				/* # of scheduled updates that deferred
+									** the request */
+	float updateMicroseconds; 		/* estimated cost of a pose update */
+
+	/* pose requested since the last scheduled update and the serial of 
+	** that update, see MD5OpenGLMeshManagerRequestMeshPose
+	*/
+	int frameRequestSerial;
+	int frameAnimationId;
+	int frameFrame;
+
+	/* pose the workers skin into the back buffers, -1 if none is in 
+	** flight, and whether skinning it succeeded
+	*/
+	int backAnimationId;
+	int backFrame;
+	int backValid;
+	FxsVector3 backMin;
+	FxsVector3 backMax;
+
+	MD5AssetHash hash; 				/* content hash of the md5mesh file */
+	struct MD5OpenGLMesh* shared; 	/* mesh whose immutable data the mesh 
+									** uses, NULL if the mesh owns it */
+	int refCount; 					/* # of meshes using the immutable data
+									** of the mesh, including itself */
+	pthread_mutex_t poseMutex; 		/* guards the pose of md5mesh, only 
+									** used by the mesh owning it */
+
+	MD5Arena arena; 				/* holds the mesh, its submeshes and their
+									** host data */
+	size_t scratchSize; 			/* bytes of transient data needed to 
+									** update the pose of the mesh */
 
 	/* bounding box for the mesh */
     FxsVector3 min;
@@ -71,6 +230,110 @@ int MD5OpenGLMeshManagerCreate(const char* filename);
 */
 const MD5OpenGLMesh* MD5OpenGLMeshManagerGetMeshWithId(int id);
 
+/*
+** Memory used by a mesh.
+*/
+typedef struct
+{
+	size_t hostBytes; 		/* immutable and pose data in host memory */
+	size_t deviceBytes; 	/* vertex and element arena in gl memory */
+	size_t sharedBytes; 	/* host and element arena memory of the 
+							** immutable data shared with another mesh, 
+							** not included above */
+	size_t scratchBytes; 	/* transient data needed for a pose update */
+}
+MD5OpenGLMeshMemoryUsage;
+
+/*
+** Gets the memory used by the mesh with id. Returns 0 if the mesh does not
+** exist.
+*/
+int MD5OpenGLMeshManagerGetMeshMemoryUsage(
+	int id,
+	MD5OpenGLMeshMemoryUsage* usage
+);
+
+/*
+** Gets the average cache miss ratio of the faces of the mesh with id (see 
+** MD5OpenGLSubMesh) in file order and after the optimization, averaged 
+** over the faces of all submeshes. Returns 0 if the mesh does not exist or
+** has no faces.
+*/
+int MD5OpenGLMeshManagerGetMeshAcmr(
+	int id,
+	float* acmrBefore,
+	float* acmrAfter
+);
+
+/*
+** Gets the statistics of the compressed animation with id (memory and decode
+** cost). Returns 0 if the animation does not exist or is not compressed.
+*/
+int MD5OpenGLMeshManagerGetAnimationStats(
+	int id,
+	MD5CompressedAnimationStats* stats
+);
+
+/*
+** Gets the # of frames and the content hash of the file of the animation 
+** with id. Returns 0 if the animation does not exist.
+*/
+int MD5OpenGLMeshManagerGetAnimationInfo(
+	int id,
+	int* numFrames,
+	MD5AssetHash* hash
+);
+
+/*
+** Gets the size in bytes of the scratch arena shared by all pose updates.
+*/
+size_t MD5OpenGLMeshManagerGetScratchMemoryUsage();
+
+/*
+** Gets the format of the positions in the vertex arena.
+*/
+MD5PositionFormat MD5OpenGLMeshManagerGetPositionFormat();
+
+/*
+** Creates a VAO of the shared vertex arena, that holds the positions of all
+** meshes. The instanced attributes are read from the MD5OpenGLInstance 
+** records in instanceBuffer. The VAO feeds the following attributes:
+**
+**      0: the (packed) position
+**      1: the min. of the bounds of the submesh (instanced)
+**      2: the extent of the bounds of the submesh (instanced)
+**      3: the normal (signed normalized)
+**      4: the tangent (signed normalized), w is the handedness of the 
+**         bitangent
+**      5: the index of the model matrix of the draw (unsigned int,
+**         instanced)
+**
+** The position of a vertex is min + position*extent. The indices in the
+** element arena bound to the VAO are unsigned ints. 
+**
+** For the 16 bit position formats the tangent only has x and y, which hold
+** the octahedral encoding of the tangent (see MD5PackOctahedralSnorm8), and
+** the w of the normal is the handedness.
+**
+** The caller deletes the VAO. Returns 0 if it fails.
+*/
+GLuint MD5OpenGLMeshManagerCreateInstancedVertexArray(GLuint instanceBuffer);
+
+/*
+** Writes the draw commands of the submeshes of the mesh with meshId and
+** their instanced data with the model matrix index model, for a VAO of
+** MD5OpenGLMeshManagerCreateInstancedVertexArray. The commands select the 
+** instances from baseInstance on. Returns the # of commands written (the #
+** of submeshes), 0 if the mesh does not exist.
+*/
+int MD5OpenGLMeshManagerGetDrawCommands(
+	int meshId,
+	GLuint model,
+	GLuint baseInstance,
+	MD5OpenGLDrawElementsIndirectCommand* commands,
+	MD5OpenGLInstance* instances
+);
+
 /*
 ** Updates the mesh pose with the frame of an animation
 */
@@ -80,6 +343,85 @@ const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
     int frame
 );
 
+/*
+** Poses the mesh with meshId in its bind pose. Returns 0 if it fails.
+*/
+int MD5OpenGLMeshManagerResetMeshPose(int meshId);
+
+/*
+** Gets the bounding box of the current pose of the mesh with meshId. The 
+** min and max of meshes skinned on the gpu stay the ones of the bind pose,
+** their bounding box is computed from the vertices read back from the 
+** vertex arena. Returns 0 if it fails.
+*/
+int MD5OpenGLMeshManagerGetPoseBounds(
+    int meshId, 
+    FxsVector3* min, 
+    FxsVector3* max
+);
+
+/*
+** Requests the mesh with meshId to be posed with the frame of an animation 
+** by the next MD5OpenGLMeshManagerUpdateRequestedPoses. Replaces a pending
+** request of the mesh from an earlier frame. screenSize is the (relative)
+** size of the mesh on the screen and prioritizes the request. 
+**
+** A mesh has one pose per frame, since all its draws of the frame read the
+** same vertices. Returns -1 and ignores the request if the mesh was already
+** requested in another pose since the last scheduled update, the caller has
+** to pose the mesh synchronously for that draw. Returns 0 if the ids are 
+** invalid.
+*/
+int MD5OpenGLMeshManagerRequestMeshPose(
+    int meshId,
+    int animationId,
+    int frame,
+    float screenSize
+);
+
+/*
+** Performs the pending pose requests within a budget of (wall) time in 
+** microseconds. Requests are ordered by their screen size (at least 0.01, so
+** meshes covering no pixels are not deferred forever) times one plus the # 
+** of updates they were deferred by. The request with the highest priority is 
+** always performed. Requests that do not fit into the budget stay pending, 
+** the meshes keep their last pose. Waits for the poses skinned by the 
+** workers first. Returns the # of deferred requests.
+*/
+int MD5OpenGLMeshManagerUpdateRequestedPoses(unsigned int budgetMicroseconds);
+
+/*
+** Pipelined version of MD5OpenGLMeshManagerUpdateRequestedPoses for managers
+** with worker threads. Called by the gl thread once per frame:
+**
+**      1. waits for the workers to finish the poses requested in the 
+**         previous frame (the fence) and swaps them to the front buffers
+**      2. hands the pending requests of meshes skinned on the host to the 
+**         workers, that skin them into the back buffers
+**      3. uploads the front buffers while the workers run
+**      4. performs the remaining requests (meshes skinned on the gpu) within
+**         the budget
+**
+** Meshes skinned on the host thus show their requested pose one frame
+** later. Returns the # of deferred requests.
+*/
+int MD5OpenGLMeshManagerSubmitRequestedPoses(unsigned int budgetMicroseconds);
+
+/*
+** Gets the # of worker threads of the manager (see "workerThreads" in 
+** FFMD5OpenGLRendererCreate). 
+*/
+int MD5OpenGLMeshManagerGetNumWorkers();
+
+/*
+** Checks the vertices skinned on the gpu for the current pose of the mesh
+** with meshId against skinning them on the host. Reads the vertices back 
+** from the vertex arena. Returns 1 if all positions and the components of 
+** the normals and tangents are within tolerance, 0 otherwise or if the mesh
+** is not skinned on the gpu.
+*/
+int MD5OpenGLMeshManagerVerifyGpuSkinning(int meshId, float tolerance);
+
 /*
 ** Destroys the mesh manager. and releases all meshes it contains.
 */ 
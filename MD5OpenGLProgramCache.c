@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MD5OpenGLProgramCache.h"
+#include "MD5AssetHash.h"
+#include <Fxs/OpenGL/Program.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+static char errMsg[1024];
+
+#define MD5_PROGRAM_CACHE_MAGIC 0x5035444D 	/* "MD5P" */
+
+/*
+** Header of a cache file, followed by the binary.
+*/
+typedef struct
+{
+	unsigned int magic;
+	unsigned int format; 		/* format of the binary */
+	unsigned int length; 		/* # of bytes of the binary */
+	MD5AssetHash key; 			/* hash of the driver and the sources */
+}
+MD5OpenGLProgramCacheHeader;
+
+static char* directory = NULL;
+static MD5OpenGLProgramCacheStats stats;
+
+int MD5OpenGLProgramCacheCreate(const char* dir)
+{
+	GLint numFormats = 0;
+
+	MD5OpenGLProgramCacheDestroy();
+
+	if (!dir)
+	{
+		return 1;
+	}
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+
+	if (numFormats <= 0)
+	{
+		ERR_MSG("Warning: The driver offers no program binary formats. Not caching programs");
+		return 1;
+	}
+
+	directory = (char*)malloc(strlen(dir) + 1);
+
+	if (!directory)
+	{
+		ERR_MSG("Warning: malloc failed. Could not create the program cache");
+		return 0;
+	}
+
+	strcpy(directory, dir);
+
+	return 1;
+}
+
+/*
+** Continues hash with a string and its terminator, so consecutive strings
+** cannot run into each other. NULL is hashed like an empty string.
+*/
+static MD5AssetHash MD5OpenGLProgramCacheHashString(
+	MD5AssetHash hash, 
+	const char* string
+)
+{
+	string = string ? string : "";
+
+	return MD5AssetHashBytes(hash, string, strlen(string) + 1);
+}
+
+/*
+** Computes the key of the binary of source for the current driver.
+*/
+static MD5AssetHash MD5OpenGLProgramCacheComputeKey(
+	const MD5OpenGLProgramSource* source
+)
+{
+	MD5AssetHash hash = MD5_ASSET_HASH_BASIS;
+	int i = 0;
+
+	hash = MD5OpenGLProgramCacheHashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = MD5OpenGLProgramCacheHashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = MD5OpenGLProgramCacheHashString(hash, (const char*)glGetString(GL_VERSION));
+	hash = MD5OpenGLProgramCacheHashString(hash, source->vertexShader);
+	hash = MD5OpenGLProgramCacheHashString(hash, source->fragmentShader);
+	hash = MD5OpenGLProgramCacheHashString(hash, source->defines);
+	hash = MD5AssetHashBytes(hash, &source->numAttributes, sizeof(int));
+
+	for (i = 0; i < source->numAttributes; i++)
+	{
+		hash = MD5OpenGLProgramCacheHashString(hash, source->attributes[i]);
+	}
+
+	hash = MD5OpenGLProgramCacheHashString(hash, source->fragOut);
+	hash = MD5AssetHashBytes(hash, &source->numVaryings, sizeof(int));
+
+	for (i = 0; i < source->numVaryings; i++)
+	{
+		hash = MD5OpenGLProgramCacheHashString(hash, source->varyings[i]);
+	}
+
+	return hash;
+}
+
+/*
+** Attaches a shader with the defines inserted after its #version line.
+*/
+static void MD5OpenGLProgramCacheAttachShader(
+	GLuint program,
+	GLenum type,
+	const char* shader,
+	const char* defines
+)
+{
+	const char* body = NULL;
+	char* combined = NULL;
+
+	if (!defines)
+	{
+		FxsOpenGLProgramAttachShaderWithSource(program, type, shader);
+		return;
+	}
+
+	body = strchr(shader, '\n');
+	body = body ? body + 1 : shader;
+	combined = (char*)malloc(strlen(shader) + strlen(defines) + 2);
+
+	if (!combined)
+	{
+		ERR_MSG("Warning: malloc failed. Could not attach the shader");
+		return;
+	}
+
+	memcpy(combined, shader, body - shader);
+	sprintf(combined + (body - shader), "%s\n%s", defines, body);
+	FxsOpenGLProgramAttachShaderWithSource(program, type, combined);
+	free(combined);
+}
+
+/*
+** Compiles and links the program for source. Returns 0 if it fails.
+*/
+static GLuint MD5OpenGLProgramCacheCompile(const MD5OpenGLProgramSource* source)
+{
+	GLuint program = glCreateProgram();
+	int i = 0;
+
+	MD5OpenGLProgramCacheAttachShader(
+		program, 
+		GL_VERTEX_SHADER, 
+		source->vertexShader, 
+		source->defines
+	);
+
+	if (source->fragmentShader)
+	{
+		MD5OpenGLProgramCacheAttachShader(
+			program, 
+			GL_FRAGMENT_SHADER, 
+			source->fragmentShader, 
+			source->defines
+		);
+	}
+
+	for (i = 0; i < source->numAttributes; i++)
+	{
+		glBindAttribLocation(program, i, source->attributes[i]);
+	}
+
+	if (source->fragOut)
+	{
+		glBindFragDataLocation(program, 0, source->fragOut);
+	}
+
+	if (source->numVaryings > 0)
+	{
+		glTransformFeedbackVaryings(
+			program, 
+			source->numVaryings, 
+			source->varyings, 
+			GL_INTERLEAVED_ATTRIBS
+		);
+	}
+
+	if (directory)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	if (!FxsOpenGLProgramLink(program))
+	{
+		sprintf(errMsg, "Warning: Could not link program: %s", source->name);
+		ERR_MSG(errMsg);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+/*
+** Loads the program from the binary at path. Returns 0 if there is no 
+** binary for key or the driver rejects it.
+*/
+static GLuint MD5OpenGLProgramCacheLoad(const char* path, MD5AssetHash key)
+{
+	MD5OpenGLProgramCacheHeader header;
+	FILE* file = NULL;
+	void* binary = NULL;
+	GLuint program = 0;
+	GLint status = GL_FALSE;
+
+	file = fopen(path, "rb");
+
+	if (!file)
+	{
+		return 0;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1 || 
+		header.magic != MD5_PROGRAM_CACHE_MAGIC || header.key != key)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	binary = malloc(header.length + 1);
+
+	if (!binary || fread(binary, 1, header.length, file) != header.length)
+	{
+		free(binary);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.format, binary, header.length);
+	free(binary);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	/* drivers reject binaries of other builds, e.g. after an update */
+	if (status != GL_TRUE)
+	{
+		glGetError();
+		glDeleteProgram(program);
+		stats.rejected++;
+		return 0;
+	}
+
+	return program;
+}
+
+/*
+** Writes the binary of program to path.
+*/
+static void MD5OpenGLProgramCacheStore(
+	GLuint program, 
+	const char* path, 
+	MD5AssetHash key
+)
+{
+	MD5OpenGLProgramCacheHeader header;
+	FILE* file = NULL;
+	void* binary = NULL;
+	GLint length = 0;
+	GLenum format = 0;
+	int written = 0;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0 || !(binary = malloc(length)))
+	{
+		return;
+	}
+
+	glGetProgramBinary(program, length, NULL, &format, binary);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = MD5_PROGRAM_CACHE_MAGIC;
+	header.format = format;
+	header.length = length;
+	header.key = key;
+
+	file = fopen(path, "wb");
+
+	if (file)
+	{
+		written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(binary, 1, length, file) == (size_t)length;
+		written = !fclose(file) && written;
+	}
+
+	if (!written)
+	{
+		sprintf(errMsg, "Warning: Could not write program binary: %s", path);
+		ERR_MSG(errMsg);
+	}
+
+	free(binary);
+}
+
+GLuint MD5OpenGLProgramCacheCreateProgram(const MD5OpenGLProgramSource* source)
+{
+	MD5AssetHash key = 0;
+	char* path = NULL;
+	GLuint program = 0;
+
+	if (!directory)
+	{
+		return MD5OpenGLProgramCacheCompile(source);
+	}
+
+	/* one file per variant and driver */
+	key = MD5OpenGLProgramCacheComputeKey(source);
+	path = (char*)malloc(strlen(directory) + strlen(source->name) + 32);
+
+	if (!path)
+	{
+		return MD5OpenGLProgramCacheCompile(source);
+	}
+
+	sprintf(path, "%s/%s-%016llx.bin", directory, source->name, key);
+	program = MD5OpenGLProgramCacheLoad(path, key);
+
+	if (program)
+	{
+		stats.hits++;
+		free(path);
+		return program;
+	}
+
+	program = MD5OpenGLProgramCacheCompile(source);
+
+	if (program)
+	{
+		stats.misses++;
+		MD5OpenGLProgramCacheStore(program, path, key);
+	}
+
+	free(path);
+
+	return program;
+}
+
+const MD5OpenGLProgramCacheStats* MD5OpenGLProgramCacheGetStats()
+{
+	return &stats;
+}
+
+void MD5OpenGLProgramCacheDestroy()
+{
+	free(directory);
+	directory = NULL;
+	memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,93 @@
+/*
+ * Cache of linked OpenGL program binaries
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5OPENGLPROGRAMCACHE_H
+#define MD5OPENGLPROGRAMCACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <Fxs/Opengl/glcorearb.h>
+
+/*
+** Sources and fixed state of a program variant. The attributes are bound to
+** the locations 0 .. numAttributes - 1. defines is inserted after the 
+** #version line of both shaders, so variants of the same sources differ in
+** their defines only.
+*/
+typedef struct
+{
+	const char* name; 					/* name of the cache file */
+	const char* vertexShader;
+	const char* fragmentShader; 		/* NULL for transform feedback only */
+	const char* defines; 				/* may be NULL */
+	const char* const* attributes;
+	int numAttributes;
+	const char* fragOut; 				/* bound to color number 0, may be 
+										** NULL */
+	const char* const* varyings; 		/* captured interleaved with 
+										** transform feedback */
+	int numVaryings;
+}
+MD5OpenGLProgramSource;
+
+/*
+** Statistics of the cache.
+*/
+typedef struct
+{
+	int hits; 			/* programs loaded from a binary */
+	int misses; 		/* programs compiled, since there was no usable 
+						** binary */
+	int rejected; 		/* binaries rejected by the driver, counted in 
+						** misses too */
+}
+MD5OpenGLProgramCacheStats;
+
+/*
+** Creates the cache with the directory of the binaries, which has to exist.
+** The cache is disabled (programs are always compiled) if directory is NULL
+** or the driver offers no binary formats. Returns 0 if it fails.
+*/
+int MD5OpenGLProgramCacheCreate(const char* directory);
+
+/*
+** Creates the program for source. Loads the binary cached for the sources 
+** and the driver (vendor, renderer and version), and compiles, links and 
+** caches the program if there is none or the driver rejects it. Uniforms
+** have to be set by the caller. Returns 0 if it fails.
+*/
+GLuint MD5OpenGLProgramCacheCreateProgram(const MD5OpenGLProgramSource* source);
+
+/*
+** Gets the statistics of the cache.
+*/
+const MD5OpenGLProgramCacheStats* MD5OpenGLProgramCacheGetStats();
+
+/*
+** Destroys the cache. The programs stay valid.
+*/
+void MD5OpenGLProgramCacheDestroy();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5OPENGLPROGRAMCACHE_H */
@@ -1,45 +1,780 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "MD5OpenGLRenderer.h"
 #include "MD5OpenGLMeshManager.h"
-#include <Fxs/OpenGL/Program.h>
+#include "MD5OpenGLProgramCache.h"
+#include "MD5OpenGLImpostor.h"
 
 #define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
 
 /*
-** Definition of our shaders.
+** Definition of our shaders. The matrices live in uniform blocks: the 
+** camera block is shared by all programs, the model block holds the model
+** matrices of MAX_MODELS draws, indexed by the instanced attribute 
+** modelIndex. OCTAHEDRAL_TANGENT is defined to 1 for the 16 bit position
+** formats, which store the tangent octahedral encoded.
 */ 
 #define TO_STRING(X) #X
 
+#define CAMERA_BINDING 0 		/* binding points of the uniform blocks */
+#define MODEL_BINDING 1
+
 static char* vertexShader =
 	"#version 150\n"
 TO_STRING(
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+	layout(std140) uniform Camera
+	{
+		mat4 viewProjection;
+		vec4 cameraRight;
+		vec4 cameraUp;
+	};
+
+	layout(std140) uniform Model
+	{
+		mat4 models[MAX_MODELS];
+	};
 
 	in vec3 position;
+	in vec3 boundsMin;
+	in vec3 boundsExtent;
+	in vec4 normal;
+	in vec4 tangent;
+	in uint modelIndex;
+
+	out vec3 worldNormal;
+	out vec4 worldTangent;
+
+	/* see MD5PackOctahedralSnorm8 */
+	vec3 decodeOctahedral(vec2 e)
+	{
+		vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+		if (v.z < 0.0)
+		{
+			v.xy = (1.0 - abs(e.yx))*vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+		}
+
+		return normalize(v);
+	}
 
 	void main()
 	{
-		gl_Position = projection*view*model*vec4(position, 1.0);
+		/* unpack the vertex, see MD5OpenGLMeshManagerCreateInstancedVertexArray */
+		vec3 p = boundsMin + position*boundsExtent;
+		vec4 t = tangent;
+		mat4 model = models[modelIndex];
+
+		if (OCTAHEDRAL_TANGENT != 0)
+		{
+			t = vec4(decodeOctahedral(tangent.xy), normal.w);
+		}
+
+		gl_Position = viewProjection*(model*vec4(p, 1.0));
+		worldNormal = mat3(model)*normal.xyz;
+		worldTangent = vec4(mat3(model)*t.xyz, t.w);
 	}
 );
 
 static char* fragmentShader =
 	"#version 150\n"
 TO_STRING(
+	uniform int solid;
+
+	in vec3 worldNormal;
+	in vec4 worldTangent;
+
 	out vec4 fragOut;	
 
 	void main()
 	{
-		fragOut = vec4(1.0, 0.0, 0.0, 1.0);	
+		vec3 lightDir = normalize(vec3(0.3, 1.0, 0.5));
+		float diffuse = 0.0;
+
+		if (solid == 0)
+		{
+			fragOut = vec4(1.0, 0.0, 0.0, 1.0);
+			return;
+		}
+
+		diffuse = max(dot(normalize(worldNormal), lightDir), 0.0);
+		fragOut = vec4(vec3(0.2 + 0.8*diffuse), 1.0);	
+	}
+);
+
+/*
+** Shaders of the impostors: a quad facing the camera, that covers the 
+** bounding sphere of the mesh and shows a cell of its atlas.
+*/
+static char* impostorVertexShader =
+	"#version 150\n"
+TO_STRING(
+	layout(std140) uniform Camera
+	{
+		mat4 viewProjection;
+		vec4 cameraRight;
+		vec4 cameraUp;
+	};
+
+	uniform vec4 sphere; 		/* center and radius in world space */
+	uniform vec4 cell; 			/* min. and size of the texture coordinates 
+								** of the cell */
+
+	out vec2 uv;
+
+	void main()
+	{
+		/* the corners of the strip are generated from the vertex id */
+		vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+		vec2 offset = (2.0*corner - 1.0)*sphere.w;
+		vec3 p = sphere.xyz + offset.x*cameraRight.xyz + offset.y*cameraUp.xyz;
+
+		gl_Position = viewProjection*vec4(p, 1.0);
+		uv = cell.xy + corner*cell.zw;
+	}
+);
+
+static char* impostorFragmentShader =
+	"#version 150\n"
+TO_STRING(
+	uniform sampler2D atlas;
+
+	in vec2 uv;
+
+	out vec4 fragOut;
+
+	void main()
+	{
+		vec4 color = texture(atlas, uv);
+
+		/* texels not covered by the mesh are transparent */
+		if (color.a < 0.5)
+		{
+			discard;
+		}
+
+		fragOut = vec4(color.rgb, 1.0);
 	}
 );
 
 /* the opengl program we use to render */
 static GLuint program; 
+static GLint solidLocation;
 static int wasInitialized = 0;
+static int shadingMode = FFMD5_OPENGL_RENDERER_SHADING_WIREFRAME;
+
+/* host copies of the matrices for computing the screen size of meshes */
+static float modelMatrix[16];
+static float viewMatrix[16];
+static float projectionMatrix[16];
+static float viewProjectionMatrix[16];
+static float cameraPosition[3];
+
+/* the camera block and the model matrices of the draws. Matrix i is the 
+** one of draw i, matrix MAX_DRAWS the current model matrix for draws 
+** outside of a frame, uploaded by the first such draw after it changed. 
+** The model block is bound to the range of modelsPerBlock matrices holding
+** the matrices of the draws issued.
+*/
+static GLuint cameraBuffer;
+static GLuint modelBuffer;
+static GLint modelsPerBlock;
+static int boundModelBlock = -1;
+static int isModelMatrixDirty = 0;
+static float* models;
+
+/* the draw commands of the submeshes of the draws and their instanced data
+** (the bounds of the submesh and the index of the model matrix in the 
+** block), drawn through drawArray
+*/
+static GLuint instanceBuffer;
+static GLuint drawCommandBuffer;
+static GLuint drawArray;
+static MD5OpenGLDrawElementsIndirectCommand* drawCommands;
+static MD5OpenGLInstance* drawInstances;
+static int maxDrawCommands = 0;
+
+/* impostors of meshes for animations (see 
+** FFMD5OpenGLRendererCreateImpostor), drawn instead of the meshes beyond 
+** impostorDistance from the camera
+*/
+#define MAX_IMPOSTORS 64
+
+/* the atlases are baked lit */
+#define IMPOSTOR_SHADING_MODE FFMD5_OPENGL_RENDERER_SHADING_SOLID
+
+typedef struct
+{
+	int meshId;
+	int animationId;
+	MD5OpenGLImpostor impostor;
+}
+FFMD5OpenGLRendererImpostor;
+
+static FFMD5OpenGLRendererImpostor impostors[MAX_IMPOSTORS];
+static int numImpostors = 0;
+static float impostorDistance = 0.0f;
+static GLuint impostorProgram;
+static GLint sphereLocation;
+static GLint cellLocation;
+static GLuint impostorArray; 		/* empty, the quads need no attributes */
+
+/* draws recorded between FFMD5OpenGLRendererBeginFrame and 
+** FFMD5OpenGLRendererEndFrame. They are issued after the scheduled pose 
+** updates.
+*/
+#define MAX_DRAWS 1024
+
+typedef struct
+{
+	int meshId;
+	float model[16];
+	int shadingMode;
+	int impostor; 				/* index of the impostor, -1 for the mesh */
+	int frame; 					/* frame of the impostor */
+	int slot; 					/* model matrix of the draw of the mesh */
+}
+FFMD5OpenGLRendererDraw;
+
+static FFMD5OpenGLRendererDraw draws[MAX_DRAWS];
+static int numDraws = 0;
+
+/* the draws of the meshes in a frame are issued in batches: contiguous 
+** draw commands with the same state, whose model matrices lie in the same
+** range of the model block
+*/
+typedef struct
+{
+	int shadingMode;
+	int slot; 					/* model matrix of the first draw */
+	int firstCommand;
+	int numCommands;
+}
+FFMD5OpenGLRendererBatch;
+
+static FFMD5OpenGLRendererBatch batches[MAX_DRAWS];
+static int numBatches = 0;
+static int isInFrame = 0;
+static unsigned int frameBudget = 0; 	/* skinning budget in microseconds */
+
+/*
+** Multiplies two column major 4x4 matrices: r = a*b
+*/
+static void MatrixMultiply(float* r, const float* a, const float* b)
+{
+	int i = 0, j = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			r[4*j + i] = a[i]*b[4*j] + a[4 + i]*b[4*j + 1] + 
+				a[8 + i]*b[4*j + 2] + a[12 + i]*b[4*j + 3];
+		}
+	}
+}
+
+/*
+** Computes the fraction of the screen covered by the projected bounding box
+** of mesh with the current matrices. Boxes crossing the near plane cover the
+** screen.
+*/
+static float FFMD5OpenGLRendererComputeScreenSize(const MD5OpenGLMesh* mesh)
+{
+	float mvp[16];
+	float corner[3];
+	float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+	float x = 0.0f, y = 0.0f, w = 0.0f;
+	int i = 0;
+
+	MatrixMultiply(mvp, viewProjectionMatrix, modelMatrix);
+
+	for (i = 0; i < 8; i++)
+	{
+		corner[0] = i & 1 ? mesh->max.x : mesh->min.x;
+		corner[1] = i & 2 ? mesh->max.y : mesh->min.y;
+		corner[2] = i & 4 ? mesh->max.z : mesh->min.z;
+
+		x = mvp[0]*corner[0] + mvp[4]*corner[1] + mvp[8]*corner[2] + mvp[12];
+		y = mvp[1]*corner[0] + mvp[5]*corner[1] + mvp[9]*corner[2] + mvp[13];
+		w = mvp[3]*corner[0] + mvp[7]*corner[1] + mvp[11]*corner[2] + mvp[15];
+
+		if (w <= 0.0f)
+		{
+			return 1.0f;
+		}
+
+		minX = x/w < minX ? x/w : minX;
+		minY = y/w < minY ? y/w : minY;
+		maxX = x/w > maxX ? x/w : maxX;
+		maxY = y/w > maxY ? y/w : maxY;
+	}
+
+	/* clip to the screen ([-1, 1]^2) */
+	minX = minX < -1.0f ? -1.0f : minX;
+	minY = minY < -1.0f ? -1.0f : minY;
+	maxX = maxX > 1.0f ? 1.0f : maxX;
+	maxY = maxY > 1.0f ? 1.0f : maxY;
+
+	if (maxX <= minX || maxY <= minY)
+	{
+		return 0.0f;
+	}
+
+	return 0.25f*(maxX - minX)*(maxY - minY);
+}
+
+/*
+** Binds the uniform blocks of a program to the shared binding points.
+*/
+static void FFMD5OpenGLRendererBindBlocks(GLuint prog)
+{
+	GLuint camera = glGetUniformBlockIndex(prog, "Camera");
+	GLuint model = glGetUniformBlockIndex(prog, "Model");
+
+	/* not every program uses every block */
+	if (camera != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(prog, camera, CAMERA_BINDING);
+	}
+
+	if (model != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(prog, model, MODEL_BINDING);
+	}
+}
+
+/*
+** Computes the # of model matrices in the model block: as many as fit into
+** a uniform block, with ranges aligned to the offset alignment.
+*/
+static GLint FFMD5OpenGLRendererComputeModelsPerBlock()
+{
+	GLint alignment = 0;
+	GLint size = 0;
+	GLint n = 0;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &size);
+	n = size/(GLint)(16*sizeof(float));
+	n = n < MAX_DRAWS + 1 ? n : MAX_DRAWS + 1;
+
+	if (alignment > (GLint)(16*sizeof(float)))
+	{
+		n -= n%(alignment/(GLint)(16*sizeof(float)));
+	}
+
+	return n;
+}
+
+/*
+** Creates the uniform buffers of the camera and the model matrices and the
+** buffers and vertex array of the draw commands. Returns 0 if it fails.
+*/
+static int FFMD5OpenGLRendererCreateBlocks()
+{
+	GLint numBlocks = 0;
+
+	if (modelsPerBlock <= 0)
+	{
+		return 0;
+	}
+
+	/* the range of the last block lies within the buffer */
+	numBlocks = (MAX_DRAWS + modelsPerBlock)/modelsPerBlock;
+	models = (float*)calloc(MAX_DRAWS + 1, 16*sizeof(float));
+
+	if (!models)
+	{
+		return 0;
+	}
+
+	glGenBuffers(1, &cameraBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, 24*sizeof(float), NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &modelBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, modelBuffer);
+	
+	glBufferData(
+		GL_UNIFORM_BUFFER, 
+		numBlocks*modelsPerBlock*16*sizeof(float), 
+		NULL, 
+		GL_STREAM_DRAW
+	);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer);
+	boundModelBlock = -1;
+
+	glGenBuffers(1, &instanceBuffer);
+	glGenBuffers(1, &drawCommandBuffer);
+	drawArray = MD5OpenGLMeshManagerCreateInstancedVertexArray(instanceBuffer);
+
+	return drawArray != 0;
+}
+
+/*
+** Makes room for n draw commands. Returns 0 if it fails.
+*/
+static int FFMD5OpenGLRendererReserveDrawCommands(int n)
+{
+	MD5OpenGLDrawElementsIndirectCommand* commands = NULL;
+	MD5OpenGLInstance* instances = NULL;
+
+	if (n <= maxDrawCommands)
+	{
+		return 1;
+	}
+
+	n = n < 2*maxDrawCommands ? 2*maxDrawCommands : n;
+	commands = (MD5OpenGLDrawElementsIndirectCommand*)realloc(
+			drawCommands, 
+			n*sizeof(MD5OpenGLDrawElementsIndirectCommand)
+		);
+
+	if (!commands)
+	{
+		return 0;
+	}
+
+	drawCommands = commands;
+	instances = (MD5OpenGLInstance*)realloc(
+			drawInstances, 
+			n*sizeof(MD5OpenGLInstance)
+		);
+
+	if (!instances)
+	{
+		return 0;
+	}
+
+	drawInstances = instances;
+	maxDrawCommands = n;
+
+	return 1;
+}
+
+/*
+** Writes the draw commands of the mesh with meshId, drawn with the model
+** matrix slot, from command first on. Returns the # of commands, 0 if it 
+** fails.
+*/
+static int FFMD5OpenGLRendererWriteDrawCommands(int meshId, int slot, int first)
+{
+	const MD5OpenGLMesh* mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+
+	if (!mesh || !FFMD5OpenGLRendererReserveDrawCommands(first + mesh->numSubMeshes))
+	{
+		ERR_MSG("Warning: malloc failed. Could not draw the mesh");
+		return 0;
+	}
+
+	return MD5OpenGLMeshManagerGetDrawCommands(
+		meshId,
+		slot%modelsPerBlock,
+		first,
+		drawCommands + first,
+		drawInstances + first
+	);
+}
+
+/*
+** Uploads the first n draw commands and their instanced data.
+*/
+static void FFMD5OpenGLRendererUploadDrawCommands(int n)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	
+	glBufferData(
+		GL_ARRAY_BUFFER, 
+		n*sizeof(MD5OpenGLInstance), 
+		drawInstances, 
+		GL_STREAM_DRAW
+	);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+	
+	glBufferData(
+		GL_DRAW_INDIRECT_BUFFER, 
+		n*sizeof(MD5OpenGLDrawElementsIndirectCommand), 
+		drawCommands, 
+		GL_STREAM_DRAW
+	);
+}
+
+/*
+** Binds the range of the model block holding the model matrix slot, if it
+** is not bound yet.
+*/
+static void FFMD5OpenGLRendererBindModels(int slot)
+{
+	if (slot/modelsPerBlock == boundModelBlock)
+	{
+		return;
+	}
+
+	boundModelBlock = slot/modelsPerBlock;
+
+	glBindBufferRange(
+		GL_UNIFORM_BUFFER, 
+		MODEL_BINDING, 
+		modelBuffer, 
+		boundModelBlock*modelsPerBlock*16*sizeof(float), 
+		modelsPerBlock*16*sizeof(float)
+	);
+}
+
+/*
+** Sets the state for issuing uploaded draw commands with the current 
+** shading mode.
+*/
+static void FFMD5OpenGLRendererSetDrawState()
+{
+	glUseProgram(program);
+    
+    glPolygonMode(
+        GL_FRONT_AND_BACK, 
+        shadingMode == FFMD5_OPENGL_RENDERER_SHADING_SOLID ? GL_FILL : GL_LINE
+    );
+
+	glBindVertexArray(drawArray);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+}
+
+/*
+** Issues the uploaded draw commands first .. first + n - 1 with a single 
+** call.
+*/
+static void FFMD5OpenGLRendererDrawCommands(int first, int n)
+{
+	glMultiDrawElementsIndirect(
+		GL_TRIANGLES, 
+		GL_UNSIGNED_INT,
+		(const void*)(first*sizeof(MD5OpenGLDrawElementsIndirectCommand)), 
+		n, 
+		0
+	);
+}
+
+/*
+** Draws the current pose of the mesh with meshId with the current model 
+** matrix.
+*/
+static void FFMD5OpenGLRendererDrawMesh(int meshId)
+{
+	int n = FFMD5OpenGLRendererWriteDrawCommands(meshId, MAX_DRAWS, 0);
+
+	if (n > 0)
+	{
+		if (isModelMatrixDirty)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, modelBuffer);
+
+			glBufferSubData(
+				GL_UNIFORM_BUFFER, 
+				MAX_DRAWS*sizeof(modelMatrix), 
+				sizeof(modelMatrix), 
+				modelMatrix
+			);
+
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			isModelMatrixDirty = 0;
+		}
+
+		FFMD5OpenGLRendererUploadDrawCommands(n);
+		FFMD5OpenGLRendererSetDrawState();
+		FFMD5OpenGLRendererBindModels(MAX_DRAWS);
+		FFMD5OpenGLRendererDrawCommands(0, n);
+	}
+}
+
+/*
+** Writes the model matrices and the draw commands of the recorded draws of
+** the meshes ordered by their state and groups them into batches. Returns
+** the # of commands.
+*/
+static int FFMD5OpenGLRendererBatchDraws()
+{
+	FFMD5OpenGLRendererBatch* batch = NULL;
+	int numSlots = 0;
+	int numCommands = 0;
+	int n = 0;
+	int i = 0, j = 0;
+
+	numBatches = 0;
+
+	for (i = 0; i < numDraws; i++)
+	{
+		draws[i].slot = -1;
+	}
+
+	for (i = 0; i < numDraws; i++)
+	{
+		if (draws[i].impostor >= 0 || draws[i].slot >= 0)
+		{
+			continue;
+		}
+
+		/* gather the draws with the state of draw i */
+		for (j = i; j < numDraws; j++)
+		{
+			if (draws[j].impostor >= 0 || draws[j].slot >= 0 || 
+				draws[j].shadingMode != draws[i].shadingMode)
+			{
+				continue;
+			}
+
+			draws[j].slot = numSlots++;
+			memcpy(models + 16*draws[j].slot, draws[j].model, 16*sizeof(float));
+			
+			n = FFMD5OpenGLRendererWriteDrawCommands(
+					draws[j].meshId, 
+					draws[j].slot, 
+					numCommands
+				);
+
+			if (n == 0)
+			{
+				continue;
+			}
+
+			if (!batch || batch->shadingMode != draws[j].shadingMode ||
+				batch->slot/modelsPerBlock != draws[j].slot/modelsPerBlock)
+			{
+				batch = &batches[numBatches++];
+				batch->shadingMode = draws[j].shadingMode;
+				batch->slot = draws[j].slot;
+				batch->firstCommand = numCommands;
+				batch->numCommands = 0;
+			}
+
+			batch->numCommands += n;
+			numCommands += n;
+		}
+	}
+
+	return numCommands;
+}
+
+/*
+** Creates the program and the vertex array of the impostors. Returns 0 if it
+** fails.
+*/
+static int FFMD5OpenGLRendererCreateImpostorProgram()
+{
+	MD5OpenGLProgramSource source;
+
+	memset(&source, 0, sizeof(source));
+	source.name = "impostor";
+	source.vertexShader = impostorVertexShader;
+	source.fragmentShader = impostorFragmentShader;
+	source.fragOut = "fragOut";
+	impostorProgram = MD5OpenGLProgramCacheCreateProgram(&source);
+
+	if (!impostorProgram)
+	{
+		return 0;
+	}
+
+	FFMD5OpenGLRendererBindBlocks(impostorProgram);
+	sphereLocation = glGetUniformLocation(impostorProgram, "sphere");
+	cellLocation = glGetUniformLocation(impostorProgram, "cell");
+	glUseProgram(impostorProgram);
+	glUniform1i(glGetUniformLocation(impostorProgram, "atlas"), 0);
+	glGenVertexArrays(1, &impostorArray);
+
+	return GL_NO_ERROR == glGetError();
+}
+
+/*
+** Gets the index of the impostor drawn instead of the mesh with meshId in
+** animationId with the current model matrix, -1 if the mesh is drawn.
+*/
+static int FFMD5OpenGLRendererSelectImpostor(int meshId, int animationId)
+{
+	const MD5OpenGLImpostor* impostor = NULL;
+	float d[3];
+	int i = 0;
+
+	if (impostorDistance <= 0.0f)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < numImpostors; i++)
+	{
+		if (impostors[i].meshId != meshId || impostors[i].animationId != animationId)
+		{
+			continue;
+		}
+
+		/* distance of the center of the impostor */
+		impostor = &impostors[i].impostor;
+		d[0] = modelMatrix[0]*impostor->center.x + modelMatrix[4]*impostor->center.y + 
+			modelMatrix[8]*impostor->center.z + modelMatrix[12] - cameraPosition[0];
+		d[1] = modelMatrix[1]*impostor->center.x + modelMatrix[5]*impostor->center.y + 
+			modelMatrix[9]*impostor->center.z + modelMatrix[13] - cameraPosition[1];
+		d[2] = modelMatrix[2]*impostor->center.x + modelMatrix[6]*impostor->center.y + 
+			modelMatrix[10]*impostor->center.z + modelMatrix[14] - cameraPosition[2];
+
+		if (d[0]*d[0] + d[1]*d[1] + d[2]*d[2] > impostorDistance*impostorDistance)
+		{
+			return i;
+		}
+
+		return -1;
+	}
+
+	return -1;
+}
+
+/*
+** Draws frame of impostor with model as a quad facing the camera. The model
+** matrix may scale uniformly.
+*/
+static void FFMD5OpenGLRendererDrawImpostor(
+	const MD5OpenGLImpostor* impostor, 
+	const float* model,
+	int frame
+)
+{
+	float sphere[4];
+	float direction[3];
+	float cell[4];
+	float d[3];
+	int i = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		sphere[i] = model[i]*impostor->center.x + model[4 + i]*impostor->center.y +
+			model[8 + i]*impostor->center.z + model[12 + i];
+		d[i] = cameraPosition[i] - sphere[i];
+	}
+
+	sphere[3] = impostor->radius*
+		sqrtf(model[0]*model[0] + model[1]*model[1] + model[2]*model[2]);
+
+	/* the direction to the camera in the space of the mesh selects the 
+	** view
+	*/
+	for (i = 0; i < 3; i++)
+	{
+		direction[i] = model[4*i]*d[0] + model[4*i + 1]*d[1] + model[4*i + 2]*d[2];
+	}
+
+	MD5OpenGLImpostorGetCell(impostor, frame, direction, cell);
+
+	glUseProgram(impostorProgram);
+	glUniform4fv(sphereLocation, 1, sphere);
+	glUniform4fv(cellLocation, 1, cell);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, impostor->atlas);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBindVertexArray(impostorArray);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
 int FFMD5OpenGLRendererCreate(const char* filename)
 {
@@ -49,6 +784,16 @@ int FFMD5OpenGLRendererCreate(const char* filename)
             0.0, 0.0, 1.0, 0.0,
             0.0, 0.0, 0.0, 1.0
         };
+	const char* attributes[] = {
+			"position",
+			"boundsMin",
+			"boundsExtent",
+			"normal",
+			"tangent",
+			"modelIndex"
+		};
+	MD5OpenGLProgramSource source;
+	char defines[64];
 
 	if (wasInitialized)
 	{
@@ -61,35 +806,55 @@ int FFMD5OpenGLRendererCreate(const char* filename)
 		return 0;
 	}
 
-	/* create our program */		
-	program = glCreateProgram();
-	
-	FxsOpenGLProgramAttachShaderWithSource(
-		program, 
-		GL_VERTEX_SHADER, 
-		vertexShader
-	);
-	
-	FxsOpenGLProgramAttachShaderWithSource(
-		program, 
-		GL_FRAGMENT_SHADER, 
-		fragmentShader
+	/* create our program, the attributes are bound to the locations of
+	** the vertex arena (see MD5OpenGLMeshManagerCreateInstancedVertexArray) 
+	*/		
+	memset(&source, 0, sizeof(source));
+	source.name = "renderer";
+	source.vertexShader = vertexShader;
+	source.fragmentShader = fragmentShader;
+	source.attributes = attributes;
+	source.numAttributes = 6;
+	source.fragOut = "fragOut";
+	modelsPerBlock = FFMD5OpenGLRendererComputeModelsPerBlock();
+
+	sprintf(
+		defines, 
+		"#define OCTAHEDRAL_TANGENT %d\n#define MAX_MODELS %d", 
+		MD5OpenGLMeshManagerGetPositionFormat() != MD5_POSITION_FORMAT_FLOAT,
+		modelsPerBlock > 0 ? modelsPerBlock : 1
 	);
 
-	glBindAttribLocation(program, 0, "position");
-	glBindFragDataLocation(program, 0, "fragOut"); 
-	FxsOpenGLProgramLink(program);
+	source.defines = defines;
+	program = MD5OpenGLProgramCacheCreateProgram(&source);
 
-	if (GL_NO_ERROR != glGetError())
+	if (!program || GL_NO_ERROR != glGetError())
 	{
 		ERR_MSG("Detected OpenGL error.")
 		return 0;
 	}
+
+	/* look up the uniforms once, the hot path only uses their locations */
+	FFMD5OpenGLRendererBindBlocks(program);
+	solidLocation = glGetUniformLocation(program, "solid");
+
+	if (!FFMD5OpenGLRendererCreateBlocks() || GL_NO_ERROR != glGetError())
+	{
+		ERR_MSG("Warning: Could not create the uniform buffers");
+		return 0;
+	}
+
+	if (!FFMD5OpenGLRendererCreateImpostorProgram())
+	{
+		ERR_MSG("Warning: Could not create the impostor program");
+		return 0;
+	}
     
     /* initialize our program */
     FFMD5OpenGLRendererSetModelMatrix(identity);
     FFMD5OpenGLRendererSetViewMatrix(identity);
     FFMD5OpenGLRendererSetProjectionMatrix(identity);
+    FFMD5OpenGLRendererSetShadingMode(FFMD5_OPENGL_RENDERER_SHADING_WIREFRAME);
     
 	wasInitialized = 1;
 
@@ -98,13 +863,43 @@ int FFMD5OpenGLRendererCreate(const char* filename)
 
 void FFMD5OpenGLRendererDestroy()
 {
+	int i = 0;
+
 	if (!wasInitialized)
 	{
 		ERR_MSG("FFMD5OpenGLRenderer is not initialized"); 
 		return;
 	}
 
+	for (i = 0; i < numImpostors; i++)
+	{
+		MD5OpenGLImpostorDestroy(&impostors[i].impostor);
+	}
+
+	numImpostors = 0;
+	glDeleteProgram(impostorProgram);
+	glDeleteVertexArrays(1, &impostorArray);
+	impostorProgram = 0;
+	impostorArray = 0;
+
 	glDeleteProgram(program);
+	glDeleteBuffers(1, &cameraBuffer);
+	glDeleteBuffers(1, &modelBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &drawCommandBuffer);
+	glDeleteVertexArrays(1, &drawArray);
+	free(models);
+	free(drawCommands);
+	free(drawInstances);
+	models = NULL;
+	drawCommands = NULL;
+	drawInstances = NULL;
+	maxDrawCommands = 0;
+	cameraBuffer = 0;
+	modelBuffer = 0;
+	instanceBuffer = 0;
+	drawCommandBuffer = 0;
+	drawArray = 0;
 
 	MD5OpenGLMeshManagerDestroy();
 }
@@ -112,50 +907,498 @@ void FFMD5OpenGLRendererDestroy()
 int FFMD5OpenGLRendererRender(int meshId, int animationId, int frame)
 {
 	const MD5OpenGLMesh* mesh = NULL;
-	int i = 0;
+	int impostor = -1;
+	int requested = 0;
+	int poseAnimationId = -1;
+	int poseFrame = -1;
 
     if (!wasInitialized)
     {
         return 0;
     }
     
+    mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+
+	if (!mesh)
+	{
+		return 0;
+	}
+
+	impostor = FFMD5OpenGLRendererSelectImpostor(meshId, animationId);
+
+	/* within a frame the pose update is scheduled and the draw recorded,
+	** unless the mesh is drawn in another pose in the frame (impostors need
+	** no pose)
+	*/
+	if (isInFrame && numDraws < MAX_DRAWS)
+	{
+		requested = 1;
+
+		if (impostor < 0)
+		{
+			requested = MD5OpenGLMeshManagerRequestMeshPose(
+					meshId,
+					animationId,
+					frame,
+					FFMD5OpenGLRendererComputeScreenSize(mesh)
+				);
+		}
+
+		if (requested == 0)
+		{
+			return 0;
+		}
+	}
+
+	if (requested > 0)
+	{
+		draws[numDraws].meshId = meshId;
+		memcpy(draws[numDraws].model, modelMatrix, sizeof(modelMatrix));
+		draws[numDraws].shadingMode = shadingMode;
+		draws[numDraws].impostor = impostor;
+		draws[numDraws].frame = frame;
+		numDraws++;
+
+		return 1;
+	}
+
+	if (impostor >= 0)
+	{
+		FFMD5OpenGLRendererDrawImpostor(
+			&impostors[impostor].impostor, 
+			modelMatrix, 
+			frame
+		);
+
+		return 1;
+	}
+
+	if (isInFrame && requested == 0)
+	{
+		ERR_MSG("Warning: Too many draws in the frame. Drawing the last pose");
+		FFMD5OpenGLRendererDrawMesh(meshId);
+		return 1;
+	}
+
+	/* the recorded draws of a mesh drawn in another pose in the frame keep
+	** the pose it had 
+	*/
+	poseAnimationId = mesh->poseAnimationId;
+	poseFrame = mesh->poseFrame;
+    
     MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
         meshId,
         animationId,
         frame
     );
     
-    mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+	FFMD5OpenGLRendererDrawMesh(meshId);
 
-	if (!mesh)
+	if (requested < 0 && poseAnimationId >= 0)
 	{
-		return 0;
+		MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+			meshId,
+			poseAnimationId,
+			poseFrame
+		);
 	}
-    
-	glUseProgram(program);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	
-	for (i = 0; i < mesh->numSubMeshes; i++)
+
+	return 1;
+}
+
+int FFMD5OpenGLRendererBeginFrame(unsigned int budgetMicroseconds)
+{
+	if (!wasInitialized || isInFrame)
 	{
-		glBindVertexArray(mesh->subMeshes[i].vao);
-		glDrawArrays(GL_TRIANGLES, 0, mesh->subMeshes[i].numPositions);
+		ERR_MSG("Warning: FFMD5OpenGLRenderer is not initialized or already in a frame"); 
+		return 0;
 	}
 
+	isInFrame = 1;
+	numDraws = 0;
+	frameBudget = budgetMicroseconds;
+
 	return 1;
 }
 
+int FFMD5OpenGLRendererEndFrame()
+{
+	int mode = shadingMode;
+	int numDeferred = 0;
+	int numCommands = 0;
+	int i = 0;
+
+	if (!isInFrame)
+	{
+		ERR_MSG("Warning: FFMD5OpenGLRendererBeginFrame was not called"); 
+		return -1;
+	}
+
+	isInFrame = 0;
+
+	/* with workers the poses are skinned while the draws are issued */
+	if (MD5OpenGLMeshManagerGetNumWorkers() > 0)
+	{
+		numDeferred = MD5OpenGLMeshManagerSubmitRequestedPoses(frameBudget);
+	}
+	else
+	{
+		numDeferred = MD5OpenGLMeshManagerUpdateRequestedPoses(frameBudget);
+	}
+
+	/* upload the model matrices and the draw commands of all draws at once,
+	** set the state once per batch and issue each batch with a single call 
+	*/
+	numCommands = FFMD5OpenGLRendererBatchDraws();
+
+	if (numCommands > 0)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, modelBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, numDraws*16*sizeof(float), models);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		FFMD5OpenGLRendererUploadDrawCommands(numCommands);
+	}
+
+	for (i = 0; i < numBatches; i++)
+	{
+		if (i == 0 || batches[i].shadingMode != batches[i - 1].shadingMode)
+		{
+			if (batches[i].shadingMode != shadingMode)
+			{
+				FFMD5OpenGLRendererSetShadingMode(batches[i].shadingMode);
+			}
+
+			FFMD5OpenGLRendererSetDrawState();
+		}
+
+		FFMD5OpenGLRendererBindModels(batches[i].slot);
+		
+		FFMD5OpenGLRendererDrawCommands(
+			batches[i].firstCommand, 
+			batches[i].numCommands
+		);
+	}
+
+	for (i = 0; i < numDraws; i++)
+	{
+		if (draws[i].impostor >= 0)
+		{
+			FFMD5OpenGLRendererDrawImpostor(
+				&impostors[draws[i].impostor].impostor, 
+				draws[i].model, 
+				draws[i].frame
+			);
+		}
+	}
+
+	if (mode != shadingMode)
+	{
+		FFMD5OpenGLRendererSetShadingMode(mode);
+	}
+
+	numDraws = 0;
+
+	return numDeferred;
+}
+
+/*
+** Uploads the product of the projection and the view matrix and the right
+** and up axis of the camera (for the impostors) to the camera block.
+*/
+static void FFMD5OpenGLRendererUpdateCamera()
+{
+    float camera[24];
+    int i = 0;
+
+    MatrixMultiply(viewProjectionMatrix, projectionMatrix, viewMatrix);
+    memcpy(camera, viewProjectionMatrix, sizeof(viewProjectionMatrix));
+
+    /* the axes are the rows of the rotation of the view matrix, the 
+    ** position is the inverse rotation of its negated translation 
+    */
+    for (i = 0; i < 3; i++)
+    {
+        camera[16 + i] = viewMatrix[4*i];
+        camera[20 + i] = viewMatrix[4*i + 1];
+        cameraPosition[i] = -(viewMatrix[4*i]*viewMatrix[12] + 
+            viewMatrix[4*i + 1]*viewMatrix[13] + viewMatrix[4*i + 2]*viewMatrix[14]);
+    }
+
+    camera[19] = 0.0f;
+    camera[23] = 0.0f;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera), camera);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 void FFMD5OpenGLRendererSetModelMatrix(const float* model)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "model", model, GL_FALSE);
+    memcpy(modelMatrix, model, sizeof(modelMatrix));
+
+    /* recorded draws upload their matrices in FFMD5OpenGLRendererEndFrame,
+    ** draws outside of a frame upload it in FFMD5OpenGLRendererDrawMesh
+    */
+    isModelMatrixDirty = 1;
 }
 
 void FFMD5OpenGLRendererSetViewMatrix(const float* view)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "view", view, GL_FALSE);
+    memcpy(viewMatrix, view, sizeof(viewMatrix));
+    FFMD5OpenGLRendererUpdateCamera();
 }
 
 void FFMD5OpenGLRendererSetProjectionMatrix(const float* projection)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "projection", projection, GL_FALSE);
+    memcpy(projectionMatrix, projection, sizeof(projectionMatrix));
+    FFMD5OpenGLRendererUpdateCamera();
+}
+
+
+void FFMD5OpenGLRendererSetShadingMode(int mode)
+{
+    shadingMode = mode;
+    glUseProgram(program);
+    glUniform1i(solidLocation, mode == FFMD5_OPENGL_RENDERER_SHADING_SOLID);
+}
+
+/*
+** Draws a cell of the impostor atlas of the mesh and animation ids in data.
+*/
+static void FFMD5OpenGLRendererDrawImpostorCell(
+    void* data, 
+    int frame, 
+    const float* view, 
+    const float* projection
+)
+{
+    const int* ids = (const int*)data;
+
+    MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(ids[0], ids[1], frame);
+    FFMD5OpenGLRendererSetViewMatrix(view);
+    FFMD5OpenGLRendererSetProjectionMatrix(projection);
+    FFMD5OpenGLRendererDrawMesh(ids[0]);
+}
+
+/*
+** Bakes the atlas of impostor for the mesh in the animation and reads it
+** back to image if it is not NULL. The sampled poses are framed by the 
+** union of their bounding boxes. The pose of the mesh is restored. Returns 
+** 0 if it fails.
+*/
+static int FFMD5OpenGLRendererBakeImpostor(
+    int meshId, 
+    int animationId, 
+    MD5OpenGLImpostor* impostor, 
+    unsigned char* image
+)
+{
+    float identity[16] = {
+            1.0, 0.0, 0.0, 0.0,
+            0.0, 1.0, 0.0, 0.0,
+            0.0, 0.0, 1.0, 0.0,
+            0.0, 0.0, 0.0, 1.0
+        };
+    const MD5OpenGLMesh* mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+    int ids[2];
+    float model[16];
+    float view[16];
+    float projection[16];
+    FxsVector3 min, max;
+    FxsVector3 poseMin, poseMax;
+    int poseAnimationId = mesh->poseAnimationId;
+    int poseFrame = mesh->poseFrame;
+    int mode = shadingMode;
+    int result = 1;
+    int f = 0;
+
+    FxsVector3MakeZero(&min);
+    FxsVector3MakeZero(&max);
+
+    for (f = 0; f < impostor->numFrames && result; f += impostor->frameStep)
+    {
+        result = MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+                meshId, 
+                animationId, 
+                f
+            ) && MD5OpenGLMeshManagerGetPoseBounds(meshId, &poseMin, &poseMax);
+
+        if (f == 0)
+        {
+            min = poseMin;
+            max = poseMax;
+            continue;
+        }
+
+        min.x = poseMin.x < min.x ? poseMin.x : min.x;
+        min.y = poseMin.y < min.y ? poseMin.y : min.y;
+        min.z = poseMin.z < min.z ? poseMin.z : min.z;
+        max.x = poseMax.x > max.x ? poseMax.x : max.x;
+        max.y = poseMax.y > max.y ? poseMax.y : max.y;
+        max.z = poseMax.z > max.z ? poseMax.z : max.z;
+    }
+
+    if (!result)
+    {
+        ERR_MSG("Warning: Could not compute the bounds of the impostor");
+    }
+
+    impostor->center.x = 0.5f*(min.x + max.x);
+    impostor->center.y = 0.5f*(min.y + max.y);
+    impostor->center.z = 0.5f*(min.z + max.z);
+    impostor->radius = 0.5f*sqrtf((max.x - min.x)*(max.x - min.x) + 
+        (max.y - min.y)*(max.y - min.y) + (max.z - min.z)*(max.z - min.z));
+
+    /* bake lit in the space of the mesh and restore the state */
+    memcpy(model, modelMatrix, sizeof(model));
+    memcpy(view, viewMatrix, sizeof(view));
+    memcpy(projection, projectionMatrix, sizeof(projection));
+    FFMD5OpenGLRendererSetModelMatrix(identity);
+    FFMD5OpenGLRendererSetShadingMode(IMPOSTOR_SHADING_MODE);
+
+    ids[0] = meshId;
+    ids[1] = animationId;
+
+    result = result && MD5OpenGLImpostorBake(
+        impostor, 
+        FFMD5OpenGLRendererDrawImpostorCell, 
+        ids, 
+        image
+    );
+
+    if (poseAnimationId >= 0)
+    {
+        MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+            meshId, 
+            poseAnimationId, 
+            poseFrame
+        );
+    }
+    else
+    {
+        MD5OpenGLMeshManagerResetMeshPose(meshId);
+    }
+
+    FFMD5OpenGLRendererSetModelMatrix(model);
+    FFMD5OpenGLRendererSetViewMatrix(view);
+    FFMD5OpenGLRendererSetProjectionMatrix(projection);
+    FFMD5OpenGLRendererSetShadingMode(mode);
+
+    return result;
+}
+
+int FFMD5OpenGLRendererCreateImpostor(
+    int meshId, 
+    int animationId, 
+    int numAngles, 
+    int cellSize, 
+    const char* cacheDirectory
+)
+{
+    FFMD5OpenGLRendererImpostor* impostor = NULL;
+    const MD5OpenGLMesh* mesh = NULL;
+    MD5AssetHash animationHash = 0;
+    MD5AssetHash key = MD5_ASSET_HASH_BASIS;
+    MD5PositionFormat positionFormat = MD5OpenGLMeshManagerGetPositionFormat();
+    int mode = IMPOSTOR_SHADING_MODE;
+    unsigned char* image = NULL;
+    char* path = NULL;
+    int numFrames = 0;
+    int result = 0;
+    int i = 0;
+
+    if (!wasInitialized || isInFrame)
+    {
+        ERR_MSG("Warning: FFMD5OpenGLRenderer is not initialized or in a frame"); 
+        return 0;
+    }
+
+    mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+
+    if (!mesh || !MD5OpenGLMeshManagerGetAnimationInfo(animationId, &numFrames, &animationHash))
+    {
+        ERR_MSG("Warning: Mesh or animation of the impostor not found");
+        return 0;
+    }
+
+    for (i = 0; i < numImpostors; i++)
+    {
+        if (impostors[i].meshId == meshId && impostors[i].animationId == animationId)
+        {
+            ERR_MSG("Warning: The impostor already exists");
+            return 0;
+        }
+    }
+
+    if (numImpostors >= MAX_IMPOSTORS)
+    {
+        ERR_MSG("Warning: Too many impostors");
+        return 0;
+    }
+
+    impostor = &impostors[numImpostors];
+
+    if (!MD5OpenGLImpostorCreate(&impostor->impostor, numFrames, numAngles, cellSize))
+    {
+        return 0;
+    }
+
+    /* the atlas is cached per content of the files, the state it is baked 
+    ** with and the layout 
+    */
+    if (cacheDirectory)
+    {
+        key = MD5AssetHashBytes(key, &mesh->hash, sizeof(MD5AssetHash));
+        key = MD5AssetHashBytes(key, &mesh->skinningMethod, sizeof(MD5SkinningMethod));
+        key = MD5AssetHashBytes(key, &positionFormat, sizeof(MD5PositionFormat));
+        key = MD5AssetHashBytes(key, &mode, sizeof(int));
+        key = MD5AssetHashBytes(key, &animationHash, sizeof(MD5AssetHash));
+        key = MD5AssetHashBytes(key, &numAngles, sizeof(int));
+        key = MD5AssetHashBytes(key, &cellSize, sizeof(int));
+        key = MD5AssetHashBytes(key, &impostor->impostor.frameStep, sizeof(int));
+
+        path = (char*)malloc(strlen(cacheDirectory) + 32);
+
+        if (path)
+        {
+            sprintf(path, "%s/impostor-%016llx.tga", cacheDirectory, key);
+            result = MD5OpenGLImpostorLoad(&impostor->impostor, path);
+            image = result ? NULL : 
+                (unsigned char*)malloc(4*(size_t)impostor->impostor.width*impostor->impostor.height);
+        }
+    }
+
+    if (!result)
+    {
+        result = FFMD5OpenGLRendererBakeImpostor(
+            meshId, 
+            animationId, 
+            &impostor->impostor, 
+            image
+        );
+
+        if (result && image)
+        {
+            MD5OpenGLImpostorStore(&impostor->impostor, path, image);
+        }
+    }
+
+    free(image);
+    free(path);
+
+    if (!result)
+    {
+        return 0;
+    }
+
+    impostor->meshId = meshId;
+    impostor->animationId = animationId;
+    numImpostors++;
+
+    return 1;
 }
 
+void FFMD5OpenGLRendererSetImpostorDistance(float distance)
+{
+    impostorDistance = distance;
+}
@@ -32,11 +32,19 @@ extern "C"
 **
 **      {
 **
+**          "positionFormat" : "unorm16",
+**
+**          "workerThreads" : 2,
+**
+**          "programCache" : "cache",
+**
 **          "meshes" :
 **          [
 **              {
 **                  "id" : 0,
-**                  "filename" : "hellknight.md5mesh"
+**                  "filename" : "hellknight.md5mesh",
+**                  "skinning" : "dualQuaternion",
+**                  "gpuSkinning" : true
 **              }
 **          ],
 **
@@ -44,28 +52,98 @@ extern "C"
 **          [
 **              {
 **                  "id" : 0,
-**                  "filename" : "idle2.md5anim"
+**                  "filename" : "idle2.md5anim",
+**                  "compress" : true
 **              }
 **          ]
 **
 **      }
+**
+** "positionFormat" is optional and selects the format of the skinned 
+** positions uploaded each frame: "float" (default), "unorm16" (normalized to
+** the bounding box of the submesh) or "half".
+**
+** "workerThreads" is optional and sets the # of threads skinning the meshes
+** requested in a frame (see FFMD5OpenGLRendererEndFrame), default is 0.
+**
+** "programCache" is optional and names an existing directory, where the
+** linked programs are cached per driver. Later starts load the binaries
+** instead of compiling the shaders, binaries the driver rejects (e.g. after
+** an update) are recompiled.
+**
+** "skinning" is optional and selects the skinning method of a mesh: 
+** "linear" (default) or "dualQuaternion".
+**
+** "gpuSkinning" is optional and skins the mesh on the gpu with transform 
+** feedback. Only the 4 largest weights of each vertex are used. It needs the 
+** "float" position format, otherwise the mesh is skinned on the host.
+**
+** "compress" is optional and stores the animation compressed (quantized 
+** keys, key frame reduction). The max. error of the joints is set with the 
+** optional "translationTolerance" (per component of the translation) and 
+** "rotationTolerance" (radians), both default to 0.001.
+**
+** Ids may refer to the same file. Meshes and animations whose files have the
+** same content and that are loaded with the same options are loaded once
+** and share their data, only the pose is kept per mesh id.
 */ 
 int FFMD5OpenGLRendererCreate(const char* filename);
 
 /*
 ** Renders the mesh with id; uses the frame of animation with animation id.
+** The mesh is only skinned if the pose changed since it was last rendered,
+** so rendering it several times per frame (e.g. for multiple passes) is
+** cheap.
 */ 
 int FFMD5OpenGLRendererRender(int meshId, int animationId, int frame);
 
 /*
-** Sets the model matrix. Initially it is the identity.
+** Begins a frame with a budget of (wall) time in microseconds for skinning.
+**
+** Until FFMD5OpenGLRendererEndFrame, FFMD5OpenGLRendererRender only requests
+** the pose of the mesh and records the draw with the current model matrix
+** and shading mode. Returns 0 if it fails.
+**
+** The draws of a mesh in a frame share its vertices, so a mesh has one pose
+** per frame: the pose of its first draw. A draw of the mesh with another 
+** pose is not recorded but posed, drawn and posed back immediately, outside
+** the budget.
+** For different poses list the file once per pose in the config, the 
+** meshes share their immutable data.
+*/
+int FFMD5OpenGLRendererBeginFrame(unsigned int budgetMicroseconds);
+
+/*
+** Ends the frame. Performs the requested pose updates within the budget,
+** ordered by the screen size of the meshes and how long their updates were
+** deferred, and issues the recorded draws. Meshes whose updates do not fit
+** into the budget are drawn with their last pose and updated in later 
+** frames. Returns the # of deferred updates, -1 if it fails.
+**
+** The draws of the meshes are issued grouped by their shading mode, with 
+** one multi draw per shading mode (and range of model matrices, see 
+** FFMD5OpenGLRendererSetModelMatrix). The impostors are drawn after the
+** meshes.
+**
+** With "workerThreads" the meshes skinned on the host are skinned by the 
+** workers while the draws are issued and show their pose one frame later.
+*/
+int FFMD5OpenGLRendererEndFrame();
+
+/*
+** Sets the model matrix. Initially it is the identity. The model matrices
+** of the draws recorded in a frame are uploaded at once by 
+** FFMD5OpenGLRendererEndFrame. The model block holds as many matrices as
+** fit into a uniform block of the implementation (1024 with 64 KB blocks).
 ** @param model a float array with 16 elements, representing and opengl 
 **              model matrix (gl => column major)
 */
 void FFMD5OpenGLRendererSetModelMatrix(const float* model);
 
 /*
-** Sets the view matrix. Initially it is the identity.
+** Sets the view matrix. Initially it is the identity. The view and the 
+** projection matrix are uploaded premultiplied to the camera block shared by
+** the programs of the renderer.
 ** @param view a float array with 16 elements, representing and opengl
 **             view matrix (gl => column major)
 
@@ -79,6 +157,47 @@ void FFMD5OpenGLRendererSetViewMatrix(const float* view);
 */
 void FFMD5OpenGLRendererSetProjectionMatrix(const float* projection);
 
+#define FFMD5_OPENGL_RENDERER_SHADING_WIREFRAME 0 	/* unlit wireframe */
+#define FFMD5_OPENGL_RENDERER_SHADING_SOLID 1 		/* filled, lit with the
+													** skinned normals */
+
+/*
+** Sets the shading mode. Initially it is FFMD5_OPENGL_RENDERER_SHADING_WIREFRAME.
+*/
+void FFMD5OpenGLRendererSetShadingMode(int mode);
+
+/*
+** Creates an impostor of the mesh with meshId for the animation with 
+** animationId: a texture atlas with the mesh rendered lit from numAngles 
+** directions around its z axis, in cells of cellSize^2 texels, for each 
+** frame of the animation (every n-th frame if they do not fit into a 
+** texture). Beyond the impostor distance the mesh is drawn in that animation
+** as a quad facing the camera, that shows the cell of the frame and the 
+** view closest to the camera. The mesh is not skinned then and the shading
+** mode does not apply.
+**
+** If cacheDirectory is not NULL (an existing directory), the atlas is loaded
+** from a TGA file there, keyed by the content of the files, the skinning
+** method, the position format, the shading and the layout, or baked and 
+** written there. Baking renders offscreen and needs no window,
+** so the atlases can be baked ahead of time, e.g. on a software renderer.
+** Has to be called outside of a frame. Returns 0 if it fails.
+*/
+int FFMD5OpenGLRendererCreateImpostor(
+    int meshId, 
+    int animationId, 
+    int numAngles, 
+    int cellSize, 
+    const char* cacheDirectory
+);
+
+/*
+** Sets the distance from the camera beyond which meshes with an impostor for
+** the rendered animation are drawn as impostors. Initially it is 0, which 
+** disables the impostors.
+*/
+void FFMD5OpenGLRendererSetImpostorDistance(float distance);
+
 /*
 ** Destroys the renderer.
 */ 
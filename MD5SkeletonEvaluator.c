@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <math.h>
+#include "MD5SkeletonEvaluator.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MD5_SKELETON_EVALUATOR_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#define NUM_KEY_ARRAYS 18 	/* # of arrays of MD5CompressedKeys */
+
+/*
+** Gets the # of joints rounded up to whole groups of 4.
+*/
+static int MD5SkeletonEvaluatorRoundJoints(int numJoints)
+{
+	return (numJoints + 3) & ~3;
+}
+
+/*
+** Allocates the arrays of keys for numJoints joints from scratch.
+*/
+static void MD5SkeletonEvaluatorAllocKeys(
+	MD5CompressedKeys* keys, 
+	MD5Arena* scratch, 
+	int numJoints
+)
+{
+	size_t size = MD5SkeletonEvaluatorRoundJoints(numJoints)*sizeof(float);
+	int i = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		keys->rotationA[i] = (float*)MD5ArenaCalloc(scratch, size);
+		keys->rotationB[i] = (float*)MD5ArenaCalloc(scratch, size);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		keys->translationA[i] = (float*)MD5ArenaCalloc(scratch, size);
+		keys->translationB[i] = (float*)MD5ArenaCalloc(scratch, size);
+		keys->translationT[i] = (float*)MD5ArenaCalloc(scratch, size);
+	}
+
+	keys->rotationT = (float*)MD5ArenaCalloc(scratch, size);
+}
+
+/*
+** Interpolates the joints begin .. end - 1 of keys into poses at first.
+*/
+static void MD5SkeletonEvaluatorBlend(
+	const MD5CompressedKeys* keys,
+	int begin,
+	int end,
+	const MD5SkeletonPoses* poses,
+	int first
+)
+{
+	float q[4];
+	float t = 0.0f, s = 0.0f, dot = 0.0f, len = 0.0f;
+	int i = 0, j = 0;
+
+	for (j = begin; j < end; j++)
+	{
+		/* nlerp on the shorter arc, same as the decoder */
+		t = keys->rotationT[j];
+		dot = 0.0f;
+
+		for (i = 0; i < 4; i++)
+		{
+			dot += keys->rotationA[i][j]*keys->rotationB[i][j];
+		}
+
+		s = dot < 0.0f ? -t : t;
+		len = 0.0f;
+
+		for (i = 0; i < 4; i++)
+		{
+			q[i] = (1.0f - t)*keys->rotationA[i][j] + s*keys->rotationB[i][j];
+			len += q[i]*q[i];
+		}
+
+		len = 1.0f/sqrtf(len);
+
+		for (i = 0; i < 4; i++)
+		{
+			poses->rotations[i][first + j] = q[i]*len;
+		}
+
+		for (i = 0; i < 3; i++)
+		{
+			t = keys->translationT[i][j];
+			poses->translations[i][first + j] = (1.0f - t)*keys->translationA[i][j] + 
+				t*keys->translationB[i][j];
+		}
+	}
+}
+
+#ifdef MD5_SKELETON_EVALUATOR_SSE
+/*
+** Same as MD5SkeletonEvaluatorBlend for the joints 0 .. 4*numGroups - 1,
+** 4 joints at a time.
+*/
+static void MD5SkeletonEvaluatorBlendSSE(
+	const MD5CompressedKeys* keys,
+	int numGroups,
+	const MD5SkeletonPoses* poses,
+	int first
+)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 a[4], b[4], q[4];
+	__m128 t, s, u, dot, len;
+	int i = 0, j = 0;
+
+	for (j = 0; j < 4*numGroups; j += 4)
+	{
+		t = _mm_loadu_ps(&keys->rotationT[j]);
+		u = _mm_sub_ps(one, t);
+		dot = _mm_setzero_ps();
+
+		for (i = 0; i < 4; i++)
+		{
+			a[i] = _mm_loadu_ps(&keys->rotationA[i][j]);
+			b[i] = _mm_loadu_ps(&keys->rotationB[i][j]);
+			dot = _mm_add_ps(dot, _mm_mul_ps(a[i], b[i]));
+		}
+
+		/* negate t for the lanes on the longer arc */
+		s = _mm_xor_ps(t, _mm_and_ps(sign, _mm_cmplt_ps(dot, _mm_setzero_ps())));
+		len = _mm_setzero_ps();
+
+		for (i = 0; i < 4; i++)
+		{
+			q[i] = _mm_add_ps(_mm_mul_ps(u, a[i]), _mm_mul_ps(s, b[i]));
+			len = _mm_add_ps(len, _mm_mul_ps(q[i], q[i]));
+		}
+
+		len = _mm_div_ps(one, _mm_sqrt_ps(len));
+
+		for (i = 0; i < 4; i++)
+		{
+			_mm_storeu_ps(&poses->rotations[i][first + j], _mm_mul_ps(q[i], len));
+		}
+
+		for (i = 0; i < 3; i++)
+		{
+			t = _mm_loadu_ps(&keys->translationT[i][j]);
+			u = _mm_sub_ps(one, t);
+			_mm_storeu_ps(
+				&poses->translations[i][first + j],
+				_mm_add_ps(
+					_mm_mul_ps(u, _mm_loadu_ps(&keys->translationA[i][j])),
+					_mm_mul_ps(t, _mm_loadu_ps(&keys->translationB[i][j]))
+				)
+			);
+		}
+	}
+}
+#endif
+
+/*
+** Evaluates the index-th batch of queries. Runs on a worker thread.
+*/
+static void MD5SkeletonEvaluatorJob(void* data, int index, int worker)
+{
+	MD5SkeletonEvaluator* evaluator = (MD5SkeletonEvaluator*)data;
+	MD5Arena* scratch = &evaluator->scratch[worker];
+	const MD5SkeletonQuery* query = NULL;
+	MD5CompressedKeys keys;
+	int begin = index*MD5_SKELETON_EVALUATOR_BATCH;
+	int end = begin + MD5_SKELETON_EVALUATOR_BATCH;
+	int numJoints = 0;
+	int done = 0;
+	int i = 0;
+
+	end = end < evaluator->numQueries ? end : evaluator->numQueries;
+
+	for (i = begin; i < end; i++)
+	{
+		query = &evaluator->queries[i];
+		numJoints = query->joints ? query->numJoints : query->animation->numJoints;
+
+		MD5ArenaReset(scratch);
+		MD5SkeletonEvaluatorAllocKeys(&keys, scratch, numJoints);
+
+		MD5CompressedAnimationUnpackKeys(
+			query->animation,
+			query->frame,
+			query->joints,
+			numJoints,
+			&keys
+		);
+
+		done = 0;
+
+#ifdef MD5_SKELETON_EVALUATOR_SSE
+		MD5SkeletonEvaluatorBlendSSE(&keys, numJoints/4, evaluator->poses, query->first);
+		done = numJoints & ~3;
+#endif
+
+		MD5SkeletonEvaluatorBlend(
+			&keys, 
+			done, 
+			numJoints, 
+			evaluator->poses, 
+			query->first
+		);
+	}
+}
+
+int MD5SkeletonEvaluatorCreate(
+	MD5SkeletonEvaluator* evaluator,
+	int numThreads,
+	int maxJoints
+)
+{
+	size_t size = 0;
+	int numArenas = 0;
+	int i = 0;
+
+	memset(evaluator, 0, sizeof(MD5SkeletonEvaluator));
+	evaluator->numThreads = numThreads > 0 ? numThreads : 0;
+	evaluator->maxJoints = maxJoints;
+
+	/* without threads the calling thread uses the first arena */
+	numArenas = evaluator->numThreads > 0 ? evaluator->numThreads : 1;
+	evaluator->scratch = (MD5Arena*)calloc(numArenas, sizeof(MD5Arena));
+
+	if (!evaluator->scratch)
+	{
+		return 0;
+	}
+
+	size = NUM_KEY_ARRAYS*MD5ArenaSizeForAllocation(
+			MD5SkeletonEvaluatorRoundJoints(maxJoints)*sizeof(float)
+		);
+
+	for (i = 0; i < numArenas; i++)
+	{
+		if (!MD5ArenaCreate(&evaluator->scratch[i], size))
+		{
+			MD5SkeletonEvaluatorDestroy(evaluator);
+			return 0;
+		}
+	}
+
+	if (evaluator->numThreads > 0 && 
+		!MD5WorkerPoolCreate(&evaluator->pool, evaluator->numThreads))
+	{
+		MD5SkeletonEvaluatorDestroy(evaluator);
+		return 0;
+	}
+
+	return 1;
+}
+
+int MD5SkeletonEvaluatorEvaluate(
+	MD5SkeletonEvaluator* evaluator,
+	const MD5SkeletonQuery* queries,
+	int numQueries,
+	const MD5SkeletonPoses* poses
+)
+{
+	const MD5SkeletonQuery* query = NULL;
+	int numBatches = 0;
+	int numJoints = 0;
+	int i = 0, j = 0;
+
+	/* check all queries first, the workers cannot report errors */
+	for (i = 0; i < numQueries; i++)
+	{
+		query = &queries[i];
+
+		if (!query->animation || query->first < 0)
+		{
+			return 0;
+		}
+
+		numJoints = query->joints ? query->numJoints : query->animation->numJoints;
+
+		if (numJoints < 0 || numJoints > evaluator->maxJoints)
+		{
+			return 0;
+		}
+
+		for (j = 0; query->joints && j < numJoints; j++)
+		{
+			if (query->joints[j] < 0 || query->joints[j] >= query->animation->numJoints)
+			{
+				return 0;
+			}
+		}
+	}
+
+	evaluator->queries = queries;
+	evaluator->numQueries = numQueries;
+	evaluator->poses = poses;
+	numBatches = (numQueries + MD5_SKELETON_EVALUATOR_BATCH - 1)/
+		MD5_SKELETON_EVALUATOR_BATCH;
+
+	if (evaluator->numThreads > 0)
+	{
+		MD5WorkerPoolRun(&evaluator->pool, MD5SkeletonEvaluatorJob, evaluator, numBatches);
+		MD5WorkerPoolWait(&evaluator->pool);
+	}
+	else
+	{
+		for (i = 0; i < numBatches; i++)
+		{
+			MD5SkeletonEvaluatorJob(evaluator, i, 0);
+		}
+	}
+
+	return 1;
+}
+
+void MD5SkeletonEvaluatorDestroy(MD5SkeletonEvaluator* evaluator)
+{
+	int i = 0;
+
+	if (evaluator->numThreads > 0)
+	{
+		MD5WorkerPoolDestroy(&evaluator->pool);
+	}
+
+	for (i = 0; evaluator->scratch && 
+		i < (evaluator->numThreads > 0 ? evaluator->numThreads : 1); i++)
+	{
+		MD5ArenaDestroy(&evaluator->scratch[i]);
+	}
+
+	free(evaluator->scratch);
+	memset(evaluator, 0, sizeof(MD5SkeletonEvaluator));
+}
@@ -0,0 +1,121 @@
+/*
+ * Batch evaluation of md5 skeletons without opengl
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5SKELETONEVALUATOR_H
+#define MD5SKELETONEVALUATOR_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Arena.h"
+#include "MD5CompressedAnimation.h"
+#include "MD5WorkerPool.h"
+
+#define MD5_SKELETON_EVALUATOR_BATCH 32 	/* # of queries per job */
+
+/*
+** A query for the object space joint transforms of a compressed animation 
+** at a point in time. 
+**
+** Only compressed animations can be queried. Their joint transforms were 
+** baked with the skeleton of the md5mesh they were compressed with (see 
+** MD5CompressedAnimationCreateWithAnimation), so the poses are those of 
+** that skeleton. To query an animation for another skeleton, compress it 
+** with an md5mesh of that skeleton. Uncompressed animations are not 
+** supported: Fxs samples them only by posing an md5mesh, which changes 
+** the md5mesh and is limited to whole frames.
+*/
+typedef struct
+{
+	const MD5CompressedAnimation* animation;
+	float frame; 				/* fractional frame, i.e. the time in seconds
+								** times the frame rate of the md5anim. 
+								** Clamped to 0 .. numFrames - 1 */
+	const int* joints; 			/* joints to evaluate (e.g. the ones with 
+								** hitboxes), NULL for all joints */
+	int numJoints; 				/* # of joints to evaluate */
+	int first; 					/* index of the first joint of the query in 
+								** the poses */
+}
+MD5SkeletonQuery;
+
+/*
+** Caller provided structure of arrays that receives the joints of the 
+** queries. The rotations are unit quaternions (x, y, z, w), the 
+** translations are the joint positions.
+*/
+typedef struct
+{
+	float* rotations[4];
+	float* translations[3];
+}
+MD5SkeletonPoses;
+
+/*
+** Evaluates batches of queries on a pool of worker threads. The keys of the
+** joints are unpacked per query and interpolated 4 joints at a time with 
+** SSE where available.
+*/
+typedef struct
+{
+	MD5WorkerPool pool;
+	int numThreads; 			/* 0 evaluates on the calling thread */
+	int maxJoints; 				/* max. # of joints of a query */
+	MD5Arena* scratch; 			/* unpacked keys, one per thread */
+
+	/* the current batch */
+	const MD5SkeletonQuery* queries;
+	int numQueries;
+	const MD5SkeletonPoses* poses;
+}
+MD5SkeletonEvaluator;
+
+/*
+** Creates an evaluator with numThreads worker threads for queries of up to 
+** maxJoints joints. Returns 0 if it fails.
+*/
+int MD5SkeletonEvaluatorCreate(
+	MD5SkeletonEvaluator* evaluator,
+	int numThreads,
+	int maxJoints
+);
+
+/*
+** Evaluates the queries into poses and returns when all are done. The 
+** animations must not be changed or destroyed meanwhile, they may be 
+** evaluated by several evaluators at once. Returns 0 if a query is invalid, 
+** no query is evaluated then.
+*/
+int MD5SkeletonEvaluatorEvaluate(
+	MD5SkeletonEvaluator* evaluator,
+	const MD5SkeletonQuery* queries,
+	int numQueries,
+	const MD5SkeletonPoses* poses
+);
+
+/*
+** Destroys an evaluator.
+*/
+void MD5SkeletonEvaluatorDestroy(MD5SkeletonEvaluator* evaluator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5SKELETONEVALUATOR_H */
@@ -0,0 +1,726 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <math.h>
+#include "MD5Skinning.h"
+#include <Fxs/Math/Vector4.h>
+
+/* 
+** Normalizes v. Returns 0 if v is too short to be normalized.
+*/
+static int Normalize(FxsVector3* v)
+{
+	float len = sqrtf(v->x*v->x + v->y*v->y + v->z*v->z);
+
+	if (len < 1e-12f)
+	{
+		return 0;
+	}
+
+	v->x /= len;
+	v->y /= len;
+	v->z /= len;
+
+	return 1;
+}
+
+void MD5JointMatrixMakeWithMatrix4(MD5JointMatrix* jm, FxsMatrix4* transform)
+{
+	FxsVector3 origin = {0.0f, 0.0f, 0.0f};
+	FxsVector3 axes[3] = {
+			{1.0f, 0.0f, 0.0f},
+			{0.0f, 1.0f, 0.0f},
+			{0.0f, 0.0f, 1.0f}
+		};
+	FxsVector4 t, c;
+	int i = 0;
+
+	/* we only rely on FxsMatrix4MultiplyVector3 and not on the memory layout
+	** of FxsMatrix4. Transforming the origin yields the translation, 
+	** transforming the axes yields the columns of the rotation.
+	*/
+	FxsMatrix4MultiplyVector3(&t, transform, &origin);
+
+	for (i = 0; i < 3; i++)
+	{
+		FxsMatrix4MultiplyVector3(&c, transform, &axes[i]);
+		jm->m[i] = c.x - t.x;
+		jm->m[4 + i] = c.y - t.y;
+		jm->m[8 + i] = c.z - t.z;
+	}
+
+	jm->m[3] = t.x;
+	jm->m[7] = t.y;
+	jm->m[11] = t.z;
+}
+
+void MD5JointMatrixMakeWithRotationTranslation(
+	MD5JointMatrix* jm, 
+	const float* q, 
+	const float* t
+)
+{
+	float x = q[0], y = q[1], z = q[2], w = q[3];
+
+	jm->m[0] = 1.0f - 2.0f*(y*y + z*z);
+	jm->m[1] = 2.0f*(x*y - w*z);
+	jm->m[2] = 2.0f*(x*z + w*y);
+	jm->m[3] = t[0];
+	jm->m[4] = 2.0f*(x*y + w*z);
+	jm->m[5] = 1.0f - 2.0f*(x*x + z*z);
+	jm->m[6] = 2.0f*(y*z - w*x);
+	jm->m[7] = t[1];
+	jm->m[8] = 2.0f*(x*z - w*y);
+	jm->m[9] = 2.0f*(y*z + w*x);
+	jm->m[10] = 1.0f - 2.0f*(x*x + y*y);
+	jm->m[11] = t[2];
+}
+
+void MD5SkinningComputePalette(
+	MD5JointMatrix* palette,
+	FxsMD5Mesh* md5mesh,
+	int numJoints
+)
+{
+	int i = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		MD5JointMatrixMakeWithMatrix4(
+			&palette[i], 
+			&md5mesh->currentPose.joints[i].transform
+		);
+	}
+}
+
+void MD5SkinningComputeInverseBindMatrices(
+	MD5JointMatrix* inverseBindMatrices,
+	const MD5JointMatrix* bindPalette,
+	int numJoints
+)
+{
+	const float* m = NULL;
+	float* r = NULL;
+	int i = 0, j = 0;
+
+	/* the inverse of (R, t) is (R^T, -R^T*t) */
+	for (i = 0; i < numJoints; i++)
+	{
+		m = bindPalette[i].m;
+		r = inverseBindMatrices[i].m;
+
+		for (j = 0; j < 3; j++)
+		{
+			r[4*j + 0] = m[j];
+			r[4*j + 1] = m[4 + j];
+			r[4*j + 2] = m[8 + j];
+			r[4*j + 3] = -(m[j]*m[3] + m[4 + j]*m[7] + m[8 + j]*m[11]);
+		}
+	}
+}
+
+void MD5SkinningComputeSkinningMatrices(
+	MD5JointMatrix* skinningMatrices,
+	const MD5JointMatrix* palette,
+	const MD5JointMatrix* inverseBindMatrices,
+	int numJoints
+)
+{
+	const float* a = NULL;
+	const float* b = NULL;
+	float* r = NULL;
+	int i = 0, j = 0, k = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		a = palette[i].m;
+		b = inverseBindMatrices[i].m;
+		r = skinningMatrices[i].m;
+
+		for (j = 0; j < 3; j++)
+		{
+			for (k = 0; k < 4; k++)
+			{
+				r[4*j + k] = a[4*j]*b[k] + a[4*j + 1]*b[4 + k] + a[4*j + 2]*b[8 + k];
+			}
+
+			r[4*j + 3] += a[4*j + 3];
+		}
+	}
+}
+
+void MD5SkinningSkinPosition(
+	FxsVector3* position,
+	const FxsMD5SubMesh* md5submesh,
+	const FxsMD5Vertex* vertex,
+	const MD5JointMatrix* palette
+)
+{
+	const FxsMD5Weight* weight = NULL;
+	const float* m = NULL;
+	float x = 0.0f, y = 0.0f, z = 0.0f;
+	int l = 0;
+
+	/* add up all weight positions to compute the final vertex position */
+	for (l = 0; l < vertex->numWeights; l++)
+	{
+		weight = &md5submesh->weights[vertex->weightId + l];
+		m = palette[weight->jointId].m;
+
+		x += weight->value*(m[0]*weight->position.x + m[1]*weight->position.y 
+			+ m[2]*weight->position.z + m[3]);
+		y += weight->value*(m[4]*weight->position.x + m[5]*weight->position.y 
+			+ m[6]*weight->position.z + m[7]);
+		z += weight->value*(m[8]*weight->position.x + m[9]*weight->position.y 
+			+ m[10]*weight->position.z + m[11]);
+	}
+
+	position->x = x;
+	position->y = y;
+	position->z = z;
+}
+
+void MD5QuaternionMakeWithJointMatrix(float* q, const MD5JointMatrix* jm)
+{
+	const float* m = jm->m;
+	float trace = m[0] + m[5] + m[10];
+	float s = 0.0f;
+
+	if (trace > 0.0f)
+	{
+		s = 0.5f/sqrtf(trace + 1.0f);
+		q[3] = 0.25f/s;
+		q[0] = (m[9] - m[6])*s;
+		q[1] = (m[2] - m[8])*s;
+		q[2] = (m[4] - m[1])*s;
+	}
+	else if (m[0] > m[5] && m[0] > m[10])
+	{
+		s = 2.0f*sqrtf(1.0f + m[0] - m[5] - m[10]);
+		q[3] = (m[9] - m[6])/s;
+		q[0] = 0.25f*s;
+		q[1] = (m[1] + m[4])/s;
+		q[2] = (m[2] + m[8])/s;
+	}
+	else if (m[5] > m[10])
+	{
+		s = 2.0f*sqrtf(1.0f + m[5] - m[0] - m[10]);
+		q[3] = (m[2] - m[8])/s;
+		q[0] = (m[1] + m[4])/s;
+		q[1] = 0.25f*s;
+		q[2] = (m[6] + m[9])/s;
+	}
+	else
+	{
+		s = 2.0f*sqrtf(1.0f + m[10] - m[0] - m[5]);
+		q[3] = (m[4] - m[1])/s;
+		q[0] = (m[2] + m[8])/s;
+		q[1] = (m[6] + m[9])/s;
+		q[2] = 0.25f*s;
+	}
+}
+
+/*
+** Product of the quaternions a and b.
+*/
+static void QuaternionMultiply(float* q, const float* a, const float* b)
+{
+	float r[4];
+
+	r[0] = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+	r[1] = a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0];
+	r[2] = a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3];
+	r[3] = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+
+	memcpy(q, r, sizeof(r));
+}
+
+/*
+** Product of the dual quaternions a and b: (ra, da)*(rb, db) = 
+** (ra*rb, ra*db + da*rb).
+*/
+static void DualQuaternionMultiply(
+	MD5DualQuaternion* dq, 
+	const MD5DualQuaternion* a, 
+	const MD5DualQuaternion* b
+)
+{
+	float c[4], d[4];
+	int i = 0;
+
+	QuaternionMultiply(c, a->real, b->dual);
+	QuaternionMultiply(d, a->dual, b->real);
+	QuaternionMultiply(dq->real, a->real, b->real);
+
+	for (i = 0; i < 4; i++)
+	{
+		dq->dual[i] = c[i] + d[i];
+	}
+}
+
+void MD5DualQuaternionMakeWithRotationTranslation(
+	MD5DualQuaternion* dq, 
+	const float* q, 
+	const float* t
+)
+{
+	float h[4];
+
+	/* dual = 0.5*t*real, with t the translation as a pure quaternion */
+	memcpy(dq->real, q, sizeof(dq->real));
+	h[0] = 0.5f*t[0];
+	h[1] = 0.5f*t[1];
+	h[2] = 0.5f*t[2];
+	h[3] = 0.0f;
+	QuaternionMultiply(dq->dual, h, dq->real);
+}
+
+void MD5DualQuaternionMakeWithJointMatrix(
+	MD5DualQuaternion* dq, 
+	const MD5JointMatrix* jm
+)
+{
+	float q[4];
+	float t[3];
+
+	MD5QuaternionMakeWithJointMatrix(q, jm);
+	t[0] = jm->m[3];
+	t[1] = jm->m[7];
+	t[2] = jm->m[11];
+	MD5DualQuaternionMakeWithRotationTranslation(dq, q, t);
+}
+
+void MD5SkinningComputeInverseBindPose(
+	MD5DualQuaternion* inverseBindPose,
+	const MD5JointMatrix* bindPalette,
+	int numJoints
+)
+{
+	int i = 0, j = 0;
+
+	/* the inverse of a unit dual quaternion is its (quaternion) conjugate */
+	for (i = 0; i < numJoints; i++)
+	{
+		MD5DualQuaternionMakeWithJointMatrix(&inverseBindPose[i], &bindPalette[i]);
+
+		for (j = 0; j < 3; j++)
+		{
+			inverseBindPose[i].real[j] = -inverseBindPose[i].real[j];
+			inverseBindPose[i].dual[j] = -inverseBindPose[i].dual[j];
+		}
+	}
+}
+
+void MD5SkinningComputeDualQuaternionPalette(
+	MD5DualQuaternion* dqPalette,
+	const MD5JointMatrix* palette,
+	const MD5DualQuaternion* inverseBindPose,
+	int numJoints
+)
+{
+	MD5DualQuaternion dq;
+	int i = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		MD5DualQuaternionMakeWithJointMatrix(&dq, &palette[i]);
+		DualQuaternionMultiply(&dqPalette[i], &dq, &inverseBindPose[i]);
+	}
+}
+
+void MD5SkinningComputeDualQuaternionPaletteWithJoints(
+	MD5DualQuaternion* dqPalette,
+	const float* rotations,
+	const float* translations,
+	const MD5DualQuaternion* inverseBindPose,
+	int numJoints
+)
+{
+	MD5DualQuaternion dq;
+	int i = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		MD5DualQuaternionMakeWithRotationTranslation(
+			&dq, 
+			&rotations[4*i], 
+			&translations[3*i]
+		);
+		DualQuaternionMultiply(&dqPalette[i], &dq, &inverseBindPose[i]);
+	}
+}
+
+int MD5SkinningComputeBindFrames(
+	FxsVector3* bindPositions,
+	FxsVector3* bindNormals,
+	FxsVector3* bindTangents,
+	float* handedness,
+	const FxsMD5SubMesh* md5submesh,
+	int numVertices,
+	const MD5JointMatrix* palette
+)
+{
+	FxsVector3* bitangents = NULL;
+	const FxsVector3* positions = bindPositions;
+	FxsVector3* normals = bindNormals;
+	FxsVector3* tangents = bindTangents;
+	const unsigned int* ids = NULL;
+	FxsVector3 e1, e2, n, t, b;
+	float du1, dv1, du2, dv2, r, d;
+	int i = 0, k = 0;
+
+	bitangents = (FxsVector3*)calloc(numVertices + 1, sizeof(FxsVector3));
+
+	if (!bitangents)
+	{
+		return 0;
+	}
+
+	memset(normals, 0, numVertices*sizeof(FxsVector3));
+	memset(tangents, 0, numVertices*sizeof(FxsVector3));
+
+	for (i = 0; i < numVertices; i++)
+	{
+		MD5SkinningSkinPosition(
+			&bindPositions[i], 
+			md5submesh, 
+			&md5submesh->vertices[i], 
+			palette
+		);
+	}
+
+	/* accumulate the area weighted face normals and the tangents of the 
+	** faces at their vertices 
+	*/
+	for (i = 0; i < md5submesh->numFaces; i++)
+	{
+		ids = &md5submesh->faces[i].v1;
+
+		e1.x = positions[ids[1]].x - positions[ids[0]].x;
+		e1.y = positions[ids[1]].y - positions[ids[0]].y;
+		e1.z = positions[ids[1]].z - positions[ids[0]].z;
+		e2.x = positions[ids[2]].x - positions[ids[0]].x;
+		e2.y = positions[ids[2]].y - positions[ids[0]].y;
+		e2.z = positions[ids[2]].z - positions[ids[0]].z;
+
+		n.x = e1.y*e2.z - e1.z*e2.y;
+		n.y = e1.z*e2.x - e1.x*e2.z;
+		n.z = e1.x*e2.y - e1.y*e2.x;
+
+		du1 = md5submesh->vertices[ids[1]].texCoords.x - md5submesh->vertices[ids[0]].texCoords.x;
+		dv1 = md5submesh->vertices[ids[1]].texCoords.y - md5submesh->vertices[ids[0]].texCoords.y;
+		du2 = md5submesh->vertices[ids[2]].texCoords.x - md5submesh->vertices[ids[0]].texCoords.x;
+		dv2 = md5submesh->vertices[ids[2]].texCoords.y - md5submesh->vertices[ids[0]].texCoords.y;
+		d = du1*dv2 - du2*dv1;
+		r = fabsf(d) > 1e-12f ? 1.0f/d : 0.0f;
+
+		t.x = (dv2*e1.x - dv1*e2.x)*r;
+		t.y = (dv2*e1.y - dv1*e2.y)*r;
+		t.z = (dv2*e1.z - dv1*e2.z)*r;
+		b.x = (du1*e2.x - du2*e1.x)*r;
+		b.y = (du1*e2.y - du2*e1.y)*r;
+		b.z = (du1*e2.z - du2*e1.z)*r;
+
+		for (k = 0; k < 3; k++)
+		{
+			normals[ids[k]].x += n.x;
+			normals[ids[k]].y += n.y;
+			normals[ids[k]].z += n.z;
+			tangents[ids[k]].x += t.x;
+			tangents[ids[k]].y += t.y;
+			tangents[ids[k]].z += t.z;
+			bitangents[ids[k]].x += b.x;
+			bitangents[ids[k]].y += b.y;
+			bitangents[ids[k]].z += b.z;
+		}
+	}
+
+	for (i = 0; i < numVertices; i++)
+	{
+		n = normals[i];
+		t = tangents[i];
+
+		if (!Normalize(&n))
+		{
+			n.x = 0.0f;
+			n.y = 0.0f;
+			n.z = 1.0f;
+		}
+
+		/* Gram-Schmidt orthogonalize, fall back to any perpendicular vector
+		** for degenerate texture coordinates.
+		*/
+		d = n.x*t.x + n.y*t.y + n.z*t.z;
+		t.x -= d*n.x;
+		t.y -= d*n.y;
+		t.z -= d*n.z;
+
+		if (!Normalize(&t))
+		{
+			t.x = fabsf(n.x) < 0.9f ? 0.0f : -n.y;
+			t.y = fabsf(n.x) < 0.9f ? -n.z : n.x;
+			t.z = fabsf(n.x) < 0.9f ? n.y : 0.0f;
+			Normalize(&t);
+		}
+
+		/* handedness: sign of (n x t) . b */
+		b = bitangents[i];
+		d = (n.y*t.z - n.z*t.y)*b.x + (n.z*t.x - n.x*t.z)*b.y + 
+			(n.x*t.y - n.y*t.x)*b.z;
+		handedness[i] = d < 0.0f ? -1.0f : 1.0f;
+
+		normals[i] = n;
+		tangents[i] = t;
+	}
+
+	free(bitangents);
+
+	return 1;
+}
+
+void MD5SkinningComputeWeightFrames(
+	FxsVector3* weightNormals,
+	FxsVector3* weightTangents,
+	const FxsMD5SubMesh* md5submesh,
+	int numVertices,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const MD5JointMatrix* palette
+)
+{
+	const FxsMD5Vertex* vertex = NULL;
+	const FxsMD5Weight* weight = NULL;
+	const FxsVector3* n = NULL;
+	const FxsVector3* t = NULL;
+	const float* m = NULL;
+	int i = 0, l = 0;
+
+	for (i = 0; i < numVertices; i++)
+	{
+		vertex = &md5submesh->vertices[i];
+		n = &bindNormals[i];
+		t = &bindTangents[i];
+
+		/* rotate into the space of each joint (the inverse of a rotation is
+		** its transpose) 
+		*/
+		for (l = 0; l < vertex->numWeights; l++)
+		{
+			weight = &md5submesh->weights[vertex->weightId + l];
+			m = palette[weight->jointId].m;
+
+			weightNormals[vertex->weightId + l].x = m[0]*n->x + m[4]*n->y + m[8]*n->z;
+			weightNormals[vertex->weightId + l].y = m[1]*n->x + m[5]*n->y + m[9]*n->z;
+			weightNormals[vertex->weightId + l].z = m[2]*n->x + m[6]*n->y + m[10]*n->z;
+			weightTangents[vertex->weightId + l].x = m[0]*t->x + m[4]*t->y + m[8]*t->z;
+			weightTangents[vertex->weightId + l].y = m[1]*t->x + m[5]*t->y + m[9]*t->z;
+			weightTangents[vertex->weightId + l].z = m[2]*t->x + m[6]*t->y + m[10]*t->z;
+		}
+	}
+}
+
+void MD5SkinningSkinVertex(
+	MD5Vertex* skinned,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* weightNormals,
+	const FxsVector3* weightTangents,
+	const float* handedness,
+	const MD5JointMatrix* palette
+)
+{
+	const FxsMD5Vertex* vertex = &md5submesh->vertices[vertexId];
+	const FxsMD5Weight* weight = NULL;
+	const FxsVector3* wn = NULL;
+	const FxsVector3* wt = NULL;
+	const float* m = NULL;
+	FxsVector3 p = {0.0f, 0.0f, 0.0f};
+	FxsVector3 n = {0.0f, 0.0f, 0.0f};
+	FxsVector3 t = {0.0f, 0.0f, 0.0f};
+	float w = 0.0f;
+	int l = 0;
+
+	for (l = 0; l < vertex->numWeights; l++)
+	{
+		weight = &md5submesh->weights[vertex->weightId + l];
+		wn = &weightNormals[vertex->weightId + l];
+		wt = &weightTangents[vertex->weightId + l];
+		m = palette[weight->jointId].m;
+		w = weight->value;
+
+		p.x += w*(m[0]*weight->position.x + m[1]*weight->position.y 
+			+ m[2]*weight->position.z + m[3]);
+		p.y += w*(m[4]*weight->position.x + m[5]*weight->position.y 
+			+ m[6]*weight->position.z + m[7]);
+		p.z += w*(m[8]*weight->position.x + m[9]*weight->position.y 
+			+ m[10]*weight->position.z + m[11]);
+
+		/* normals and tangents are only rotated */
+		n.x += w*(m[0]*wn->x + m[1]*wn->y + m[2]*wn->z);
+		n.y += w*(m[4]*wn->x + m[5]*wn->y + m[6]*wn->z);
+		n.z += w*(m[8]*wn->x + m[9]*wn->y + m[10]*wn->z);
+
+		t.x += w*(m[0]*wt->x + m[1]*wt->y + m[2]*wt->z);
+		t.y += w*(m[4]*wt->x + m[5]*wt->y + m[6]*wt->z);
+		t.z += w*(m[8]*wt->x + m[9]*wt->y + m[10]*wt->z);
+	}
+
+	Normalize(&n);
+	Normalize(&t);
+
+	skinned->position = p;
+	skinned->normal = MD5PackSnorm1010102(n.x, n.y, n.z, 0.0f);
+	skinned->tangent = MD5PackSnorm1010102(t.x, t.y, t.z, handedness[vertexId]);
+}
+
+/*
+** Rotates v by the unit quaternion q.
+*/
+static void QuaternionRotate(FxsVector3* r, const float* q, const FxsVector3* v)
+{
+	/* v + 2*q.xyz x (q.xyz x v + q.w*v) */
+	float cx = q[1]*v->z - q[2]*v->y + q[3]*v->x;
+	float cy = q[2]*v->x - q[0]*v->z + q[3]*v->y;
+	float cz = q[0]*v->y - q[1]*v->x + q[3]*v->z;
+
+	r->x = v->x + 2.0f*(q[1]*cz - q[2]*cy);
+	r->y = v->y + 2.0f*(q[2]*cx - q[0]*cz);
+	r->z = v->z + 2.0f*(q[0]*cy - q[1]*cx);
+}
+
+void MD5SkinningSkinVertexDualQuaternion(
+	MD5Vertex* skinned,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* bindPositions,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const float* handedness,
+	const MD5DualQuaternion* dqPalette
+)
+{
+	const FxsMD5Vertex* vertex = &md5submesh->vertices[vertexId];
+	const FxsMD5Weight* weight = NULL;
+	const MD5DualQuaternion* dq = NULL;
+	const MD5DualQuaternion* first = NULL;
+	float real[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float dual[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	FxsVector3 p, n, t;
+	float w = 0.0f, len = 0.0f;
+	int l = 0, j = 0;
+
+	/* blend the dual quaternions of the weights. Flip those in the other
+	** hemisphere than the one of the largest weight to take the shortest 
+	** path (like the gpu skinning, see MD5SkinningInputMake).
+	*/
+	for (l = 0; l < vertex->numWeights; l++)
+	{
+		weight = &md5submesh->weights[vertex->weightId + l];
+
+		if (l == 0 || weight->value > w)
+		{
+			first = &dqPalette[weight->jointId];
+			w = weight->value;
+		}
+	}
+
+	for (l = 0; l < vertex->numWeights; l++)
+	{
+		weight = &md5submesh->weights[vertex->weightId + l];
+		dq = &dqPalette[weight->jointId];
+		w = weight->value;
+
+		if (dq->real[0]*first->real[0] + dq->real[1]*first->real[1] + 
+			dq->real[2]*first->real[2] + dq->real[3]*first->real[3] < 0.0f)
+		{
+			w = -w;
+		}
+
+		for (j = 0; j < 4; j++)
+		{
+			real[j] += w*dq->real[j];
+			dual[j] += w*dq->dual[j];
+		}
+	}
+
+	len = sqrtf(real[0]*real[0] + real[1]*real[1] + real[2]*real[2] + real[3]*real[3]);
+	len = len > 1e-12f ? 1.0f/len : 0.0f;
+
+	for (j = 0; j < 4; j++)
+	{
+		real[j] *= len;
+		dual[j] *= len;
+	}
+
+	/* p' = rotate(p) + 2*(real.w*dual.xyz - dual.w*real.xyz + real.xyz x dual.xyz) */
+	QuaternionRotate(&p, real, &bindPositions[vertexId]);
+	p.x += 2.0f*(real[3]*dual[0] - dual[3]*real[0] + real[1]*dual[2] - real[2]*dual[1]);
+	p.y += 2.0f*(real[3]*dual[1] - dual[3]*real[1] + real[2]*dual[0] - real[0]*dual[2]);
+	p.z += 2.0f*(real[3]*dual[2] - dual[3]*real[2] + real[0]*dual[1] - real[1]*dual[0]);
+
+	QuaternionRotate(&n, real, &bindNormals[vertexId]);
+	QuaternionRotate(&t, real, &bindTangents[vertexId]);
+
+	skinned->position = p;
+	skinned->normal = MD5PackSnorm1010102(n.x, n.y, n.z, 0.0f);
+	skinned->tangent = MD5PackSnorm1010102(t.x, t.y, t.z, handedness[vertexId]);
+}
+
+void MD5SkinningInputMake(
+	MD5SkinningInput* input,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* bindPositions,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const float* handedness
+)
+{
+	const FxsMD5Vertex* vertex = &md5submesh->vertices[vertexId];
+	const FxsMD5Weight* weight = NULL;
+	float sum = 0.0f;
+	int l = 0, j = 0;
+
+	memset(input, 0, sizeof(MD5SkinningInput));
+	input->position = bindPositions[vertexId];
+	input->normal = bindNormals[vertexId];
+	input->tangent[0] = bindTangents[vertexId].x;
+	input->tangent[1] = bindTangents[vertexId].y;
+	input->tangent[2] = bindTangents[vertexId].z;
+	input->tangent[3] = handedness[vertexId];
+
+	/* keep the largest weights sorted by value (insertion sort) */
+	for (l = 0; l < vertex->numWeights; l++)
+	{
+		weight = &md5submesh->weights[vertex->weightId + l];
+
+		for (j = MD5_SKINNING_MAX_WEIGHTS - 1; j >= 0; j--)
+		{
+			if (j > 0 && input->weights[j - 1] < weight->value)
+			{
+				input->weights[j] = input->weights[j - 1];
+				input->joints[j] = input->joints[j - 1];
+				continue;
+			}
+
+			if (input->weights[j] < weight->value)
+			{
+				input->weights[j] = weight->value;
+				input->joints[j] = (unsigned short)weight->jointId;
+			}
+
+			break;
+		}
+	}
+
+	for (j = 0; j < MD5_SKINNING_MAX_WEIGHTS; j++)
+	{
+		sum += input->weights[j];
+	}
+
+	sum = sum > 1e-12f ? 1.0f/sum : 0.0f;
+
+	for (j = 0; j < MD5_SKINNING_MAX_WEIGHTS; j++)
+	{
+		input->weights[j] *= sum;
+	}
+}
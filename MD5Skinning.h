@@ -0,0 +1,280 @@
+/*
+ * CPU skinning of MD5 meshes
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5SKINNING_H
+#define MD5SKINNING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <Fxs/Math/Vector3.h>
+#include <Fxs/MD5/MD5Mesh.h>
+#include "MD5VertexFormat.h"
+
+/*
+** Affine joint transform stored as a row major 3x4 matrix. 
+**
+**      | m[0] m[1]  m[2]  m[3]  |
+**      | m[4] m[5]  m[6]  m[7]  |
+**      | m[8] m[9]  m[10] m[11] |
+*/
+typedef struct
+{
+	float m[12];
+}
+MD5JointMatrix;
+
+/*
+** Rigid joint transform stored as a unit dual quaternion (x, y, z, w).
+*/
+typedef struct
+{
+	float real[4];
+	float dual[4];
+}
+MD5DualQuaternion;
+
+/*
+** Skinning methods.
+*/
+typedef enum
+{
+	MD5_SKINNING_LINEAR = 0, 			/* linear blend skinning */
+	MD5_SKINNING_DUAL_QUATERNION 		/* dual quaternion skinning */
+}
+MD5SkinningMethod;
+
+#define MD5_SKINNING_MAX_WEIGHTS 4 	/* max. # of weights of a vertex skinned
+									** on the gpu */
+
+/*
+** Bind pose data of a vertex for skinning it on the gpu. The weights are the
+** MD5_SKINNING_MAX_WEIGHTS largest weights of the vertex, normalized to sum 
+** up to one. Unused weights are 0.
+*/
+typedef struct
+{
+	FxsVector3 position;
+	FxsVector3 normal;
+	float tangent[4]; 				/* w is the handedness of the bitangent */
+	unsigned short joints[MD5_SKINNING_MAX_WEIGHTS];
+	float weights[MD5_SKINNING_MAX_WEIGHTS];
+}
+MD5SkinningInput;
+
+/*
+** Converts a FxsMatrix4 joint transform to a MD5JointMatrix.
+*/
+void MD5JointMatrixMakeWithMatrix4(MD5JointMatrix* jm, FxsMatrix4* transform);
+
+/*
+** Makes a rigid joint transform from the rotation of the unit quaternion q 
+** (x, y, z, w) and the translation t.
+*/
+void MD5JointMatrixMakeWithRotationTranslation(
+	MD5JointMatrix* jm, 
+	const float* q, 
+	const float* t
+);
+
+/*
+** Computes the palette of the first numJoints joints of the current pose of 
+** md5mesh.
+*/
+void MD5SkinningComputePalette(
+	MD5JointMatrix* palette,
+	FxsMD5Mesh* md5mesh,
+	int numJoints
+);
+
+/*
+** Computes the position of vertex of md5submesh with the joint transforms in
+** palette.
+*/
+void MD5SkinningSkinPosition(
+	FxsVector3* position,
+	const FxsMD5SubMesh* md5submesh,
+	const FxsMD5Vertex* vertex,
+	const MD5JointMatrix* palette
+);
+
+/*
+** Computes the inverse of the numJoints rigid joint transforms of the bind
+** pose.
+*/
+void MD5SkinningComputeInverseBindMatrices(
+	MD5JointMatrix* inverseBindMatrices,
+	const MD5JointMatrix* bindPalette,
+	int numJoints
+);
+
+/*
+** Computes the matrices that take the bind pose to the pose in palette, 
+** i.e. palette[i]*inverseBindMatrices[i].
+*/
+void MD5SkinningComputeSkinningMatrices(
+	MD5JointMatrix* skinningMatrices,
+	const MD5JointMatrix* palette,
+	const MD5JointMatrix* inverseBindMatrices,
+	int numJoints
+);
+
+/*
+** Quaternion (x, y, z, w) of the rotation of jm.
+*/
+void MD5QuaternionMakeWithJointMatrix(float* q, const MD5JointMatrix* jm);
+
+/*
+** Makes a dual quaternion from the rotation of the unit quaternion q 
+** (x, y, z, w) and the translation t.
+*/
+void MD5DualQuaternionMakeWithRotationTranslation(
+	MD5DualQuaternion* dq, 
+	const float* q, 
+	const float* t
+);
+
+/*
+** Converts a rigid joint transform to a dual quaternion.
+*/
+void MD5DualQuaternionMakeWithJointMatrix(
+	MD5DualQuaternion* dq, 
+	const MD5JointMatrix* jm
+);
+
+/*
+** Computes the inverse of the numJoints joint transforms of the bind pose
+** as dual quaternions.
+*/
+void MD5SkinningComputeInverseBindPose(
+	MD5DualQuaternion* inverseBindPose,
+	const MD5JointMatrix* bindPalette,
+	int numJoints
+);
+
+/*
+** Computes the dual quaternions that take the bind pose to the pose in 
+** palette, i.e. palette[i]*inverseBindPose[i].
+*/
+void MD5SkinningComputeDualQuaternionPalette(
+	MD5DualQuaternion* dqPalette,
+	const MD5JointMatrix* palette,
+	const MD5DualQuaternion* inverseBindPose,
+	int numJoints
+);
+
+/*
+** Computes the dual quaternion palette like 
+** MD5SkinningComputeDualQuaternionPalette, but directly from the rotations
+** (4 floats (x, y, z, w) per joint) and translations (3 floats per joint) 
+** of the pose, without going through joint matrices.
+*/
+void MD5SkinningComputeDualQuaternionPaletteWithJoints(
+	MD5DualQuaternion* dqPalette,
+	const float* rotations,
+	const float* translations,
+	const MD5DualQuaternion* inverseBindPose,
+	int numJoints
+);
+
+/*
+** Computes positions, normals and tangents of the first numVertices 
+** vertices of md5submesh in the pose given by palette (usually the bind 
+** pose). handedness receives the handedness of the bitangent of each 
+** vertex. The tangents are computed from the texture coordinates.
+**
+** Returns 0 if it fails.
+*/
+int MD5SkinningComputeBindFrames(
+	FxsVector3* bindPositions,
+	FxsVector3* bindNormals,
+	FxsVector3* bindTangents,
+	float* handedness,
+	const FxsMD5SubMesh* md5submesh,
+	int numVertices,
+	const MD5JointMatrix* palette
+);
+
+/*
+** Rotates the normals and tangents of the bind pose (see 
+** MD5SkinningComputeBindFrames) into the space of the joints of each 
+** weight. weightNormals and weightTangents receive one vector per weight.
+*/
+void MD5SkinningComputeWeightFrames(
+	FxsVector3* weightNormals,
+	FxsVector3* weightTangents,
+	const FxsMD5SubMesh* md5submesh,
+	int numVertices,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const MD5JointMatrix* palette
+);
+
+/*
+** Computes position, normal and tangent of vertex vertexId of md5submesh 
+** with the joint transforms in palette. The normal and tangent are rotated 
+** by the joint of each weight in the same pass (see 
+** MD5SkinningComputeWeightFrames).
+*/
+void MD5SkinningSkinVertex(
+	MD5Vertex* skinned,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* weightNormals,
+	const FxsVector3* weightTangents,
+	const float* handedness,
+	const MD5JointMatrix* palette
+);
+
+/*
+** Computes position, normal and tangent of vertex vertexId of md5submesh by
+** blending the dual quaternions in dqPalette (see 
+** MD5SkinningComputeDualQuaternionPalette) of its weights and transforming 
+** its bind pose.
+*/
+void MD5SkinningSkinVertexDualQuaternion(
+	MD5Vertex* skinned,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* bindPositions,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const float* handedness,
+	const MD5DualQuaternion* dqPalette
+);
+
+/*
+** Makes the gpu skinning input of the md5 vertex with vertexId from the bind
+** pose of its submesh (see MD5SkinningComputeBindFrames).
+*/
+void MD5SkinningInputMake(
+	MD5SkinningInput* input,
+	const FxsMD5SubMesh* md5submesh,
+	int vertexId,
+	const FxsVector3* bindPositions,
+	const FxsVector3* bindNormals,
+	const FxsVector3* bindTangents,
+	const float* handedness
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5SKINNING_H */
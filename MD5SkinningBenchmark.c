@@ -0,0 +1,487 @@
+/*
+ * Timing of linear blend vs. dual quaternion skinning
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+** Standalone benchmark of the host skinning paths on a synthetic mesh. Each
+** frame of a random animation is given as joint rotations and translations,
+** like the frames decoded from a compressed animation, and skinned with:
+**
+**   linear:       joint matrices, then linear blend skinning
+**   dq direct:    dual quaternion palette built from the joints, then dual
+**                 quaternion skinning
+**   dq matrices:  joint matrices converted to the dual quaternion palette,
+**                 then dual quaternion skinning (the path of poses that are
+**                 only available as matrices)
+**
+** Given an md5mesh and an md5anim, the animation is also compressed (see 
+** MD5CompressedAnimation) and decoding its frames compared with posing the
+** md5mesh: the memory of both, the time per frame and the max. error. The 
+** tolerances default to those of the mesh manager.
+**
+** Build and run, e.g.:
+**
+**   cc -O2 -DMD5_SKINNING_BENCHMARK_MAIN MD5SkinningBenchmark.c \
+**      MD5Skinning.c MD5VertexFormat.c MD5CompressedAnimation.c MD5Arena.c \
+**      -lFxs -lpthread -lm -o md5skinningbenchmark
+**   ./md5skinningbenchmark [numJoints numVertices numFrames 
+**      [md5mesh md5anim [translationTolerance rotationTolerance]]]
+*/
+#ifdef MD5_SKINNING_BENCHMARK_MAIN
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "MD5Skinning.h"
+#include "MD5CompressedAnimation.h"
+
+#define NUM_WEIGHTS 4 			/* weights of each vertex */
+#define TRANSLATION_TOLERANCE 0.001f 	/* same as the defaults of the mesh */
+#define ROTATION_TOLERANCE 0.001f 		/* manager */
+
+static float Random(float min, float max)
+{
+	return min + (max - min)*rand()/(float)RAND_MAX;
+}
+
+/*
+** Makes a random unit quaternion q (x, y, z, w).
+*/
+static void RandomQuaternion(float* q)
+{
+	float length = 0.0f;
+	int i = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		q[i] = Random(-1.0f, 1.0f);
+		length += q[i]*q[i];
+	}
+
+	length = sqrtf(length);
+
+	for (i = 0; i < 4; i++)
+	{
+		q[i] /= length;
+	}
+}
+
+static void RandomJoints(float* rotations, float* translations, int numJoints)
+{
+	int i = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		RandomQuaternion(&rotations[4*i]);
+		translations[3*i] = Random(-10.0f, 10.0f);
+		translations[3*i + 1] = Random(-10.0f, 10.0f);
+		translations[3*i + 2] = Random(-10.0f, 10.0f);
+	}
+}
+
+static void MakePalette(
+	MD5JointMatrix* palette,
+	const float* rotations,
+	const float* translations,
+	int numJoints
+)
+{
+	int i = 0;
+
+	for (i = 0; i < numJoints; i++)
+	{
+		MD5JointMatrixMakeWithRotationTranslation(
+			&palette[i],
+			&rotations[4*i],
+			&translations[3*i]
+		);
+	}
+}
+
+/*
+** Gets the seconds passed since start on a monotonic clock.
+*/
+static double Seconds(const struct timespec* start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) + 1e-9*(now.tv_nsec - start->tv_nsec);
+}
+
+/*
+** Gets the angle between the rotations of a and b. The angle is taken from
+** the sine and the cosine of their difference, the cosine alone is too 
+** imprecise for small angles.
+*/
+static float RotationAngle(const MD5JointMatrix* a, const MD5JointMatrix* b)
+{
+	float r[9];
+	float x = 0.0f, y = 0.0f, z = 0.0f;
+	int i = 0, j = 0;
+
+	/* r = transpose(a)*b */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			r[3*i + j] = a->m[i]*b->m[j] + a->m[4 + i]*b->m[4 + j] + 
+				a->m[8 + i]*b->m[8 + j];
+		}
+	}
+
+	x = r[7] - r[5];
+	y = r[2] - r[6];
+	z = r[3] - r[1];
+
+	return atan2f(
+			0.5f*sqrtf(x*x + y*y + z*z), 
+			0.5f*(r[0] + r[4] + r[8] - 1.0f)
+		);
+}
+
+/*
+** Compresses the animation in animationFilename with the skeleton of the 
+** md5mesh in meshFilename and compares decoding each frame with posing the
+** md5mesh. Returns 0 if it fails.
+*/
+static int BenchmarkCompression(
+	const char* meshFilename,
+	const char* animationFilename,
+	float translationTolerance,
+	float rotationTolerance
+)
+{
+	FxsMD5Mesh* md5mesh = NULL;
+	FxsMD5Animation* animation = NULL;
+	MD5CompressedAnimation* compressed = NULL;
+	MD5JointMatrix* palette = NULL;
+	const MD5JointMatrix* decoded = NULL;
+	double poseSeconds = 0.0;
+	double decodeSeconds = 0.0;
+	float translationError = 0.0f;
+	float rotationError = 0.0f;
+	struct timespec start;
+	int numJoints = 0;
+	int numFrames = 0;
+	int i = 0, j = 0, f = 0;
+
+	if (!FxsMD5MeshCreateWithFile(&md5mesh, meshFilename) ||
+		!FxsMD5AnimationCreateWithFile(&animation, animationFilename))
+	{
+		printf("Could not load %s and %s\n", meshFilename, animationFilename);
+		FxsMD5MeshDestroy(&md5mesh);
+		return 0;
+	}
+
+	numJoints = md5mesh->currentPose.numJoints;
+	numFrames = animation->numFrames;
+	palette = (MD5JointMatrix*)malloc((numJoints + 1)*sizeof(MD5JointMatrix));
+
+	if (!palette || !MD5CompressedAnimationCreateWithAnimation(
+			&compressed,
+			md5mesh,
+			animation,
+			translationTolerance,
+			rotationTolerance
+		))
+	{
+		printf("Could not compress %s\n", animationFilename);
+		free(palette);
+		FxsMD5AnimationDestroy(&animation);
+		FxsMD5MeshDestroy(&md5mesh);
+		return 0;
+	}
+
+	/* the frames are decoded in order, so each decode misses the cache */
+	for (f = 0; f < numFrames; f++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		FxsMD5MeshUpdatePoseWithAnimationFrame(md5mesh, animation, f);
+
+		for (i = 0; i < numJoints; i++)
+		{
+			MD5JointMatrixMakeWithMatrix4(
+				&palette[i], 
+				&md5mesh->currentPose.joints[i].transform
+			);
+		}
+
+		poseSeconds += Seconds(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		decoded = MD5CompressedAnimationDecodeFrame(compressed, f);
+		decodeSeconds += Seconds(&start);
+
+		if (!decoded)
+		{
+			printf("Could not decode frame %d\n", f);
+			break;
+		}
+
+		/* the error of the translation is per component */
+		for (i = 0; i < numJoints; i++)
+		{
+			for (j = 3; j < 12; j += 4)
+			{
+				translationError = fmaxf(translationError, 
+					fabsf(palette[i].m[j] - decoded[i].m[j]));
+			}
+
+			rotationError = fmaxf(rotationError, 
+				RotationAngle(&palette[i], &decoded[i]));
+		}
+	}
+
+	printf("%s: %d joints, %d frames, tolerances %g %g (rad)\n",
+		animationFilename, numJoints, numFrames, 
+		translationTolerance, rotationTolerance);
+	printf("memory         %zu -> %zu bytes (%.2fx)\n",
+		compressed->stats.uncompressedBytes, compressed->stats.compressedBytes,
+		(double)compressed->stats.uncompressedBytes/compressed->stats.compressedBytes);
+	printf("ms per frame   pose %9.4f   decode %9.4f\n",
+		1000.0*poseSeconds/numFrames, 1000.0*decodeSeconds/numFrames);
+	printf("max. error     translation %g, rotation %g (rad)\n", 
+		translationError, rotationError);
+
+	MD5CompressedAnimationDestroy(&compressed);
+	free(palette);
+	FxsMD5AnimationDestroy(&animation);
+	FxsMD5MeshDestroy(&md5mesh);
+
+	return f == numFrames;
+}
+
+int main(int argc, char** argv)
+{
+	int numJoints = argc > 3 ? atoi(argv[1]) : 64;
+	int numVertices = argc > 3 ? atoi(argv[2]) : 10000;
+	int numFrames = argc > 3 ? atoi(argv[3]) : 200;
+	FxsMD5SubMesh md5submesh;
+	MD5JointMatrix* palette = NULL;
+	MD5DualQuaternion* inverseBindPose = NULL;
+	MD5DualQuaternion* dqPalette = NULL;
+	MD5DualQuaternion* dqPaletteMatrices = NULL;
+	FxsVector3* bindPositions = NULL;
+	FxsVector3* bindNormals = NULL;
+	FxsVector3* bindTangents = NULL;
+	FxsVector3* weightNormals = NULL;
+	FxsVector3* weightTangents = NULL;
+	float* handedness = NULL;
+	float* rotations = NULL;
+	float* translations = NULL;
+	MD5Vertex* skinned = NULL;
+	FxsMD5Weight* weight = NULL;
+	double paletteSeconds[3] = {0.0, 0.0, 0.0};
+	double skinSeconds[3] = {0.0, 0.0, 0.0};
+	float error = 0.0f;
+	struct timespec start;
+	int i = 0, j = 0, f = 0;
+
+	if (numJoints < 1 || numVertices < 3 || numFrames < 1)
+	{
+		printf("usage: %s [numJoints numVertices numFrames]\n", argv[0]);
+		return 1;
+	}
+
+	/* a soup of triangles, each vertex with NUM_WEIGHTS random weights */
+	md5submesh.numFaces = numVertices/3;
+	md5submesh.faces = (FxsMD5Face*)malloc(md5submesh.numFaces*sizeof(FxsMD5Face));
+	md5submesh.vertices = (FxsMD5Vertex*)malloc(numVertices*sizeof(FxsMD5Vertex));
+	md5submesh.weights = (FxsMD5Weight*)malloc(
+			numVertices*NUM_WEIGHTS*sizeof(FxsMD5Weight)
+		);
+	palette = (MD5JointMatrix*)malloc(numJoints*sizeof(MD5JointMatrix));
+	inverseBindPose = (MD5DualQuaternion*)malloc(numJoints*sizeof(MD5DualQuaternion));
+	dqPalette = (MD5DualQuaternion*)malloc(numJoints*sizeof(MD5DualQuaternion));
+	dqPaletteMatrices = (MD5DualQuaternion*)malloc(
+			numJoints*sizeof(MD5DualQuaternion)
+		);
+	bindPositions = (FxsVector3*)malloc(numVertices*sizeof(FxsVector3));
+	bindNormals = (FxsVector3*)malloc(numVertices*sizeof(FxsVector3));
+	bindTangents = (FxsVector3*)malloc(numVertices*sizeof(FxsVector3));
+	weightNormals = (FxsVector3*)malloc(numVertices*NUM_WEIGHTS*sizeof(FxsVector3));
+	weightTangents = (FxsVector3*)malloc(numVertices*NUM_WEIGHTS*sizeof(FxsVector3));
+	handedness = (float*)malloc(numVertices*sizeof(float));
+	rotations = (float*)malloc(numFrames*numJoints*4*sizeof(float));
+	translations = (float*)malloc(numFrames*numJoints*3*sizeof(float));
+	skinned = (MD5Vertex*)malloc(numVertices*sizeof(MD5Vertex));
+
+	if (!md5submesh.faces || !md5submesh.vertices || !md5submesh.weights ||
+		!palette || !inverseBindPose || !dqPalette || !dqPaletteMatrices ||
+		!bindPositions || !bindNormals || !bindTangents || !weightNormals ||
+		!weightTangents || !handedness || !rotations || !translations ||
+		!skinned)
+	{
+		printf("malloc failed\n");
+		return 1;
+	}
+
+	srand(1);
+
+	for (i = 0; i < md5submesh.numFaces; i++)
+	{
+		md5submesh.faces[i].v1 = 3*i;
+		md5submesh.faces[i].v2 = 3*i + 1;
+		md5submesh.faces[i].v3 = 3*i + 2;
+	}
+
+	for (i = 0; i < numVertices; i++)
+	{
+		md5submesh.vertices[i].texCoords.x = Random(0.0f, 1.0f);
+		md5submesh.vertices[i].texCoords.y = Random(0.0f, 1.0f);
+		md5submesh.vertices[i].weightId = NUM_WEIGHTS*i;
+		md5submesh.vertices[i].numWeights = NUM_WEIGHTS;
+
+		for (j = 0; j < NUM_WEIGHTS; j++)
+		{
+			weight = &md5submesh.weights[NUM_WEIGHTS*i + j];
+			weight->jointId = rand() % numJoints;
+			weight->value = 1.0f/NUM_WEIGHTS;
+			weight->position.x = Random(-1.0f, 1.0f);
+			weight->position.y = Random(-1.0f, 1.0f);
+			weight->position.z = Random(-1.0f, 1.0f);
+		}
+	}
+
+	/* frame 0 is the bind pose */
+	RandomJoints(rotations, translations, numFrames*numJoints);
+	MakePalette(palette, rotations, translations, numJoints);
+
+	if (!MD5SkinningComputeBindFrames(bindPositions, bindNormals, bindTangents,
+			handedness, &md5submesh, numVertices, palette))
+	{
+		printf("MD5SkinningComputeBindFrames failed\n");
+		return 1;
+	}
+
+	MD5SkinningComputeWeightFrames(weightNormals, weightTangents, &md5submesh,
+		numVertices, bindNormals, bindTangents, palette);
+	MD5SkinningComputeInverseBindPose(inverseBindPose, palette, numJoints);
+
+	for (f = 0; f < numFrames; f++)
+	{
+		/* linear */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		MakePalette(palette, &rotations[4*numJoints*f],
+			&translations[3*numJoints*f], numJoints);
+		paletteSeconds[0] += Seconds(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (i = 0; i < numVertices; i++)
+		{
+			MD5SkinningSkinVertex(&skinned[i], &md5submesh, i, weightNormals,
+				weightTangents, handedness, palette);
+		}
+
+		skinSeconds[0] += Seconds(&start);
+
+		/* dual quaternions from the matrices */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		MakePalette(palette, &rotations[4*numJoints*f],
+			&translations[3*numJoints*f], numJoints);
+		MD5SkinningComputeDualQuaternionPalette(dqPaletteMatrices, palette,
+			inverseBindPose, numJoints);
+		paletteSeconds[2] += Seconds(&start);
+
+		/* dual quaternions from the joints */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		MD5SkinningComputeDualQuaternionPaletteWithJoints(dqPalette,
+			&rotations[4*numJoints*f], &translations[3*numJoints*f],
+			inverseBindPose, numJoints);
+		paletteSeconds[1] += Seconds(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (i = 0; i < numVertices; i++)
+		{
+			MD5SkinningSkinVertexDualQuaternion(&skinned[i], &md5submesh, i,
+				bindPositions, bindNormals, bindTangents, handedness, dqPalette);
+		}
+
+		skinSeconds[1] += Seconds(&start);
+
+		/* both palettes are the same up to the sign of each dual quaternion */
+		for (i = 0; i < numJoints; i++)
+		{
+			float sign = dqPalette[i].real[0]*dqPaletteMatrices[i].real[0] +
+				dqPalette[i].real[1]*dqPaletteMatrices[i].real[1] +
+				dqPalette[i].real[2]*dqPaletteMatrices[i].real[2] +
+				dqPalette[i].real[3]*dqPaletteMatrices[i].real[3] < 0.0f ?
+				-1.0f : 1.0f;
+
+			for (j = 0; j < 4; j++)
+			{
+				error = fmaxf(error, fabsf(dqPalette[i].real[j] -
+					sign*dqPaletteMatrices[i].real[j]));
+				error = fmaxf(error, fabsf(dqPalette[i].dual[j] -
+					sign*dqPaletteMatrices[i].dual[j]));
+			}
+		}
+	}
+
+	/* skinning is the same for both dual quaternion palettes */
+	skinSeconds[2] = skinSeconds[1];
+
+	printf("%d joints, %d vertices, %d weights per vertex, %d frames\n",
+		numJoints, numVertices, NUM_WEIGHTS, numFrames);
+	printf("ms per frame   palette      skin     total\n");
+	printf("linear       %9.4f %9.4f %9.4f\n",
+		1000.0*paletteSeconds[0]/numFrames, 1000.0*skinSeconds[0]/numFrames,
+		1000.0*(paletteSeconds[0] + skinSeconds[0])/numFrames);
+	printf("dq direct    %9.4f %9.4f %9.4f\n",
+		1000.0*paletteSeconds[1]/numFrames, 1000.0*skinSeconds[1]/numFrames,
+		1000.0*(paletteSeconds[1] + skinSeconds[1])/numFrames);
+	printf("dq matrices  %9.4f %9.4f %9.4f\n",
+		1000.0*paletteSeconds[2]/numFrames, 1000.0*skinSeconds[2]/numFrames,
+		1000.0*(paletteSeconds[2] + skinSeconds[2])/numFrames);
+	printf("max. difference of the dual quaternion palettes: %g\n", error);
+
+	if (argc > 5 && !BenchmarkCompression(
+			argv[4],
+			argv[5],
+			argc > 7 ? (float)atof(argv[6]) : TRANSLATION_TOLERANCE,
+			argc > 7 ? (float)atof(argv[7]) : ROTATION_TOLERANCE
+		))
+	{
+		return 1;
+	}
+
+	free(md5submesh.faces);
+	free(md5submesh.vertices);
+	free(md5submesh.weights);
+	free(palette);
+	free(inverseBindPose);
+	free(dqPalette);
+	free(dqPaletteMatrices);
+	free(bindPositions);
+	free(bindNormals);
+	free(bindTangents);
+	free(weightNormals);
+	free(weightTangents);
+	free(handedness);
+	free(rotations);
+	free(translations);
+	free(skinned);
+
+	return 0;
+}
+
+#endif /* MD5_SKINNING_BENCHMARK_MAIN */
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "MD5VertexCache.h"
+
+/*
+** Temporary data of the optimizer.
+*/
+typedef struct
+{
+	int* offsets; 			/* first entry of each vertex in triangles */
+	int* triangles; 		/* adjacent triangles of each vertex */
+	int* liveCounts; 		/* # of adjacent triangles not yet emitted */
+	int* timeStamps; 		/* time a vertex entered the cache */
+	int* deadEnds; 			/* stack of recently used vertices */
+	int numDeadEnds;
+	unsigned char* emitted; /* flag for each triangle */
+}
+Tipsify;
+
+static void TipsifyDestroy(Tipsify* tipsify)
+{
+	free(tipsify->offsets);
+	free(tipsify->triangles);
+	free(tipsify->liveCounts);
+	free(tipsify->timeStamps);
+	free(tipsify->deadEnds);
+	free(tipsify->emitted);
+	memset(tipsify, 0, sizeof(Tipsify));
+}
+
+static int TipsifyCreate(
+	Tipsify* tipsify,
+	const unsigned int* indices,
+	int numFaces,
+	int numVertices
+)
+{
+	int i = 0;
+
+	memset(tipsify, 0, sizeof(Tipsify));
+	tipsify->offsets = (int*)calloc(numVertices + 1, sizeof(int));
+	tipsify->triangles = (int*)malloc((3*numFaces + 1)*sizeof(int));
+	tipsify->liveCounts = (int*)calloc(numVertices + 1, sizeof(int));
+	tipsify->timeStamps = (int*)calloc(numVertices + 1, sizeof(int));
+	tipsify->deadEnds = (int*)malloc((3*numFaces + 1)*sizeof(int));
+	tipsify->emitted = (unsigned char*)calloc(numFaces + 1, 1);
+
+	if (!tipsify->offsets || !tipsify->triangles || !tipsify->liveCounts ||
+		!tipsify->timeStamps || !tipsify->deadEnds || !tipsify->emitted)
+	{
+		TipsifyDestroy(tipsify);
+		return 0;
+	}
+
+	/* build the vertex-triangle adjacency */
+	for (i = 0; i < 3*numFaces; i++)
+	{
+		tipsify->liveCounts[indices[i]]++;
+	}
+
+	for (i = 1; i <= numVertices; i++)
+	{
+		tipsify->offsets[i] = tipsify->offsets[i - 1] + tipsify->liveCounts[i - 1];
+	}
+
+	/* the live counts are recounted while filling in the triangles */
+	memset(tipsify->liveCounts, 0, numVertices*sizeof(int));
+
+	for (i = 0; i < 3*numFaces; i++)
+	{
+		tipsify->triangles[tipsify->offsets[indices[i]] +
+			tipsify->liveCounts[indices[i]]++] = i/3;
+	}
+
+	return 1;
+}
+
+/*
+** Gets the next vertex to fan around if the current fanning vertex has no
+** live triangles left. Returns -1 if all triangles were emitted.
+*/
+static int TipsifySkipDeadEnd(Tipsify* tipsify, int* cursor, int numVertices)
+{
+	int v = 0;
+
+	while (tipsify->numDeadEnds > 0)
+	{
+		v = tipsify->deadEnds[--tipsify->numDeadEnds];
+
+		if (tipsify->liveCounts[v] > 0)
+		{
+			return v;
+		}
+	}
+
+	for (; *cursor < numVertices; (*cursor)++)
+	{
+		if (tipsify->liveCounts[*cursor] > 0)
+		{
+			return *cursor;
+		}
+	}
+
+	return -1;
+}
+
+int MD5VertexCacheOptimize(
+	unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int cacheSize
+)
+{
+	Tipsify tipsify;
+	unsigned int* optimized = NULL;
+	const unsigned int* face = NULL;
+	int fan = 0; 				/* the fanning vertex */
+	int time = cacheSize + 1;
+	int cursor = 0; 			/* for skipping dead ends */
+	int count = 0; 				/* # of emitted indices */
+	int candidates = 0; 		/* first dead end pushed by the current fan */
+	int best = 0, priority = 0, bestPriority = 0;
+	int i = 0, j = 0, t = 0, v = 0;
+
+	if (numFaces <= 0)
+	{
+		return 1;
+	}
+
+	optimized = (unsigned int*)malloc((3*numFaces + 1)*sizeof(unsigned int));
+
+	if (!optimized || !TipsifyCreate(&tipsify, indices, numFaces, numVertices))
+	{
+		free(optimized);
+		return 0;
+	}
+
+	fan = TipsifySkipDeadEnd(&tipsify, &cursor, numVertices);
+
+	while (fan >= 0)
+	{
+		candidates = tipsify.numDeadEnds;
+
+		/* emit all live triangles around the fanning vertex */
+		for (i = tipsify.offsets[fan]; i < tipsify.offsets[fan + 1]; i++)
+		{
+			t = tipsify.triangles[i];
+
+			if (tipsify.emitted[t])
+			{
+				continue;
+			}
+
+			face = &indices[3*t];
+
+			for (j = 0; j < 3; j++)
+			{
+				v = face[j];
+				optimized[count++] = v;
+				tipsify.deadEnds[tipsify.numDeadEnds++] = v;
+				tipsify.liveCounts[v]--;
+
+				if (time - tipsify.timeStamps[v] > cacheSize)
+				{
+					tipsify.timeStamps[v] = time++;
+				}
+			}
+
+			tipsify.emitted[t] = 1;
+		}
+
+		/* the next fanning vertex is the vertex of the fan with live
+		** triangles, that stays the longest in the cache
+		*/
+		best = -1;
+		bestPriority = -1;
+
+		for (i = candidates; i < tipsify.numDeadEnds; i++)
+		{
+			v = tipsify.deadEnds[i];
+
+			if (tipsify.liveCounts[v] <= 0)
+			{
+				continue;
+			}
+
+			priority = 0;
+
+			if (time - tipsify.timeStamps[v] + 2*tipsify.liveCounts[v] <= cacheSize)
+			{
+				priority = time - tipsify.timeStamps[v];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		fan = best >= 0 ? best : TipsifySkipDeadEnd(&tipsify, &cursor, numVertices);
+	}
+
+	memcpy(indices, optimized, 3*numFaces*sizeof(unsigned int));
+	free(optimized);
+	TipsifyDestroy(&tipsify);
+
+	return 1;
+}
+
+int MD5VertexCacheRemap(
+	unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int* vertexMap
+)
+{
+	int* newIds = NULL; 		/* new id + 1 of each old id, 0 if unused */
+	int count = 0;
+	int i = 0;
+
+	newIds = (int*)calloc(numVertices + 1, sizeof(int));
+
+	if (!newIds)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < 3*numFaces; i++)
+	{
+		if (!newIds[indices[i]])
+		{
+			vertexMap[count] = indices[i];
+			newIds[indices[i]] = ++count;
+		}
+
+		indices[i] = newIds[indices[i]] - 1;
+	}
+
+	free(newIds);
+
+	return count;
+}
+
+float MD5VertexCacheComputeAcmr(
+	const unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int cacheSize
+)
+{
+	int* timeStamps = NULL;
+	int time = cacheSize + 1;
+	int misses = 0;
+	int i = 0;
+
+	if (numFaces <= 0)
+	{
+		return 0.0f;
+	}
+
+	timeStamps = (int*)calloc(numVertices + 1, sizeof(int));
+
+	if (!timeStamps)
+	{
+		return -1.0f;
+	}
+
+	/* a vertex is in the fifo cache if less than cacheSize vertices entered
+	** it after it
+	*/
+	for (i = 0; i < 3*numFaces; i++)
+	{
+		if (time - timeStamps[indices[i]] > cacheSize)
+		{
+			timeStamps[indices[i]] = time++;
+			misses++;
+		}
+	}
+
+	free(timeStamps);
+
+	return (float)misses/numFaces;
+}
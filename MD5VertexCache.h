@@ -0,0 +1,70 @@
+/*
+ * Post-transform vertex cache optimization of triangle lists
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5VERTEXCACHE_H
+#define MD5VERTEXCACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MD5_VERTEX_CACHE_SIZE 16 	/* # of entries of the simulated fifo
+									** cache */
+
+/*
+** Reorders the numFaces triangles in indices (3 vertex ids < numVertices
+** per triangle) for the post-transform vertex cache of size cacheSize
+** (Tipsify, Sander et al. 2007). Returns 0 if it fails, the triangles are
+** left untouched then.
+*/
+int MD5VertexCacheOptimize(
+	unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int cacheSize
+);
+
+/*
+** Renumbers the vertices in indices in the order of their first use. Writes
+** the old id of each new vertex id to vertexMap (numVertices entries) and
+** returns the # of vertices used by indices, or -1 if it fails.
+*/
+int MD5VertexCacheRemap(
+	unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int* vertexMap
+);
+
+/*
+** Computes the average cache miss ratio (transformed vertices per triangle)
+** of indices for a fifo cache of size cacheSize. Returns a negative value if
+** it fails.
+*/
+float MD5VertexCacheComputeAcmr(
+	const unsigned int* indices,
+	int numFaces,
+	int numVertices,
+	int cacheSize
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5VERTEXCACHE_H */
@@ -0,0 +1,222 @@
+#include <string.h>
+#include <memory.h>
+#include <stdlib.h>
+#include <math.h>
+#include "MD5VertexFormat.h"
+
+int MD5PositionFormatMakeWithName(MD5PositionFormat* format, const char* name)
+{
+	if (!strcmp(name, "float"))
+	{
+		*format = MD5_POSITION_FORMAT_FLOAT;
+		return 1;
+	}
+
+	if (!strcmp(name, "unorm16"))
+	{
+		*format = MD5_POSITION_FORMAT_UNORM16;
+		return 1;
+	}
+
+	if (!strcmp(name, "half"))
+	{
+		*format = MD5_POSITION_FORMAT_HALF;
+		return 1;
+	}
+
+	return 0;
+}
+
+size_t MD5PositionFormatGetVertexSize(MD5PositionFormat format)
+{
+	switch (format)
+	{
+		case MD5_POSITION_FORMAT_UNORM16:
+		case MD5_POSITION_FORMAT_HALF:
+			return sizeof(MD5PackedVertex);
+		default:
+			return sizeof(MD5Vertex);
+	}
+}
+
+/*
+** Converts c in -1 .. 1 to a signed normalized integer with bits bits.
+*/
+static unsigned int PackSnorm(float c, int bits)
+{
+	int max = (1 << (bits - 1)) - 1;
+	int i = 0;
+
+	c = c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c);
+	i = (int)(c*max + (c < 0.0f ? -0.5f : 0.5f));
+
+	return (unsigned int)i & ((1u << bits) - 1);
+}
+
+unsigned int MD5PackSnorm1010102(float x, float y, float z, float w)
+{
+	return PackSnorm(x, 10) | (PackSnorm(y, 10) << 10) | 
+		(PackSnorm(z, 10) << 20) | (PackSnorm(w, 2) << 30);
+}
+
+/*
+** Converts the signed normalized integer with bits bits at shift in packed
+** to a float in -1 .. 1.
+*/
+static float UnpackSnorm(unsigned int packed, int shift, int bits)
+{
+	int max = (1 << (bits - 1)) - 1;
+	int i = (int)((packed >> shift) & ((1u << bits) - 1));
+	float c = 0.0f;
+
+	/* sign extend */
+	i = i > max ? i - (1 << bits) : i;
+	c = (float)i/max;
+
+	return c < -1.0f ? -1.0f : c;
+}
+
+void MD5UnpackSnorm1010102(unsigned int packed, float* v)
+{
+	v[0] = UnpackSnorm(packed, 0, 10);
+	v[1] = UnpackSnorm(packed, 10, 10);
+	v[2] = UnpackSnorm(packed, 20, 10);
+	v[3] = UnpackSnorm(packed, 30, 2);
+}
+
+/*
+** Converts c in -1 .. 1 to a signed normalized byte.
+*/
+static signed char PackSnorm8(float c)
+{
+	c = c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c);
+
+	return (signed char)(c*127.0f + (c < 0.0f ? -0.5f : 0.5f));
+}
+
+void MD5PackOctahedralSnorm8(signed char* packed, float x, float y, float z)
+{
+	float sum = fabsf(x) + fabsf(y) + fabsf(z);
+	float u = 0.0f, v = 0.0f;
+
+	/* project onto the octahedron, the lower half is folded over the upper
+	** half 
+	*/
+	sum = sum > 0.0f ? sum : 1.0f;
+	u = x/sum;
+	v = y/sum;
+
+	if (z < 0.0f)
+	{
+		u = (1.0f - fabsf(y/sum))*(x >= 0.0f ? 1.0f : -1.0f);
+		v = (1.0f - fabsf(x/sum))*(y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	packed[0] = PackSnorm8(u);
+	packed[1] = PackSnorm8(v);
+}
+
+unsigned short MD5HalfMakeWithFloat(float f)
+{
+	unsigned int bits = 0;
+	unsigned int sign = 0;
+	int exponent = 0;
+	unsigned int mantissa = 0;
+
+	memcpy(&bits, &f, sizeof(float));
+	sign = (bits >> 16) & 0x8000;
+	exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	mantissa = bits & 0x007FFFFF;
+
+	/* nan and infinity */
+	if (((bits >> 23) & 0xFF) == 0xFF)
+	{
+		return (unsigned short)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+
+	/* too small for a normalized half */
+	if (exponent <= 0)
+	{
+		return (unsigned short)sign;
+	}
+
+	/* round to nearest */
+	mantissa += 0x1000;
+
+	if (mantissa & 0x00800000)
+	{
+		mantissa = 0;
+		exponent++;
+	}
+
+	/* too large */
+	if (exponent >= 31)
+	{
+		return (unsigned short)(sign | 0x7C00);
+	}
+
+	return (unsigned short)(sign | (exponent << 10) | (mantissa >> 13));
+}
+
+/*
+** Packs normal and tangent of vertex, see MD5PackedVertex.
+*/
+static void MD5PackVertexFrame(MD5PackedVertex* packed, const MD5Vertex* vertex)
+{
+	float t[4];
+
+	MD5UnpackSnorm1010102(vertex->tangent, t);
+	MD5PackOctahedralSnorm8(packed->tangent, t[0], t[1], t[2]);
+	packed->normal = (vertex->normal & 0x3FFFFFFF) | (vertex->tangent & 0xC0000000);
+}
+
+void MD5PositionFormatPack(
+	void* dst,
+	MD5PositionFormat format,
+	const MD5Vertex* vertices,
+	int numVertices,
+	const FxsVector3* min,
+	const FxsVector3* max
+)
+{
+	MD5PackedVertex* packed = (MD5PackedVertex*)dst;
+	const FxsVector3* p = NULL;
+	float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+	int i = 0;
+
+	switch (format)
+	{
+		case MD5_POSITION_FORMAT_UNORM16:
+			/* scale to 0 .. 65535, flat extents map to 0 */
+			sx = max->x > min->x ? 65535.0f/(max->x - min->x) : 0.0f;
+			sy = max->y > min->y ? 65535.0f/(max->y - min->y) : 0.0f;
+			sz = max->z > min->z ? 65535.0f/(max->z - min->z) : 0.0f;
+
+			for (i = 0; i < numVertices; i++)
+			{
+				p = &vertices[i].position;
+				packed[i].position[0] = (unsigned short)((p->x - min->x)*sx + 0.5f);
+				packed[i].position[1] = (unsigned short)((p->y - min->y)*sy + 0.5f);
+				packed[i].position[2] = (unsigned short)((p->z - min->z)*sz + 0.5f);
+				MD5PackVertexFrame(&packed[i], &vertices[i]);
+			}
+
+			break;
+
+		case MD5_POSITION_FORMAT_HALF:
+			for (i = 0; i < numVertices; i++)
+			{
+				p = &vertices[i].position;
+				packed[i].position[0] = MD5HalfMakeWithFloat(p->x - min->x);
+				packed[i].position[1] = MD5HalfMakeWithFloat(p->y - min->y);
+				packed[i].position[2] = MD5HalfMakeWithFloat(p->z - min->z);
+				MD5PackVertexFrame(&packed[i], &vertices[i]);
+			}
+
+			break;
+
+		default:
+			memcpy(dst, vertices, numVertices*sizeof(MD5Vertex));
+			break;
+	}
+}
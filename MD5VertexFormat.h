@@ -0,0 +1,126 @@
+/*
+ * Formats of the skinned vertex data uploaded to opengl
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5VERTEXFORMAT_H
+#define MD5VERTEXFORMAT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <Fxs/Math/Vector3.h>
+
+/*
+** Format of the positions in the vertex arena.
+*/
+typedef enum
+{
+	MD5_POSITION_FORMAT_FLOAT = 0, 	/* 3 floats, 12 bytes */
+	MD5_POSITION_FORMAT_UNORM16, 	/* 3 unsigned shorts normalized to the 
+									** bounding box of the submesh, 6 bytes */
+	MD5_POSITION_FORMAT_HALF 		/* 3 half floats relative to the min. of 
+									** the bounding box of the submesh, 6 bytes */
+}
+MD5PositionFormat;
+
+/*
+** A skinned vertex as produced by the skinning pass. Normal and tangent are
+** packed as signed normalized 10:10:10:2 integers (GL_INT_2_10_10_10_REV),
+** the w component of the tangent holds the handedness of the bitangent.
+**
+** This is also the layout of the vertex arena for MD5_POSITION_FORMAT_FLOAT.
+*/
+typedef struct
+{
+	FxsVector3 position;
+	unsigned int normal;
+	unsigned int tangent;
+}
+MD5Vertex;
+
+/*
+** Layout of the vertex arena for the 16 bit position formats, 12 bytes. The
+** tangent is octahedral encoded in 2 bytes (see MD5PackOctahedralSnorm8), 
+** the w component of the normal holds the handedness of the bitangent.
+*/
+typedef struct
+{
+	unsigned short position[3];
+	signed char tangent[2];
+	unsigned int normal;
+}
+MD5PackedVertex;
+
+/*
+** Parses the format from its name in a config file ("float", "unorm16" or 
+** "half"). Returns 0 if name is unknown.
+*/
+int MD5PositionFormatMakeWithName(MD5PositionFormat* format, const char* name);
+
+/*
+** Returns the size of a vertex in the vertex arena in bytes.
+*/
+size_t MD5PositionFormatGetVertexSize(MD5PositionFormat format);
+
+/*
+** Packs a (normalized) vector to a signed normalized 10:10:10:2 integer.
+*/
+unsigned int MD5PackSnorm1010102(float x, float y, float z, float w);
+
+/*
+** Unpacks a signed normalized 10:10:10:2 integer to v (4 floats).
+*/
+void MD5UnpackSnorm1010102(unsigned int packed, float* v);
+
+/*
+** Encodes the unit vector (x, y, z) with the octahedral mapping as 2 signed
+** normalized bytes. A shader recovers it from e = packed/127 with 
+** v = (e, 1 - |e.x| - |e.y|), replacing v.xy with 
+** (1 - |e.yx|)*(e.x >= 0 ? 1 : -1, e.y >= 0 ? 1 : -1) if v.z < 0, and 
+** normalizing v.
+*/
+void MD5PackOctahedralSnorm8(signed char* packed, float x, float y, float z);
+
+/*
+** Converts a float to a IEEE 754 half float. Rounds to nearest, overflows 
+** to infinity and flushes values too small for a normalized half to zero.
+*/
+unsigned short MD5HalfMakeWithFloat(float f);
+
+/*
+** Packs numVertices vertices into dst in format. min and max are the 
+** bounds of the positions.
+**
+** For unorm16 the shader recovers a position with min + p*(max - min),
+** for half with min + p and for float p is the position itself. 
+*/
+void MD5PositionFormatPack(
+	void* dst,
+	MD5PositionFormat format,
+	const MD5Vertex* vertices,
+	int numVertices,
+	const FxsVector3* min,
+	const FxsVector3* max
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5VERTEXFORMAT_H */
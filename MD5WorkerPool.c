@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "MD5WorkerPool.h"
+
+/*
+** Argument of a thread.
+*/
+typedef struct
+{
+	MD5WorkerPool* pool;
+	int worker;
+}
+Worker;
+
+static void* WorkerRun(void* arg)
+{
+	Worker* worker = (Worker*)arg;
+	MD5WorkerPool* pool = worker->pool;
+	int index = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (1)
+	{
+		while (!pool->quit && pool->nextJob >= pool->numJobs)
+		{
+			pthread_cond_wait(&pool->started, &pool->mutex);
+		}
+
+		if (pool->quit)
+		{
+			break;
+		}
+
+		/* run the job without holding the lock */
+		index = pool->nextJob++;
+		pthread_mutex_unlock(&pool->mutex);
+		pool->job(pool->data, index, worker->worker);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (++pool->numFinished == pool->numJobs)
+		{
+			pthread_cond_broadcast(&pool->finished);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	free(worker);
+
+	return NULL;
+}
+
+int MD5WorkerPoolCreate(MD5WorkerPool* pool, int numThreads)
+{
+	Worker* worker = NULL;
+	int i = 0;
+
+	memset(pool, 0, sizeof(MD5WorkerPool));
+	pool->threads = (pthread_t*)malloc((numThreads + 1)*sizeof(pthread_t));
+
+	if (!pool->threads)
+	{
+		return 0;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->started, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+
+	for (i = 0; i < numThreads; i++)
+	{
+		worker = (Worker*)malloc(sizeof(Worker));
+
+		if (!worker)
+		{
+			MD5WorkerPoolDestroy(pool);
+			return 0;
+		}
+
+		worker->pool = pool;
+		worker->worker = i;
+
+		if (pthread_create(&pool->threads[i], NULL, WorkerRun, worker))
+		{
+			free(worker);
+			MD5WorkerPoolDestroy(pool);
+			return 0;
+		}
+
+		pool->numThreads++;
+	}
+
+	return 1;
+}
+
+void MD5WorkerPoolRun(
+	MD5WorkerPool* pool,
+	MD5WorkerPoolJob job,
+	void* data,
+	int numJobs
+)
+{
+	MD5WorkerPoolWait(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->job = job;
+	pool->data = data;
+	pool->numJobs = numJobs;
+	pool->nextJob = 0;
+	pool->numFinished = 0;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void MD5WorkerPoolWait(MD5WorkerPool* pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->numFinished < pool->numJobs)
+	{
+		pthread_cond_wait(&pool->finished, &pool->mutex);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void MD5WorkerPoolDestroy(MD5WorkerPool* pool)
+{
+	int i = 0;
+
+	if (!pool->threads)
+	{
+		return;
+	}
+
+	MD5WorkerPoolWait(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->numThreads; i++)
+	{
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->finished);
+	pthread_cond_destroy(&pool->started);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	memset(pool, 0, sizeof(MD5WorkerPool));
+}
@@ -0,0 +1,89 @@
+/*
+ * Pool of worker threads running batches of jobs
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MD5WORKERPOOL_H
+#define MD5WORKERPOOL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <pthread.h>
+
+/*
+** A job of a batch. worker is the index of the thread running the job,
+** e.g. for selecting per thread memory.
+*/
+typedef void (*MD5WorkerPoolJob)(void* data, int index, int worker);
+
+/*
+** A fixed # of threads running one batch of jobs at a time. A batch is
+** started with MD5WorkerPoolRun and runs asynchronously until
+** MD5WorkerPoolWait, which acts as the fence between the caller and the
+** workers.
+*/
+typedef struct
+{
+	pthread_t* threads;
+	int numThreads;
+	pthread_mutex_t mutex;
+	pthread_cond_t started; 	/* signaled when a batch starts or the pool
+								** is destroyed */
+	pthread_cond_t finished; 	/* signaled when the last job finished */
+
+	/* the current batch */
+	MD5WorkerPoolJob job;
+	void* data;
+	int numJobs;
+	int nextJob; 				/* index of the next job to run */
+	int numFinished;
+	int quit;
+}
+MD5WorkerPool;
+
+/*
+** Creates a pool of numThreads threads. Returns 0 if it fails.
+*/
+int MD5WorkerPoolCreate(MD5WorkerPool* pool, int numThreads);
+
+/*
+** Starts running job for the indices 0 .. numJobs - 1. Waits for the
+** previous batch first.
+*/
+void MD5WorkerPoolRun(
+	MD5WorkerPool* pool,
+	MD5WorkerPoolJob job,
+	void* data,
+	int numJobs
+);
+
+/*
+** Waits until all jobs of the current batch finished.
+*/
+void MD5WorkerPoolWait(MD5WorkerPool* pool);
+
+/*
+** Waits for the current batch and destroys the pool.
+*/
+void MD5WorkerPoolDestroy(MD5WorkerPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5WORKERPOOL_H */